@@ -0,0 +1,156 @@
+#include <csignal>
+#include <fstream>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+
+#include "src/Testing/Benchmarks.h"
+#include "src/Testing/ConnectionScalingTest.h"
+#include "src/Testing/AllocationTest.h"
+#include "src/Testing/BehaviourTest.h"
+
+using namespace src::Testing;
+
+//region Counting global allocator
+static atomic<unsigned long long> allocationCount{0};
+
+void *operator new(size_t size) {
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    if (void *ptr = malloc(size ? size : 1))
+        return ptr;
+    throw bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+//endregion
+
+void printUsage() {
+    cout << "Usage: EpollChatBench micro [--out results.csv] [--baseline baseline.csv] [--tolerance 0.25]\n"
+            "       EpollChatBench scaling [--max 20000] [--step 2000] [--out report.csv]\n"
+            "       EpollChatBench allocs\n"
+            "       EpollChatBench logins [--count 200]\n"
+            "       EpollChatBench checks" << endl;
+}
+
+int runMicro(int argc, char **argv) {
+    string outPath, baselinePath;
+    double tolerance = 0.25;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        string flag = argv[i];
+        if (flag == "--out")
+            outPath = argv[i + 1];
+        else if (flag == "--baseline")
+            baselinePath = argv[i + 1];
+        else if (flag == "--tolerance")
+            tolerance = stod(argv[i + 1]);
+        else {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    cout << "Running microbenchmarks:" << endl;
+    auto results = Benchmarks::RunAll();
+
+    if (!outPath.empty()) {
+        ofstream out(outPath);
+        Benchmarks::WriteCSV(results, out);
+        cout << "Results written to '" << outPath << "'" << endl;
+    } else
+        Benchmarks::WriteCSV(results, cout);
+
+    if (!baselinePath.empty()) {
+        ifstream in(baselinePath);
+        if (!in) {
+            cerr << "Failed to open baseline '" << baselinePath << "'" << endl;
+            return EXIT_FAILURE;
+        }
+        auto baseline = Benchmarks::ReadCSV(in);
+        if (Benchmarks::CompareToBaseline(results, baseline, tolerance, cout))
+            return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int runScaling(int argc, char **argv) {
+    unsigned long maxConnections = 20000, step = 2000;
+    string outPath;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        string flag = argv[i];
+        if (flag == "--max")
+            maxConnections = stoul(argv[i + 1]);
+        else if (flag == "--step")
+            step = stoul(argv[i + 1]);
+        else if (flag == "--out")
+            outPath = argv[i + 1];
+        else {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    cout << "Running connection scaling test:" << endl;
+    auto samples = ConnectionScalingTest::Run(maxConnections, step);
+    cout << endl;
+    ConnectionScalingTest::WriteReport(samples, cout);
+    if (!outPath.empty()) {
+        ofstream out(outPath);
+        ConnectionScalingTest::WriteCSV(samples, out);
+        cout << "Curves written to '" << outPath << "'" << endl;
+    }
+    return EXIT_SUCCESS;
+}
+
+int runAllocations() {
+    cout << "Counting allocations per request:" << endl;
+    bool passed = AllocationTest::Run([]() { return allocationCount.load(memory_order_relaxed); }, cout);
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int runLogins(int argc, char **argv) {
+    unsigned long count = 200;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        string flag = argv[i];
+        if (flag == "--count")
+            count = stoul(argv[i + 1]);
+        else {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    cout << "Running login burst test:" << endl;
+    ConnectionScalingTest::LoginBurst(count, cout);
+    return EXIT_SUCCESS;
+}
+
+int runChecks() {
+    cout << "Running behaviour checks:" << endl;
+    bool passed = BehaviourTest::Run(cout);
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char **argv) {
+    signal(SIGPIPE, SIG_IGN);
+
+    string mode = (argc > 1) ? argv[1] : "micro";
+    if (mode == "micro")
+        return runMicro(argc, argv);
+    if (mode == "scaling")
+        return runScaling(argc, argv);
+    if (mode == "allocs")
+        return runAllocations();
+    if (mode == "logins")
+        return runLogins(argc, argv);
+    if (mode == "checks")
+        return runChecks();
+
+    printUsage();
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,138 @@
+#include "AllocationTest.h"
+
+#include <iomanip>
+#include <chrono>
+#include <deque>
+#include <malloc.h>
+
+using namespace std;
+
+namespace src::Testing {
+
+    static IntrusivePtr<Client> MakeSinkClient() {
+        int fd = open("/dev/null", O_WRONLY);
+        if (fd == -1) {
+            perror("open(/dev/null)");
+            exit(EXIT_FAILURE);
+        }
+        return MakePooled<Client>(fd, sockaddr_storage{}, false);
+    }
+
+    bool AllocationTest::Run(const function<unsigned long long()> &allocations, ostream &out) {
+        Server server("AllocationServer");
+        bool passed = SendMessage(server, allocations, out);
+        passed &= ConnectionChurn(server, allocations, out);
+        return passed;
+    }
+
+    bool AllocationTest::SendMessage(Server &server, const function<unsigned long long()> &allocations,
+                                     ostream &out) {
+        const string msg = "hello there, this is a message of a fairly typical length";
+
+        //region Setup a room of logged-in members
+        IntrusivePtr<Client> hostConnection;
+        shared_ptr<ChatRoom> room;
+        for (int i = 0; i < ROOM_SIZE; i++) {
+            auto connection = MakeSinkClient();
+            auto account = make_shared<Account>("member" + to_string(i), KeyHasher::Hash("key", 1));
+            account->Attach(connection, server.RequestArena);
+            connection->SetOwner(account);
+            server.PushConnection(connection);
+            server.PushAccount(account);
+            if (!room) {
+                hostConnection = connection;
+                server.PushRoom(make_shared<ChatRoom>("AllocationRoom", account));
+                room = server.GetRoom(-1);
+            }
+            room->PushMember(account);
+        }
+        Hash hostID = server.GetAccount(0)->ID;
+
+        // Growth of the long-lived containers is amortized and not what is being measured.
+        server.ServerLog.reserve(4 * BATCH);
+        room->Messages.reserve(4 * BATCH);
+
+        auto pushBatch = [&]() {
+            string data = " " + to_string(room->ID) + "|" + msg + " ";
+            for (int i = 0; i < BATCH; i++)
+                server.PushRequest(hostConnection->ID,
+                                   MakePooled<ServerRequest>(ServerActionType::SendMessage,
+                                                             hostConnection->FileDescriptor, data));
+        };
+        //endregion
+
+        //region Measure
+        // The first batch grows the arena and the per-thread metrics shard to their steady-state size.
+        pushBatch();
+        server.EnactRespond();
+
+        pushBatch();
+        unsigned long long before = allocations();
+        server.EnactRespond();
+        unsigned long long total = allocations() - before;
+
+        before = allocations();
+        for (int i = 0; i < BATCH; i++) {
+            Hash id = server.msgCount.fetch_add(1) + 1;
+            server.EmplaceMessage(id, tuple<Hash, Hash, string>(room->ID, hostID, string(msg)));
+            room->Messages.emplace_back(id, hostID, msg);
+            server.LogMessage(msg);
+        }
+        server.RequestArena.Reset();
+        unsigned long long retained = allocations() - before;
+        //endregion
+
+        double perOp = (double) total / BATCH, retainedPerOp = (double) retained / BATCH;
+        bool passed = total <= retained;
+        out << "  " << left << setw(32) << ("SendMessage/" + to_string(ROOM_SIZE)) << right << fixed
+            << setprecision(2) << "allocations/op " << perOp << "  retained/op " << retainedPerOp
+            << "  handler/op " << max(0.0, perOp - retainedPerOp) << (passed ? "  OK" : "  FAIL") << endl;
+        return passed;
+    }
+
+    bool AllocationTest::ConnectionChurn(Server &server, const function<unsigned long long()> &allocations,
+                                         ostream &out) {
+        auto &pool = ObjectPool<Client>::Instance();
+        deque<int> live;
+
+        auto cycle = [&]() {
+            int fd = open("/dev/null", O_WRONLY);
+            if (fd == -1) {
+                perror("open(/dev/null)");
+                exit(EXIT_FAILURE);
+            }
+            server.PushConnection(MakePooled<Client>(fd, sockaddr_storage{}, true));
+            live.push_back(fd);
+            if (live.size() > CHURN_WINDOW) {
+                server.RemoveConnection(live.front());
+                live.pop_front();
+            }
+        };
+
+        for (int i = 0; i < 4 * CHURN_WINDOW; i++)
+            cycle();
+
+        size_t capacity = pool.Capacity();
+        size_t heap = mallinfo2().uordblks;
+        unsigned long long before = allocations();
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < CHURN_CYCLES; i++)
+            cycle();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        unsigned long long total = allocations() - before;
+        long long heapGrowth = (long long) mallinfo2().uordblks - (long long) heap;
+        long long poolGrowth = (long long) pool.Capacity() - (long long) capacity;
+
+        for (int fd: live)
+            server.RemoveConnection(fd);
+
+        bool passed = poolGrowth == 0 && heapGrowth <= 0;
+        out << "  " << left << setw(32) << ("ConnectionChurn/" + to_string(CHURN_WINDOW)) << right << fixed
+            << setprecision(0) << "connects/s " << CHURN_CYCLES / seconds << setprecision(2)
+            << "  allocations/connect " << (double) total / CHURN_CYCLES
+            << "  pool growth " << poolGrowth << "  heap growth " << heapGrowth << "B"
+            << "  idle footprint " << ObjectPool<Client>::SlotSize() + sizeof(IntrusivePtr<Client>) << "B"
+            << (passed ? "  OK" : "  FAIL") << endl;
+        return passed;
+    }
+} // Testing
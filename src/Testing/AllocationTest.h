@@ -0,0 +1,35 @@
+#ifndef EPOLLCHAT_ALLOCATIONTEST_H
+#define EPOLLCHAT_ALLOCATIONTEST_H
+
+#include <functional>
+#include <iostream>
+
+#include "../classes/server/Server.h"
+
+namespace src::Testing {
+
+    // Allocation behaviour of the hot paths. 'allocations' returns the number of global operator new
+    // calls made by the process so far; the counting operator new lives in the bench binary so the
+    // chat client is not affected.
+    class AllocationTest {
+    public:
+        static bool Run(const function<unsigned long long()> &allocations, ostream &out);
+    private:
+        static const int ROOM_SIZE = 10;
+        static const int BATCH = 1000;
+        static const int CHURN_WINDOW = 1000;
+        static const int CHURN_CYCLES = 200000;
+
+        // Counts global allocations made by Server::EnactRespond on a warmed-up SendMessage batch and
+        // compares them with what the retained state alone costs (the message history entries and the
+        // log line). Everything beyond that is a handler temporary and must come from the request arena.
+        static bool SendMessage(Server &server, const function<unsigned long long()> &allocations, ostream &out);
+        // Connects and drops CHURN_CYCLES clients through the server with CHURN_WINDOW of them alive at
+        // a time. Once warmed up, neither the client pool nor the heap may grow.
+        static bool ConnectionChurn(Server &server, const function<unsigned long long()> &allocations,
+                                    ostream &out);
+    };
+
+} // Testing
+
+#endif //EPOLLCHAT_ALLOCATIONTEST_H
@@ -0,0 +1,1242 @@
+#include "BehaviourTest.h"
+
+#include <iomanip>
+#include <random>
+#include <set>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <sys/socket.h>
+
+#include "../classes/server/MemberSet.h"
+
+using namespace std;
+
+namespace src::Testing {
+
+    bool BehaviourTest::Run(ostream &out) {
+        bool passed = RequestParsing(out);
+        passed &= Membership(out);
+        // The same checks have to pass whether the rooms run on the reactor or on their shards.
+        passed &= RoomRequests(0, out);
+        passed &= RoomRequests(4, out);
+        passed &= HistoryPaging(out);
+        passed &= ResyncDeltas(0, out);
+        passed &= ResyncDeltas(4, out);
+        passed &= MemberChanges(0, out);
+        passed &= MemberChanges(4, out);
+        passed &= Subscriptions(0, out);
+        passed &= Subscriptions(4, out);
+        passed &= ConcurrentSubscribe(out);
+        passed &= ReadCursors(0, out);
+        passed &= ReadCursors(4, out);
+        passed &= Sessions(0, out);
+        passed &= Sessions(4, out);
+        passed &= Mailbox(out);
+        passed &= Coalescing(out);
+        passed &= PresenceChanges(0, out);
+        passed &= PresenceChanges(4, out);
+        return passed;
+    }
+
+    bool BehaviourTest::Check(const string &name, bool passed, ostream &out) {
+        out << "  " << left << setw(48) << name << (passed ? "OK" : "FAIL") << endl;
+        return passed;
+    }
+
+    //region Harness
+    BehaviourTest::Session BehaviourTest::Connect(Server &server) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == -1) {
+            perror("socketpair");
+            exit(EXIT_FAILURE);
+        }
+        auto client = MakePooled<Client>(fds[0], sockaddr_storage{}, true);
+        client->Coalescer = server.Coalescing.get();
+        server.PushConnection(client);
+        return {client, fds[1], "", {}};
+    }
+
+    void BehaviourTest::Disconnect(Server &server, Session &session) {
+        session.Connection->Close();
+        server.RemoveConnection(session.Connection->FileDescriptor);
+        close(session.Peer);
+    }
+
+    void BehaviourTest::Send(Server &server, Session &session, ServerActionType type, const string &data) {
+        string frame = ServerRequest(type, session.Connection->FileDescriptor, data).Serialize();
+        RequestView view{};
+        RequestParser::ParseFrame(frame, view);
+        auto request = MakePooled<ServerRequest>(view.Type, view.TargetFD);
+        request->Data = view.Data;
+        server.PushRequest(session.Connection->ID, request);
+    }
+
+    void BehaviourTest::Pump(Server &server, int millis) {
+        server.EnactRespond();
+        EpollEvent events[MAX_EVENTS];
+        int n = epoll_wait(server.EpollFD, events, MAX_EVENTS, millis);
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == server.VerifierFD)
+                server.Verifier->RunCompletions();
+            else if (fd == server.PresenceFD)
+                server.FlushPresence();
+            else if (fd == server.BumpsFD)
+                server.FlushUnread();
+            else if (fd == server.CoalesceFD)
+                server.Coalescing->Flush();
+        }
+        server.EnactRespond();
+    }
+
+    void BehaviourTest::Settle(Server &server, int millis) {
+        auto until = chrono::steady_clock::now() + chrono::milliseconds(millis);
+        while (chrono::steady_clock::now() < until)
+            Pump(server, 1);
+    }
+
+    void BehaviourTest::Receive(Session &session, vector<ClientResponse> *replies) {
+        char buff[IO_BUFFER_SIZE];
+        ssize_t b_rec;
+        while ((b_rec = recv(session.Peer, buff, sizeof buff, MSG_DONTWAIT)) > 0)
+            session.Pending.append(buff, b_rec);
+
+        size_t length;
+        while ((length = RequestParser::FrameLength(session.Pending)) > 0) {
+            auto frame = ClientResponse::Deserialize(session.Pending.substr(0, length));
+            session.Pending.erase(0, length);
+            if (frame.Type == ClientActionType::EventBatch)
+                ClientResponse::ParseEvents(frame.Data, frame.TargetFD, session.Events);
+            else if (frame.Type != ClientActionType::InformSuccess && frame.Type != ClientActionType::InformFailure)
+                session.Events.push_back(std::move(frame));
+            else if (replies)
+                replies->push_back(std::move(frame));
+        }
+    }
+
+    vector<ClientResponse> BehaviourTest::AwaitReplies(Server &server, Session &session, size_t count) {
+        vector<ClientResponse> replies;
+        auto until = chrono::steady_clock::now() + chrono::milliseconds(REPLY_TIMEOUT_MS);
+        while (replies.size() < count && chrono::steady_clock::now() < until) {
+            Pump(server, 1);
+            Receive(session, &replies);
+        }
+        return replies;
+    }
+
+    ClientResponse BehaviourTest::Request(Server &server, Session &session, ServerActionType type,
+                                          const string &data) {
+        Send(server, session, type, data);
+        auto replies = AwaitReplies(server, session, 1);
+        return replies.empty() ? ClientResponse() : replies.front();
+    }
+
+    Hash BehaviourTest::SignUp(Server &server, Session &session, const string &name) {
+        Hash id = 0;
+        stringstream{Request(server, session, ServerActionType::RegisterAccount, name + " | key").Data} >> id;
+        Request(server, session, ServerActionType::LoginAccount, to_string(id) + " key");
+        return id;
+    }
+
+    Hash BehaviourTest::CreateRoom(Server &server, Session &session, const string &name) {
+        Hash id = 0;
+        stringstream{Request(server, session, ServerActionType::CreateRoom, name).Data} >> id;
+        return id;
+    }
+    //endregion
+
+    bool BehaviourTest::RequestParsing(ostream &out) {
+        bool passed = true;
+
+        //region Frames
+        const string frame = ServerRequest(ServerActionType::SendMessage, 7, "3|hello there").Serialize();
+        passed &= Check("RequestParser/FrameLength/partial",
+                        RequestParser::FrameLength(frame.substr(0, frame.size() - 1)) == 0 &&
+                        RequestParser::FrameLength(frame.substr(0, frame.find(DATA_END))) == 0, out);
+        passed &= Check("RequestParser/FrameLength/stream",
+                        RequestParser::FrameLength(frame + frame.substr(0, 5)) == frame.size(), out);
+        // A DELIMITER_END in the data does not end the frame, only the one after its DATA_END does.
+        const string bracketed = ServerRequest(ServerActionType::SendMessage, 7, "3|a]b").Serialize();
+        passed &= Check("RequestParser/FrameLength/bracket in data",
+                        RequestParser::FrameLength(bracketed) == bracketed.size(), out);
+
+        RequestView view{};
+        SendMessagePayload message{};
+        passed &= Check("RequestParser/ParseFrame",
+                        RequestParser::ParseFrame(frame, view) && view.Type == ServerActionType::SendMessage &&
+                        view.TargetFD == 7 && RequestParser::Parse(view.Data, message) && message.RoomID == 3 &&
+                        message.Message == "hello there", out);
+        passed &= Check("RequestParser/ParseFrame/malformed",
+                        !RequestParser::ParseFrame("7 3 ( x ) ]", view) &&
+                        !RequestParser::ParseFrame("[ x 3 ( x ) ]", view) &&
+                        !RequestParser::ParseFrame("[ 7 3 x ) ]", view), out);
+        //endregion
+
+        //region Payloads
+        CredentialsPayload credentials{};
+        passed &= Check("RequestParser/Credentials",
+                        RequestParser::Parse(" 42 secret key ", credentials) && credentials.ID == 42 &&
+                        credentials.Key == "secret key" && !RequestParser::Parse(" x key ", credentials), out);
+
+        RegisterPayload registration{};
+        passed &= Check("RequestParser/Register",
+                        RequestParser::Parse(" ariel | 1 ", registration) && registration.Name == "ariel" &&
+                        registration.Key == "1" && !RequestParser::Parse(" ariel 1 ", registration) &&
+                        !RequestParser::Parse(" | ", registration), out);
+
+        CreateRoomPayload room{};
+        passed &= Check("RequestParser/CreateRoom",
+                        RequestParser::Parse(" lobby ", room) && room.Name == "lobby" &&
+                        !RequestParser::Parse("  ", room), out);
+
+        MembersPayload members{};
+        string tooMany = " 1";
+        for (int i = 0; i <= MEMBERS_MAX_IDS; i++)
+            tooMany += " " + to_string(i + 2);
+        passed &= Check("RequestParser/Members",
+                        RequestParser::Parse(" 9 4 5 6 ", members) && members.RoomID == 9 && members.Count == 3 &&
+                        members.IDs[2] == 6 && !RequestParser::Parse(" 9 ", members) &&
+                        !RequestParser::Parse(" 9 4 x ", members) && !RequestParser::Parse(tooMany, members), out);
+
+        // Messages are length-prefixed, so they may hold separators and digits of their own.
+        SendMessagesPayload batch{};
+        passed &= Check("RequestParser/SendMessages",
+                        RequestParser::Parse(" 3 5|a b|c 4 2|12 ", batch) && batch.Count == 2 &&
+                        batch.Messages[0] == pair<Hash, string_view>(3, "a b|c") &&
+                        batch.Messages[1] == pair<Hash, string_view>(4, "12") &&
+                        !RequestParser::Parse(" 3 9|short ", batch) &&
+                        !RequestParser::Parse(" 3 2|abc ", batch) && !RequestParser::Parse("  ", batch), out);
+
+        HistoryPayload history{};
+        passed &= Check("RequestParser/History",
+                        RequestParser::Parse(" 3 120 50 ", history) && history.RoomID == 3 &&
+                        history.Cursor == 120 && history.Limit == 50 && !RequestParser::Parse(" 3 120 ", history), out);
+
+        ResyncPayload resync{};
+        AckReadPayload acks{};
+        passed &= Check("RequestParser/NumberPairs",
+                        RequestParser::Parse(" 1 10 2 20 ", resync) && resync.Count == 2 &&
+                        resync.Rooms[1] == pair<Hash, Hash>(2, 20) && !RequestParser::Parse(" 1 10 2 ", resync) &&
+                        RequestParser::Parse(" 5 7 ", acks) && acks.Count == 1 &&
+                        !RequestParser::Parse("  ", acks), out);
+        //endregion
+
+        return passed;
+    }
+
+    bool BehaviourTest::Membership(ostream &out) {
+        bool passed = true;
+        auto account = [](Hash id) {
+            auto result = make_shared<Account>("member", KeyRecord{});
+            result->ID = id;
+            return result;
+        };
+        // Every view of the set agrees with the model: lookups, the dense arrays and the bitset.
+        auto agrees = [](const MemberSet &members, const set<Hash> &model) -> bool {
+            if (members.Size() != model.size())
+                return false;
+            set<Hash> dense, bits;
+            for (size_t i = 0; i < members.Size(); i++) {
+                if (members[i]->ID != members.IDAt(i) || !model.count(members.IDAt(i)))
+                    return false;
+                dense.insert(members.IDAt(i));
+            }
+            for (auto [word, mask]: members.Words())
+                for (Hash bit = 0; bit < 64; bit++)
+                    if (mask & (1ULL << bit))
+                        bits.insert(word * 64 + bit);
+            for (Hash id: model) {
+                auto member = members.Get(id);
+                if (!members.Contains(id) || !member || (*member)->ID != id)
+                    return false;
+            }
+            return dense == model && bits == model;
+        };
+
+        //region Random joins and leaves
+        MemberSet members;
+        set<Hash> model;
+        mt19937 rng(7);
+        uniform_int_distribution<Hash> ids(1, 600);
+        bool consistent = true;
+        for (int i = 0; i < 20000 && consistent; i++) {
+            Hash id = ids(rng);
+            if (rng() % 3)
+                consistent = members.Insert(account(id)) == model.insert(id).second;
+            else
+                consistent = members.Erase(id) == (model.erase(id) == 1);
+            if (i % 97 == 0)
+                consistent &= agrees(members, model);
+        }
+        passed &= Check("MemberSet/random joins and leaves", consistent && agrees(members, model), out);
+
+        while (!model.empty()) {
+            consistent &= members.Erase(*model.begin());
+            model.erase(model.begin());
+        }
+        passed &= Check("MemberSet/emptied", consistent && agrees(members, model) && members.Words().empty() &&
+                                             !members.Contains(ids(rng)), out);
+        //endregion
+
+        //region Leaves from a probe run
+        // IDs sharing a home slot in the initial table of 8 (MemberSet::Home), few enough for no rehash.
+        auto home = [](Hash id) { return (id * 11400714819323198485ULL) >> 32 & 7; };
+        vector<Hash> run{1};
+        for (Hash id = 2; run.size() < 3; id++)
+            if (home(id) == home(run.front()))
+                run.push_back(id);
+        MemberSet collided;
+        for (Hash id: run)
+            collided.Insert(account(id));
+        // Leaving the head of the run shifts the other two back, leaving its middle then closes the new hole.
+        bool shifted = collided.Erase(run[0]) && !collided.Contains(run[0]) && collided.Contains(run[1]) &&
+                       collided.Contains(run[2]) && collided.Erase(run[1]) && collided.Contains(run[2]) &&
+                       collided.Insert(account(run[0])) && collided.Contains(run[0]) &&
+                       agrees(collided, {run[0], run[2]});
+        passed &= Check("MemberSet/backward-shift delete", shifted, out);
+        //endregion
+
+        return passed;
+    }
+
+    bool BehaviourTest::RoomRequests(unsigned shards, ostream &out) {
+        const string mode = shards ? "Sharded/" : "Inline/";
+        const int MESSAGES = 64;
+        bool passed = true;
+        Server server("BehaviourServer", shards);
+        server.KeyCost = 1;
+
+        Session host = Connect(server), member = Connect(server), outsider = Connect(server),
+                guest = Connect(server);
+        SignUp(server, host, "host");
+        Hash memberID = SignUp(server, member, "member");
+        Hash outsiderID = SignUp(server, outsider, "outsider");
+        Hash rooms[2];
+        for (int r = 0; r < 2; r++) {
+            rooms[r] = CreateRoom(server, host, "room" + to_string(r));
+            Request(server, host, ServerActionType::AddMember, to_string(rooms[r]) + " " + to_string(memberID));
+        }
+        Settle(server, 20);
+        Receive(member, nullptr);
+        member.Events.clear();
+
+        //region Ordering
+        // Every message is queued before any is enacted, so the two rooms' shards run them side by side.
+        for (int i = 0; i < MESSAGES; i++)
+            for (Hash room: rooms)
+                Send(server, host, ServerActionType::SendMessage, to_string(room) + "|m" + to_string(i));
+        auto replies = AwaitReplies(server, host, 2 * MESSAGES);
+        passed &= Check(mode + "SendMessage/replies", replies.size() == 2 * MESSAGES &&
+                        all_of(replies.begin(), replies.end(), [](const ClientResponse &reply) {
+                            return reply.Type == ClientActionType::InformSuccess;
+                        }), out);
+
+        Settle(server, 50);
+        Receive(member, nullptr);
+        map<Hash, vector<pair<Hash, string>>> received;
+        for (auto &event: member.Events) {
+            if (event.Type != ClientActionType::MessageIn)
+                continue;
+            //format {roomID} {seq} {senderID} [msg]
+            Hash room, seq, sender;
+            string msg;
+            stringstream{event.Data} >> room >> seq >> sender >> msg;
+            received[room].emplace_back(seq, msg);
+        }
+        bool ordered = received.size() == 2;
+        for (Hash room: rooms) {
+            auto &messages = received[room];
+            ordered &= messages.size() == MESSAGES;
+            for (size_t i = 0; ordered && i < messages.size(); i++)
+                ordered = messages[i].second == "m" + to_string(i) &&
+                          (i == 0 || messages[i].first == messages[i - 1].first + 1);
+        }
+        passed &= Check(mode + "SendMessage/per-room order", ordered, out);
+        //endregion
+
+        //region Refusals, both the reactor's and the room owner's
+        string room = to_string(rooms[0]);
+        auto refused = [&](Session &session, ServerActionType type, const string &data) {
+            return Request(server, session, type, data).Type == ClientActionType::InformFailure;
+        };
+        passed &= Check(mode + "SendMessage/refused",
+                        refused(guest, ServerActionType::SendMessage, room + "|x") &&
+                        refused(outsider, ServerActionType::SendMessage, room + "|x") &&
+                        refused(host, ServerActionType::SendMessage, "999999|x") &&
+                        refused(host, ServerActionType::SendMessage, "x"), out);
+        passed &= Check(mode + "AddMember/refused",
+                        refused(outsider, ServerActionType::AddMember, room + " " + to_string(outsiderID)) &&
+                        refused(host, ServerActionType::AddMember, room + " 999999") &&
+                        refused(host, ServerActionType::AddMember, "999999 " + to_string(outsiderID)), out);
+        passed &= Check(mode + "RemoveMember/refused",
+                        refused(host, ServerActionType::RemoveMember, room + " " + to_string(outsiderID)) &&
+                        refused(outsider, ServerActionType::RemoveMember, room + " " + to_string(memberID)), out);
+
+        // The refusals left the room as it was: the member still gets the host's messages, the outsider does not.
+        member.Events.clear();
+        outsider.Events.clear();
+        bool delivered = Request(server, host, ServerActionType::SendMessage, room + "|after").Type ==
+                         ClientActionType::InformSuccess;
+        Settle(server, 20);
+        Receive(member, nullptr);
+        Receive(outsider, nullptr);
+        passed &= Check(mode + "refusals leave the room as it was",
+                        delivered && member.Events.size() == 1 && outsider.Events.empty(), out);
+        //endregion
+
+        for (Session *session: {&host, &member, &outsider, &guest})
+            Disconnect(server, *session);
+        return passed;
+    }
+
+    bool BehaviourTest::HistoryPaging(ostream &out) {
+        const int MESSAGES = 25;
+        bool passed = true;
+        Server server("BehaviourServer", 0);
+        server.KeyCost = 1;
+
+        Session host = Connect(server), member = Connect(server), outsider = Connect(server);
+        SignUp(server, host, "host");
+        Hash memberID = SignUp(server, member, "member");
+        SignUp(server, outsider, "outsider");
+        // Adding the first member makes the host one as well.
+        Hash room = CreateRoom(server, host, "history"), other = CreateRoom(server, host, "other");
+        for (Hash id: {room, other})
+            Request(server, host, ServerActionType::AddMember, to_string(id) + " " + to_string(memberID));
+
+        // The other room's messages interleave, so the room's message ids have gaps.
+        vector<Hash> ids;
+        for (int i = 0; i < MESSAGES; i++) {
+            Hash id;
+            stringstream{Request(server, host, ServerActionType::SendMessage,
+                                 to_string(room) + "|h" + to_string(i)).Data} >> id;
+            ids.push_back(id);
+            Request(server, host, ServerActionType::SendMessage, to_string(other) + "|o" + to_string(i));
+        }
+        Settle(server, 10);
+        Receive(host, nullptr);
+        host.Events.clear();
+
+        struct Page {
+            bool Sent;
+            Hash Next;
+            vector<tuple<Hash, Hash, Hash, string>> Entries;
+        };
+        auto fetch = [&](Hash cursor, unsigned limit) {
+            Page page{false, 0, {}};
+            auto reply = Request(server, host, ServerActionType::FetchHistory,
+                                 to_string(room) + " " + to_string(cursor) + " " + to_string(limit));
+            Receive(host, nullptr);
+            //format {roomID} {next} {sent}
+            Hash roomID;
+            size_t sent;
+            stringstream{reply.Data} >> roomID >> page.Next >> sent;
+            for (auto &event: host.Events) {
+                Hash batchRoom;
+                if (event.Type == ClientActionType::HistoryBatch)
+                    ClientResponse::ParseHistory(event.Data, batchRoom, page.Entries);
+            }
+            host.Events.clear();
+            page.Sent = reply.Type == ClientActionType::InformSuccess && roomID == room && sent == page.Entries.size();
+            return page;
+        };
+        // The page holds the room's messages [from, to), oldest first.
+        auto holds = [&](const Page &page, size_t from, size_t to) {
+            if (!page.Sent || page.Entries.size() != to - from)
+                return false;
+            for (size_t i = from; i < to; i++) {
+                auto &[msgID, seq, sender, content] = page.Entries[i - from];
+                if (msgID != ids[i] || seq != i + 1 || content != "h" + to_string(i))
+                    return false;
+            }
+            return true;
+        };
+
+        //region Cursors
+        auto newest = fetch(0, 10);
+        auto middle = fetch(newest.Next, 10);
+        auto oldest = fetch(middle.Next, 10);
+        passed &= Check("FetchHistory/paged to the start",
+                        holds(newest, 15, 25) && newest.Next == ids[15] && holds(middle, 5, 15) &&
+                        middle.Next == ids[5] && holds(oldest, 0, 5) && oldest.Next == 0, out);
+
+        auto beforeFirst = fetch(ids[0], 10);
+        auto all = fetch(0, 100000);
+        passed &= Check("FetchHistory/ends and oversized limit",
+                        holds(beforeFirst, 0, 0) && beforeFirst.Next == 0 && holds(all, 0, MESSAGES) &&
+                        all.Next == 0, out);
+
+        // A cursor between two of the room's messages pages back from the older one.
+        auto between = fetch(ids[10] + 1, 3);
+        passed &= Check("FetchHistory/cursor of another room's message",
+                        ids[11] > ids[10] + 1 && holds(between, 8, 11) && between.Next == ids[8], out);
+        //endregion
+
+        //region Refusals
+        auto refused = [&](Session &session, const string &data) {
+            return Request(server, session, ServerActionType::FetchHistory, data).Type ==
+                   ClientActionType::InformFailure;
+        };
+        passed &= Check("FetchHistory/refused",
+                        refused(outsider, to_string(room) + " 0 10") && refused(host, "999999 0 10") &&
+                        refused(host, to_string(room) + " 0 0") && refused(host, to_string(room) + " 0"), out);
+        //endregion
+
+        for (Session *session: {&host, &member, &outsider})
+            Disconnect(server, *session);
+        return passed;
+    }
+
+    bool BehaviourTest::ResyncDeltas(unsigned shards, ostream &out) {
+        const string mode = shards ? "Sharded/" : "Inline/";
+        const int BEHIND = 10, SEEN = 4;
+        bool passed = true;
+        Server server("BehaviourServer", shards);
+        server.KeyCost = 1;
+
+        Session host = Connect(server), member = Connect(server), outsider = Connect(server);
+        SignUp(server, host, "host");
+        Hash memberID = SignUp(server, member, "member");
+        SignUp(server, outsider, "outsider");
+        Hash behind = CreateRoom(server, host, "behind"), quiet = CreateRoom(server, host, "quiet"),
+                far = CreateRoom(server, host, "far"), closed = CreateRoom(server, outsider, "closed");
+        for (Hash room: {behind, quiet, far})
+            Request(server, host, ServerActionType::AddMember, to_string(room) + " " + to_string(memberID));
+        for (int i = 0; i < BEHIND; i++)
+            Send(server, host, ServerActionType::SendMessage, to_string(behind) + "|b" + to_string(i));
+        for (int i = 0; i < RESYNC_MAX_DELTA + 1; i++)
+            Send(server, host, ServerActionType::SendMessage, to_string(far) + "|f" + to_string(i));
+        AwaitReplies(server, host, BEHIND + RESYNC_MAX_DELTA + 1);
+        Settle(server, 20);
+        Receive(member, nullptr);
+        member.Events.clear();
+
+        // Resyncs 'rooms' as the member, returns the (status, latest) of each room and the deltas sent.
+        auto resync = [&](const vector<pair<Hash, Hash>> &rooms, map<Hash, pair<int, Hash>> &results,
+                          map<Hash, vector<tuple<Hash, Hash, Hash, string>>> &deltas) {
+            stringstream data{};
+            for (auto [room, seq]: rooms)
+                data << room << " " << seq << " ";
+            auto reply = Request(server, member, ServerActionType::Resync, data.str());
+            Receive(member, nullptr);
+            for (auto &event: member.Events) {
+                Hash room;
+                vector<tuple<Hash, Hash, Hash, string>> entries;
+                if (event.Type == ClientActionType::HistoryBatch &&
+                    ClientResponse::ParseHistory(event.Data, room, entries))
+                    move(entries.begin(), entries.end(), back_inserter(deltas[room]));
+            }
+            member.Events.clear();
+            //format {count} ({roomID} {status} {latest})...
+            stringstream in{reply.Data};
+            size_t count = 0;
+            in >> count;
+            for (size_t i = 0; i < count; i++) {
+                Hash room, latest;
+                int status;
+                in >> room >> status >> latest;
+                results[room] = {status, latest};
+            }
+            return reply.Type == ClientActionType::InformSuccess && count == rooms.size();
+        };
+
+        map<Hash, pair<int, Hash>> results;
+        map<Hash, vector<tuple<Hash, Hash, Hash, string>>> deltas;
+        bool answered = resync({{behind, SEEN}, {quiet, 0}, {far, 0}, {closed, 0}, {999999, 0}}, results, deltas);
+
+        auto &delta = deltas[behind];
+        bool inOrder = delta.size() == BEHIND - SEEN;
+        for (size_t i = 0; inOrder && i < delta.size(); i++)
+            inOrder = get<1>(delta[i]) == SEEN + i + 1 && get<3>(delta[i]) == "b" + to_string(SEEN + i);
+        passed &= Check(mode + "Resync/delta of a room behind",
+                        answered && results[behind] == pair<int, Hash>((int) ResyncStatus::Delta, BEHIND) &&
+                        inOrder, out);
+        passed &= Check(mode + "Resync/nothing new",
+                        results[quiet] == pair<int, Hash>((int) ResyncStatus::Delta, 0) && !deltas.count(quiet), out);
+        passed &= Check(mode + "Resync/too far behind reloads",
+                        results[far] == pair<int, Hash>((int) ResyncStatus::Reload, RESYNC_MAX_DELTA + 1) &&
+                        !deltas.count(far), out);
+        passed &= Check(mode + "Resync/denied rooms",
+                        results[closed].first == (int) ResyncStatus::Denied &&
+                        results[999999].first == (int) ResyncStatus::Denied && !deltas.count(closed), out);
+
+        results.clear();
+        deltas.clear();
+        answered = resync({{behind, BEHIND}, {quiet, 3}}, results, deltas);
+        passed &= Check(mode + "Resync/up to date and ahead",
+                        answered && results[behind] == pair<int, Hash>((int) ResyncStatus::Delta, BEHIND) &&
+                        results[quiet] == pair<int, Hash>((int) ResyncStatus::Reload, 0) && deltas.empty(), out);
+
+        passed &= Check(mode + "Resync/refused",
+                        Request(server, member, ServerActionType::Resync, to_string(behind)).Type ==
+                        ClientActionType::InformFailure, out);
+
+        for (Session *session: {&host, &member, &outsider})
+            Disconnect(server, *session);
+        return passed;
+    }
+
+    bool BehaviourTest::MemberChanges(unsigned shards, ostream &out) {
+        const string mode = shards ? "Sharded/" : "Inline/";
+        bool passed = true;
+        Server server("BehaviourServer", shards);
+        server.KeyCost = 1;
+
+        Session host = Connect(server), a = Connect(server), b = Connect(server), c = Connect(server),
+                guest = Connect(server);
+        SignUp(server, host, "host");
+        Hash aID = SignUp(server, a, "a"), bID = SignUp(server, b, "b"), cID = SignUp(server, c, "c");
+        Hash room = CreateRoom(server, host, "members");
+        const Hash MISSING = 999999;
+
+        // Sends the request as 'session', returns the outcome of each account named or nothing when refused.
+        auto change = [&](Session &session, ServerActionType type, const vector<Hash> &ids) {
+            stringstream data{};
+            data << room;
+            for (Hash id: ids)
+                data << " " << id;
+            auto reply = Request(server, session, type, data.str());
+            vector<pair<Hash, MemberStatus>> statuses;
+            //format {roomID} {count} ({memID} {status})...
+            stringstream in{reply.Data};
+            Hash roomID;
+            size_t count = 0;
+            in >> roomID >> count;
+            for (size_t i = 0; reply.Type == ClientActionType::InformSuccess && i < count; i++) {
+                Hash id;
+                int status;
+                in >> id >> status;
+                statuses.emplace_back(id, (MemberStatus) status);
+            }
+            return statuses;
+        };
+        // How many frames of 'type' the session was pushed since the last call.
+        auto told = [&](Session &session, ClientActionType type) {
+            Settle(server, 10);
+            Receive(session, nullptr);
+            auto count = count_if(session.Events.begin(), session.Events.end(),
+                                  [type](const ClientResponse &event) { return event.Type == type; });
+            session.Events.clear();
+            return count;
+        };
+
+        //region AddMembers
+        using Outcomes = vector<pair<Hash, MemberStatus>>;
+        auto added = change(host, ServerActionType::AddMembers, {aID, bID, MISSING, aID});
+        passed &= Check(mode + "AddMembers/partial",
+                        added == Outcomes{{aID, MemberStatus::Done}, {bID, MemberStatus::Done},
+                                          {MISSING, MemberStatus::NoAccount}, {aID, MemberStatus::Unchanged}} &&
+                        told(a, ClientActionType::JoinRoom) == 1 && told(b, ClientActionType::JoinRoom) == 1, out);
+
+        added = change(host, ServerActionType::AddMembers, {aID, cID});
+        passed &= Check(mode + "AddMembers/already a member",
+                        added == Outcomes{{aID, MemberStatus::Unchanged}, {cID, MemberStatus::Done}} &&
+                        told(a, ClientActionType::JoinRoom) == 0 && told(c, ClientActionType::JoinRoom) == 1, out);
+
+        auto refused = [&](Session &session, ServerActionType type, const string &data) {
+            return Request(server, session, type, data).Type == ClientActionType::InformFailure;
+        };
+        passed &= Check(mode + "AddMembers/refused",
+                        refused(a, ServerActionType::AddMembers, to_string(room) + " " + to_string(bID)) &&
+                        refused(guest, ServerActionType::AddMembers, to_string(room) + " " + to_string(bID)) &&
+                        refused(host, ServerActionType::AddMembers, to_string(MISSING) + " " + to_string(bID)) &&
+                        refused(host, ServerActionType::AddMembers, to_string(room)), out);
+        //endregion
+
+        //region RemoveMembers
+        // Any member may remove themselves, but nobody else.
+        auto removed = change(a, ServerActionType::RemoveMembers, {aID, bID});
+        passed &= Check(mode + "RemoveMembers/by a member",
+                        removed == Outcomes{{aID, MemberStatus::Done}, {bID, MemberStatus::Denied}} &&
+                        told(a, ClientActionType::LeaveRoom) == 1 && told(b, ClientActionType::LeaveRoom) == 0, out);
+
+        removed = change(host, ServerActionType::RemoveMembers, {bID, MISSING, aID});
+        passed &= Check(mode + "RemoveMembers/partial",
+                        removed == Outcomes{{bID, MemberStatus::Done}, {MISSING, MemberStatus::NoAccount},
+                                            {aID, MemberStatus::Unchanged}} &&
+                        told(b, ClientActionType::LeaveRoom) == 1 && told(a, ClientActionType::LeaveRoom) == 0, out);
+        passed &= Check(mode + "RemoveMembers/refused",
+                        refused(guest, ServerActionType::RemoveMembers, to_string(room) + " " + to_string(cID)) &&
+                        refused(host, ServerActionType::RemoveMembers, to_string(MISSING) + " " + to_string(cID)) &&
+                        refused(host, ServerActionType::RemoveMembers, to_string(room) + " x"), out);
+        //endregion
+
+        // Only the members left get the room's messages.
+        Request(server, host, ServerActionType::SendMessage, to_string(room) + "|after");
+        passed &= Check(mode + "Members/room as reported",
+                        told(c, ClientActionType::MessageIn) == 1 && told(a, ClientActionType::MessageIn) == 0 &&
+                        told(b, ClientActionType::MessageIn) == 0, out);
+
+        for (Session *session: {&host, &a, &b, &c, &guest})
+            Disconnect(server, *session);
+        return passed;
+    }
+
+    bool BehaviourTest::Subscriptions(unsigned shards, ostream &out) {
+        const string mode = shards ? "Sharded/" : "Inline/";
+        bool passed = true;
+        Server server("BehaviourServer", shards);
+        server.KeyCost = 1;
+
+        Session host = Connect(server), first = Connect(server), second = Connect(server),
+                plain = Connect(server), outsider = Connect(server), guest = Connect(server);
+        SignUp(server, host, "host");
+        Hash memberID = SignUp(server, first, "member");
+        Request(server, second, ServerActionType::LoginAccount, to_string(memberID) + " key");
+        Hash plainID = SignUp(server, plain, "plain");
+        SignUp(server, outsider, "outsider");
+        vector<Hash> rooms;
+        for (int r = 0; r < CLIENT_MAX_VIEWED + 1; r++) {
+            rooms.push_back(CreateRoom(server, host, "view" + to_string(r)));
+            Request(server, host, ServerActionType::AddMembers,
+                    to_string(rooms[r]) + " " + to_string(memberID) + " " + to_string(plainID));
+        }
+        Hash one = rooms[0], two = rooms[1];
+
+        auto subscribe = [&](Session &session, Hash room) {
+            return Request(server, session, ServerActionType::Subscribe, to_string(room));
+        };
+        // The MessageIn count per room and the UnreadBump counts pushed to the session since the last call.
+        auto pushed = [&](Session &session, map<Hash, int> &messages, map<Hash, Hash> &bumps) {
+            Settle(server, UNREAD_FLUSH_MS + 50);
+            Receive(session, nullptr);
+            for (auto &event: session.Events) {
+                stringstream in{event.Data};
+                Hash room;
+                if (event.Type == ClientActionType::MessageIn && in >> room)
+                    messages[room]++;
+                //format {count} ({roomID} {unread})...
+                size_t count = 0;
+                if (event.Type == ClientActionType::UnreadBump && in >> count)
+                    for (size_t i = 0; i < count; i++) {
+                        Hash unread;
+                        in >> room >> unread;
+                        bumps[room] += unread;
+                    }
+            }
+            session.Events.clear();
+        };
+        for (Session *session: {&first, &second, &plain}) {
+            Settle(server, 10);
+            Receive(*session, nullptr);
+            session->Events.clear();
+        }
+
+        //region Sessions viewing different rooms
+        Hash latest = 0;
+        stringstream{subscribe(first, one).Data} >> latest >> latest;
+        bool subscribed = latest == 0 && subscribe(second, two).Type == ClientActionType::InformSuccess;
+        for (int i = 0; i < 3; i++)
+            Request(server, host, ServerActionType::SendMessage, to_string(one) + "|x");
+        Request(server, host, ServerActionType::SendMessage, to_string(two) + "|y");
+
+        map<Hash, int> firstMessages, secondMessages, plainMessages;
+        map<Hash, Hash> firstBumps, secondBumps, plainBumps;
+        pushed(first, firstMessages, firstBumps);
+        pushed(second, secondMessages, secondBumps);
+        pushed(plain, plainMessages, plainBumps);
+        passed &= Check(mode + "Subscribe/viewed rooms in full",
+                        subscribed && firstMessages == map<Hash, int>{{one, 3}} &&
+                        secondMessages == map<Hash, int>{{two, 1}}, out);
+        passed &= Check(mode + "UnreadBump/per session",
+                        firstBumps == map<Hash, Hash>{{two, 1}} && secondBumps == map<Hash, Hash>{{one, 3}}, out);
+        passed &= Check(mode + "Subscribe/never subscribed gets all",
+                        plainMessages == map<Hash, int>{{one, 3}, {two, 1}} && plainBumps.empty(), out);
+
+        stringstream{subscribe(first, two).Data} >> latest >> latest;
+        passed &= Check(mode + "Subscribe/reports the latest seq", latest == 1, out);
+        //endregion
+
+        //region View limit and Unsubscribe
+        // 'first' views rooms one and two, the others fill its slots up to the limit.
+        bool filled = true;
+        for (int r = 2; r < CLIENT_MAX_VIEWED; r++)
+            filled &= subscribe(first, rooms[r]).Type == ClientActionType::InformSuccess;
+        Hash last = rooms[CLIENT_MAX_VIEWED];
+        passed &= Check(mode + "Subscribe/view limit",
+                        filled && subscribe(first, last).Type == ClientActionType::InformFailure &&
+                        subscribe(first, one).Type == ClientActionType::InformSuccess, out);
+
+        bool freed = Request(server, first, ServerActionType::Unsubscribe, to_string(rooms[2])).Type ==
+                     ClientActionType::InformSuccess &&
+                     subscribe(first, last).Type == ClientActionType::InformSuccess;
+        Request(server, first, ServerActionType::Unsubscribe, "0");
+        Request(server, host, ServerActionType::SendMessage, to_string(one) + "|z");
+        firstMessages.clear();
+        firstBumps.clear();
+        pushed(first, firstMessages, firstBumps);
+        passed &= Check(mode + "Unsubscribe/one and every room",
+                        freed && firstMessages.empty() && firstBumps == map<Hash, Hash>{{one, 1}}, out);
+        //endregion
+
+        //region Logout and login on the same connection
+        // The next account starts as a session that never subscribed, neither selective nor viewing the
+        // previous account's rooms.
+        subscribe(first, one);
+        bool relogged = Request(server, first, ServerActionType::LogoutAccount, "").Type ==
+                        ClientActionType::InformSuccess &&
+                        Request(server, first, ServerActionType::LoginAccount, to_string(plainID) + " key").Type ==
+                        ClientActionType::InformSuccess;
+        Settle(server, 10);
+        Receive(first, nullptr);
+        first.Events.clear();
+        Request(server, host, ServerActionType::SendMessage, to_string(one) + "|u");
+        Request(server, host, ServerActionType::SendMessage, to_string(two) + "|v");
+        firstMessages.clear();
+        firstBumps.clear();
+        pushed(first, firstMessages, firstBumps);
+        passed &= Check(mode + "Subscribe/reset by logout",
+                        relogged && firstMessages == map<Hash, int>{{one, 1}, {two, 1}} && firstBumps.empty(), out);
+        //endregion
+
+        auto refused = [&](Session &session, ServerActionType type, const string &data) {
+            return Request(server, session, type, data).Type == ClientActionType::InformFailure;
+        };
+        passed &= Check(mode + "Subscribe/refused",
+                        refused(guest, ServerActionType::Subscribe, to_string(one)) &&
+                        refused(guest, ServerActionType::Unsubscribe, to_string(one)) &&
+                        refused(outsider, ServerActionType::Subscribe, to_string(one)) &&
+                        refused(first, ServerActionType::Subscribe, "999999") &&
+                        refused(first, ServerActionType::Subscribe, "x"), out);
+
+        for (Session *session: {&host, &first, &second, &plain, &outsider, &guest})
+            Disconnect(server, *session);
+        return passed;
+    }
+
+    bool BehaviourTest::ConcurrentSubscribe(ostream &out) {
+        const int THREADS = 4, ROUNDS = 200;
+        const Hash ROOM = 1;
+        bool single = true;
+        for (int round = 0; round < ROUNDS && single; round++) {
+            Client client(-1, sockaddr_storage{}, false);
+            atomic<int> ready{0};
+            vector<thread> threads;
+            for (int t = 0; t < THREADS; t++)
+                threads.emplace_back([&]() {
+                    ready.fetch_add(1);
+                    while (ready.load() < THREADS)
+                        this_thread::yield();
+                    client.Subscribe(ROOM);
+                });
+            for (auto &t: threads)
+                t.join();
+            // One slot taken leaves room for exactly CLIENT_MAX_VIEWED - 1 other rooms.
+            for (Hash other = ROOM + 1; other < ROOM + CLIENT_MAX_VIEWED; other++)
+                single &= client.Subscribe(other);
+            single &= client.Views(ROOM) && !client.Subscribe(ROOM + CLIENT_MAX_VIEWED);
+        }
+        return Check("Subscribe/concurrent calls take one slot", single, out);
+    }
+
+    bool BehaviourTest::ReadCursors(unsigned shards, ostream &out) {
+        const string mode = shards ? "Sharded/" : "Inline/";
+        bool passed = true;
+        Server server("BehaviourServer", shards);
+        server.KeyCost = 1;
+
+        Session host = Connect(server), reader = Connect(server), outsider = Connect(server);
+        Hash hostID = SignUp(server, host, "host");
+        Hash readerID = SignUp(server, reader, "reader");
+        SignUp(server, outsider, "outsider");
+        Hash busy = CreateRoom(server, host, "busy"), calm = CreateRoom(server, host, "calm"),
+                silent = CreateRoom(server, host, "silent"), closed = CreateRoom(server, outsider, "closed");
+        for (Hash room: {busy, calm, silent})
+            Request(server, host, ServerActionType::AddMember, to_string(room) + " " + to_string(readerID));
+        Request(server, reader, ServerActionType::LogoutAccount, "");
+        for (int i = 0; i < 5; i++)
+            Request(server, host, ServerActionType::SendMessage, to_string(busy) + "|b");
+        for (int i = 0; i < 3; i++)
+            Request(server, host, ServerActionType::SendMessage, to_string(calm) + "|c");
+
+        // Logs 'id' in on a new session, returns the unread count of each room it was sent.
+        auto login = [&](Hash id, Session &session) {
+            session = Connect(server);
+            Request(server, session, ServerActionType::LoginAccount, to_string(id) + " key");
+            Settle(server, 10);
+            Receive(session, nullptr);
+            map<Hash, Hash> counts;
+            for (auto &event: session.Events) {
+                //format {count} ({roomID} {unread})...
+                stringstream in{event.Data};
+                size_t count = 0;
+                if (event.Type == ClientActionType::UnreadCounts && in >> count)
+                    for (size_t i = 0; i < count; i++) {
+                        Hash room, unread;
+                        in >> room >> unread;
+                        counts[room] = unread;
+                    }
+            }
+            session.Events.clear();
+            return counts;
+        };
+
+        Session session{};
+        passed &= Check(mode + "UnreadCounts/at login",
+                        login(readerID, session) == map<Hash, Hash>{{busy, 5}, {calm, 3}, {silent, 0}}, out);
+
+        // Acks are never answered, so the Subscribe reply is the first one to arrive. A cursor only moves
+        // forward, and not past the room's last message.
+        for (string acks: {to_string(busy) + " 2 " + to_string(calm) + " 10", to_string(busy) + " 1",
+                           to_string(closed) + " 1", string("x")})
+            Send(server, session, ServerActionType::AckRead, acks);
+        bool unanswered = Request(server, session, ServerActionType::Subscribe, to_string(busy)).Type ==
+                          ClientActionType::InformSuccess;
+        Session later{};
+        passed &= Check(mode + "AckRead/moves the read cursors",
+                        unanswered &&
+                        login(readerID, later) == map<Hash, Hash>{{busy, 3}, {calm, 0}, {silent, 0}}, out);
+
+        // A member's own messages count as read.
+        Session hostLater{};
+        passed &= Check(mode + "UnreadCounts/own messages read",
+                        login(hostID, hostLater) == map<Hash, Hash>{{busy, 0}, {calm, 0}, {silent, 0}}, out);
+
+        for (Session *cur: {&host, &reader, &outsider, &session, &later, &hostLater})
+            Disconnect(server, *cur);
+        return passed;
+    }
+
+    bool BehaviourTest::Sessions(unsigned shards, ostream &out) {
+        const string mode = shards ? "Sharded/" : "Inline/";
+        bool passed = true;
+        Server server("BehaviourServer", shards);
+        server.KeyCost = 1;
+
+        Session host = Connect(server);
+        SignUp(server, host, "host");
+        vector<Session> sessions{Connect(server)};
+        Hash multiID = SignUp(server, sessions[0], "multi");
+        for (int s = 1; s < 4; s++) {
+            sessions.push_back(Connect(server));
+            Request(server, sessions[s], ServerActionType::LoginAccount, to_string(multiID) + " key");
+        }
+        Hash room = CreateRoom(server, host, "sessions");
+        Request(server, host, ServerActionType::AddMember, to_string(room) + " " + to_string(multiID));
+        shared_ptr<Account> account = sessions[0].Connection->Owner;
+
+        // The MessageIn count of each session and the presence changes of 'multi' the host was told of,
+        // since the last call.
+        vector<bool> detached(sessions.size(), false);
+        auto pushed = [&](vector<int> &messages, vector<int> &presence) {
+            Settle(server, PRESENCE_FLUSH_MS + 50);
+            messages.assign(sessions.size(), 0);
+            for (size_t s = 0; s < sessions.size(); s++) {
+                if (detached[s])
+                    continue;
+                Receive(sessions[s], nullptr);
+                for (auto &event: sessions[s].Events)
+                    messages[s] += event.Type == ClientActionType::MessageIn;
+                sessions[s].Events.clear();
+            }
+            presence.clear();
+            Receive(host, nullptr);
+            for (auto &event: host.Events) {
+                //format {count} ({accountID} {online})...
+                stringstream in{event.Data};
+                size_t count = 0;
+                if (event.Type == ClientActionType::PresenceUpdate && in >> count)
+                    for (size_t i = 0; i < count; i++) {
+                        Hash id;
+                        int online;
+                        in >> id >> online;
+                        if (id == multiID)
+                            presence.push_back(online);
+                    }
+            }
+            host.Events.clear();
+        };
+        auto detach = [&](size_t s) {
+            Disconnect(server, sessions[s]);
+            detached[s] = true;
+        };
+        vector<int> messages, presence;
+        pushed(messages, presence);
+
+        //region Pushed to every session
+        Request(server, host, ServerActionType::SendMessage, to_string(room) + "|all");
+        pushed(messages, presence);
+        passed &= Check(mode + "Sessions/pushed to every session",
+                        account->SessionCount() == 4 && messages == vector<int>{1, 1, 1, 1}, out);
+        //endregion
+
+        //region Detaching a middle session
+        // The last session fills the hole the second leaves, so it must be found at its new index when it
+        // detaches in turn.
+        detach(1);
+        detach(3);
+        Request(server, host, ServerActionType::SendMessage, to_string(room) + "|left");
+        pushed(messages, presence);
+        passed &= Check(mode + "Sessions/detach keeps the swapped index",
+                        account->SessionCount() == 2 && messages[0] == 1 && messages[2] == 1 &&
+                        sessions[2].Connection->SessionIndex == 1, out);
+        //endregion
+
+        //region Offline with the last session
+        bool online = presence.empty();
+        detach(2);
+        pushed(messages, presence);
+        online &= presence.empty();
+        detach(0);
+        pushed(messages, presence);
+        passed &= Check(mode + "Sessions/offline with the last one",
+                        online && account->SessionCount() == 0 && presence == vector<int>{0}, out);
+        //endregion
+
+        Disconnect(server, host);
+        return passed;
+    }
+
+    bool BehaviourTest::Mailbox(ostream &out) {
+        bool passed = true;
+        Server server("BehaviourServer", 0);
+        server.KeyCost = 1;
+
+        Session host = Connect(server), member = Connect(server);
+        SignUp(server, host, "host");
+        Hash memberID = SignUp(server, member, "member");
+        Hash room = CreateRoom(server, host, "mailbox");
+        Request(server, host, ServerActionType::AddMember, to_string(room) + " " + to_string(memberID));
+        vector<Session> sessions;
+
+        // Sends 'count' messages of 'length' bytes while the member is offline, logs it in on a new session
+        // and returns the seqs of the messages it was written, in the order they arrived.
+        auto offline = [&](int count, size_t length) {
+            Request(server, member, ServerActionType::LogoutAccount, "");
+            for (int i = 0; i < count; i++)
+                Request(server, host, ServerActionType::SendMessage, to_string(room) + "|" + string(length, 'm'));
+            sessions.push_back(member);
+            member = Connect(server);
+            Request(server, member, ServerActionType::LoginAccount, to_string(memberID) + " key");
+            Settle(server, 10);
+            Receive(member, nullptr);
+            //format {roomID} {seq} {senderID} msg
+            vector<Hash> seqs;
+            for (auto &event: member.Events) {
+                Hash roomID, seq;
+                if (event.Type == ClientActionType::MessageIn && stringstream{event.Data} >> roomID >> seq)
+                    seqs.push_back(seq);
+            }
+            member.Events.clear();
+            return seqs;
+        };
+
+        passed &= Check("Mailbox/written in order at login",
+                        offline(5, 1) == vector<Hash>{1, 2, 3, 4, 5}, out);
+
+        // Twice what the mailbox holds: only a run of the newest is left, ending at the last message.
+        const size_t LENGTH = 1024;
+        const int COUNT = 2 * MAILBOX_MAX_BYTES / LENGTH;
+        auto kept = offline(COUNT, LENGTH);
+        bool newest = !kept.empty() && kept.size() * LENGTH <= MAILBOX_MAX_BYTES && kept.front() > 6 &&
+                      kept.back() == 5 + COUNT;
+        for (size_t i = 1; i < kept.size(); i++)
+            newest &= kept[i] == kept[i - 1] + 1;
+        passed &= Check("Mailbox/oldest dropped on overflow", newest, out);
+
+        Disconnect(server, host);
+        Disconnect(server, member);
+        for (Session &session: sessions)
+            Disconnect(server, session);
+        return passed;
+    }
+
+    bool BehaviourTest::Coalescing(ostream &out) {
+        const unsigned WINDOW_MS = 500, MAX_EVENTS = 4;
+        // Limits set at build time are the ones every server starts with, and cannot be replaced.
+        if (COALESCE_WINDOW_US || COALESCE_MAX_EVENTS) {
+            out << "  " << left << setw(48) << "Coalescing/limits set at build time" << "SKIP" << endl;
+            return true;
+        }
+        bool passed = true;
+        Server server("BehaviourServer", 0);
+        server.KeyCost = 1;
+        server.EnableCoalescing(WINDOW_MS * 1000, MAX_EVENTS);
+
+        Session host = Connect(server), member = Connect(server);
+        Hash hostID = SignUp(server, host, "host");
+        Hash memberID = SignUp(server, member, "member");
+        Hash room = CreateRoom(server, host, "coalesced");
+        Request(server, host, ServerActionType::AddMember, to_string(room) + " " + to_string(memberID));
+        Settle(server, WINDOW_MS + 50);
+        Receive(member, nullptr);
+        Hash seq = 0;
+
+        // The frames written to the member since the last call, batches left whole.
+        auto frames = [&]() {
+            Settle(server, 10);
+            char buff[IO_BUFFER_SIZE];
+            ssize_t b_rec;
+            while ((b_rec = recv(member.Peer, buff, sizeof buff, MSG_DONTWAIT)) > 0)
+                member.Pending.append(buff, b_rec);
+            vector<ClientResponse> arrived;
+            size_t length;
+            while ((length = RequestParser::FrameLength(member.Pending)) > 0) {
+                arrived.push_back(ClientResponse::Deserialize(member.Pending.substr(0, length)));
+                member.Pending.erase(0, length);
+            }
+            return arrived;
+        };
+        // Whether 'frame' is one EventBatch of the host's next 'count' messages, each of 'length' bytes.
+        auto batch = [&](const ClientResponse &frame, size_t count, size_t length) {
+            vector<ClientResponse> events;
+            if (frame.Type != ClientActionType::EventBatch ||
+                !ClientResponse::ParseEvents(frame.Data, frame.TargetFD, events) || events.size() != count)
+                return false;
+            //format {roomID} {seq} {senderID} msg
+            for (auto &event: events) {
+                Hash roomID = 0, eventSeq = 0, senderID = 0;
+                string text;
+                stringstream{event.Data} >> roomID >> eventSeq >> senderID >> text;
+                if (event.Type != ClientActionType::MessageIn || event.TargetFD != member.Connection->FileDescriptor ||
+                    roomID != room || eventSeq != ++seq || senderID != hostID || text.size() != length)
+                    return false;
+            }
+            return true;
+        };
+        auto send = [&](size_t length) {
+            Request(server, host, ServerActionType::SendMessage, to_string(room) + "|" + string(length, 'c'));
+        };
+
+        //region Caps
+        for (unsigned i = 0; i < MAX_EVENTS - 1; i++)
+            send(1);
+        bool held = frames().empty();
+        send(1);
+        auto arrived = frames();
+        passed &= Check("Coalescing/sent at the event cap",
+                        held && arrived.size() == 1 && batch(arrived[0], MAX_EVENTS, 1), out);
+
+        const size_t LARGE = COALESCE_MAX_BYTES / 2 + 1;
+        send(LARGE);
+        held = frames().empty();
+        send(LARGE);
+        arrived = frames();
+        passed &= Check("Coalescing/sent at the byte cap",
+                        held && arrived.size() == 1 && batch(arrived[0], 2, LARGE), out);
+        //endregion
+
+        //region Replies and the window
+        // A reply must not overtake the events raised before it.
+        send(1);
+        held = frames().empty();
+        Send(server, member, ServerActionType::Subscribe, to_string(room));
+        arrived = frames();
+        passed &= Check("Coalescing/held events go ahead of a reply",
+                        held && arrived.size() == 2 && batch(arrived[0], 1, 1) &&
+                        arrived[1].Type == ClientActionType::InformSuccess, out);
+
+        send(1);
+        held = frames().empty();
+        Settle(server, WINDOW_MS + 50);
+        arrived = frames();
+        passed &= Check("Coalescing/sent when the window is over",
+                        held && arrived.size() == 1 && batch(arrived[0], 1, 1), out);
+        //endregion
+
+        Disconnect(server, host);
+        Disconnect(server, member);
+        return passed;
+    }
+
+    bool BehaviourTest::PresenceChanges(unsigned shards, ostream &out) {
+        const string mode = shards ? "Sharded/" : "Inline/";
+        bool passed = true;
+        Server server("BehaviourServer", shards);
+        server.KeyCost = 1;
+
+        Session host = Connect(server), first = Connect(server), second = Connect(server),
+                outsider = Connect(server);
+        Hash hostID = SignUp(server, host, "host");
+        Hash firstID = SignUp(server, first, "first");
+        Hash secondID = SignUp(server, second, "second");
+        SignUp(server, outsider, "outsider");
+        // The host shares both rooms with the others, yet is told of each change once.
+        Hash one = CreateRoom(server, host, "one"), two = CreateRoom(server, host, "two");
+        for (Hash room: {one, two})
+            Request(server, host, ServerActionType::AddMembers,
+                    to_string(room) + " " + to_string(firstID) + " " + to_string(secondID));
+
+        // The PresenceUpdate frames pushed to the session since the last call, each as account -> online.
+        auto updates = [&](Session &session) {
+            Receive(session, nullptr);
+            vector<map<Hash, int>> frames;
+            for (auto &event: session.Events) {
+                //format {count} ({accountID} {online})...
+                stringstream in{event.Data};
+                size_t count = 0;
+                if (event.Type != ClientActionType::PresenceUpdate || !(in >> count))
+                    continue;
+                auto &frame = frames.emplace_back();
+                for (size_t i = 0; i < count; i++) {
+                    Hash id;
+                    int online;
+                    in >> id >> online;
+                    frame[id] += online + 1;
+                }
+            }
+            session.Events.clear();
+            return frames;
+        };
+        auto flushed = [&]() {
+            Settle(server, PRESENCE_FLUSH_MS + 50);
+            for (Session *session: {&host, &first, &second, &outsider})
+                updates(*session);
+        };
+        auto login = [&](Session &session, Hash id) {
+            Send(server, session, ServerActionType::LoginAccount, to_string(id) + " key");
+        };
+        auto logout = [&](Session &session) {
+            Send(server, session, ServerActionType::LogoutAccount, "");
+        };
+        flushed();
+
+        //region Changes told once per flush
+        // Entries read online + 1, so an account listed twice in one frame shows up as more than 2.
+        logout(first);
+        logout(second);
+        Settle(server, PRESENCE_FLUSH_MS + 50);
+        bool offline = updates(host) == vector<map<Hash, int>>{{{firstID, 1}, {secondID, 1}}} &&
+                       updates(outsider).empty();
+        updates(first);
+        updates(second);
+
+        login(first, firstID);
+        login(second, secondID);
+        Settle(server, PRESENCE_FLUSH_MS + 50);
+        passed &= Check(mode + "PresenceUpdate/once per flush",
+                        offline && updates(host) == vector<map<Hash, int>>{{{firstID, 2}, {secondID, 2}}} &&
+                        updates(outsider).empty(), out);
+        passed &= Check(mode + "PresenceUpdate/not told to itself",
+                        updates(first) == vector<map<Hash, int>>{{{secondID, 2}}} &&
+                        updates(second) == vector<map<Hash, int>>{{{firstID, 2}}}, out);
+        //endregion
+
+        //region QueryPresence
+        logout(second);
+        flushed();
+        auto listed = [&](Hash room) {
+            //format {roomID} {online} {members} ({id})...
+            stringstream in{Request(server, host, ServerActionType::QueryPresence, to_string(room)).Data};
+            Hash roomID = 0;
+            size_t online = 0, members = 0;
+            in >> roomID >> online >> members;
+            vector<Hash> ids(online);
+            for (Hash &id: ids)
+                in >> id;
+            return make_tuple(roomID, members, ids);
+        };
+        vector<Hash> expected{hostID, firstID};
+        sort(expected.begin(), expected.end());
+        passed &= Check(mode + "QueryPresence/the room's online members",
+                        listed(one) == make_tuple(one, (size_t) 3, expected) &&
+                        listed(two) == make_tuple(two, (size_t) 3, expected), out);
+        //endregion
+
+        for (Session *session: {&host, &first, &second, &outsider})
+            Disconnect(server, *session);
+        return passed;
+    }
+} // Testing
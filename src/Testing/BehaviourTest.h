@@ -0,0 +1,97 @@
+#ifndef EPOLLCHAT_BEHAVIOURTEST_H
+#define EPOLLCHAT_BEHAVIOURTEST_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../classes/server/Server.h"
+
+namespace src::Testing {
+
+    // Pass/fail checks of the request parser, the room structures and the request handlers, one OK or
+    // FAIL line each. Run by 'EpollChatBench checks', which ctest runs as well.
+    class BehaviourTest {
+    public:
+        static bool Run(ostream &out);
+    private:
+        // A client on one end of a socketpair, the server holds the other end as one of its connections.
+        struct Session {
+            IntrusivePtr<Client> Connection;
+            int Peer;
+            string Pending;
+            // Frames pushed to the session so far, each event of an EventBatch on its own.
+            vector<ClientResponse> Events;
+        };
+        static constexpr int REPLY_TIMEOUT_MS = 2000;
+
+        static bool Check(const string &name, bool passed, ostream &out);
+
+        //region Harness
+        // Stands in for the reactor's accept and read paths, so no port is needed for the sessions.
+        static Session Connect(Server &server);
+        static void Disconnect(Server &server, Session &session);
+        // Queues a request as the reactor does once its frame is read.
+        static void Send(Server &server, Session &session, ServerActionType type, const string &data);
+        // Does the rest of the reactor's work for up to 'millis': enacts the queued requests, then runs the
+        // key completions and flushes that came due.
+        static void Pump(Server &server, int millis);
+        // Pumps for 'millis' whatever arrives, for pushed events to settle.
+        static void Settle(Server &server, int millis);
+        // Takes what arrived for the session without waiting, replies go to 'replies' when it is not null.
+        static void Receive(Session &session, vector<ClientResponse> *replies);
+        // Pumps until 'count' replies arrived or REPLY_TIMEOUT_MS passed, returns the ones that did.
+        static vector<ClientResponse> AwaitReplies(Server &server, Session &session, size_t count);
+        static ClientResponse Request(Server &server, Session &session, ServerActionType type,
+                                      const string &data);
+        // Registers an account and logs the session into it, returns the account's id.
+        static Hash SignUp(Server &server, Session &session, const string &name);
+        static Hash CreateRoom(Server &server, Session &session, const string &name);
+        //endregion
+
+        // Frame splitting and the payload formats, including the malformed inputs each must refuse.
+        static bool RequestParsing(ostream &out);
+        // MemberSet against a plain set under random joins and leaves, and leaves from a probe run, whose
+        // holes backward-shift deletion has to close without losing the entries behind them.
+        static bool Membership(ostream &out);
+        // Message order within each room and the refusals of the room handlers, on a server with
+        // 'shards' room shards (0 runs the rooms inline), from the clients' side.
+        static bool RoomRequests(unsigned shards, ostream &out);
+        // FetchHistory paged back to the start of a room by its cursors, from a cursor that is no
+        // message of the room as well, and the refused requests.
+        static bool HistoryPaging(ostream &out);
+        // Resync of rooms behind, up to date, ahead of, too far behind and not open to the requester,
+        // answered across the rooms' owners with 'shards' room shards.
+        static bool ResyncDeltas(unsigned shards, ostream &out);
+        // AddMembers and RemoveMembers naming a mix of accounts that can and cannot be changed, each
+        // reported with its own outcome and only the changed ones told, with 'shards' room shards.
+        static bool MemberChanges(unsigned shards, ostream &out);
+        // Two sessions of one account viewing different rooms: each gets its own rooms' messages in full
+        // and its own UnreadBump counts for the rest. Also the view limit, Unsubscribe, the reset on
+        // logout and the refusals, with 'shards' room shards.
+        static bool Subscriptions(unsigned shards, ostream &out);
+        // Subscribe called for one room from several threads at once takes a single slot.
+        static bool ConcurrentSubscribe(ostream &out);
+        // The UnreadCounts frame sent at login, from the rooms' latest seqs and the account's read cursors
+        // as moved by its own messages and by AckRead, with 'shards' room shards.
+        static bool ReadCursors(unsigned shards, ostream &out);
+        // One account logged in on several sessions: every session is pushed the account's events, the
+        // sessions left keep being served as others detach, and the account goes offline with the last
+        // of them only, with 'shards' room shards.
+        static bool Sessions(unsigned shards, ostream &out);
+        // Events raised while an account has no session, written in order at its next login, and the
+        // oldest of them dropped once they exceed MAILBOX_MAX_BYTES.
+        static bool Mailbox(ostream &out);
+        // A server coalescing pushed events: held ones go out ahead of a reply, a batch is sent once it
+        // reaches the event or the byte cap or its window is over, and each is one EventBatch frame
+        // holding the events in order.
+        static bool Coalescing(ostream &out);
+        // PresenceUpdate frames, one per flush to each co-member of the accounts that changed and none to
+        // the accounts themselves, and QueryPresence against the room's online members, with 'shards'
+        // room shards.
+        static bool PresenceChanges(unsigned shards, ostream &out);
+    };
+
+} // Testing
+
+#endif //EPOLLCHAT_BEHAVIOURTEST_H
@@ -0,0 +1,402 @@
+#include "Benchmarks.h"
+
+#include <chrono>
+#include <iomanip>
+#include <map>
+
+using namespace std;
+
+namespace src::Testing {
+
+    template<typename T>
+    static inline void DoNotOptimize(T const &value) {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    // Benchmark accounts are created directly, hashing a real key for each would dominate setup.
+    static const KeyRecord BENCH_KEY = KeyHasher::Hash("key", 1);
+
+    static IntrusivePtr<Client> MakeSinkClient() {
+        // Writes to /dev/null always succeed, so fan-out measures our own cost and not the socket's.
+        int fd = open("/dev/null", O_WRONLY);
+        if (fd == -1) {
+            perror("open(/dev/null)");
+            exit(EXIT_FAILURE);
+        }
+        return MakePooled<Client>(fd, sockaddr_storage{}, false);
+    }
+
+    BenchmarkResult Benchmarks::Measure(const string &name, const function<void()> &op,
+                                        unsigned long long maxIterations) {
+        using clock = chrono::steady_clock;
+        const auto target = chrono::milliseconds(200);
+
+        for (int i = 0; i < 16; i++)
+            op();
+
+        unsigned long long iterations = 1;
+        clock::duration elapsed{};
+        while (true) {
+            auto start = clock::now();
+            for (unsigned long long i = 0; i < iterations; i++)
+                op();
+            elapsed = clock::now() - start;
+            if (elapsed >= target || iterations >= maxIterations)
+                break;
+            iterations *= 2;
+        }
+
+        return Record(name, iterations, elapsed);
+    }
+
+    BenchmarkResult Benchmarks::Record(const string &name, unsigned long long iterations,
+                                       chrono::steady_clock::duration elapsed) {
+        BenchmarkResult res{name, iterations,
+                            (double) chrono::duration_cast<chrono::nanoseconds>(elapsed).count() /
+                            (double) iterations};
+        cout << "  " << left << setw(40) << name << right << setw(14) << fixed << setprecision(1)
+             << res.NsPerOp << " ns/op" << endl;
+        return res;
+    }
+
+    vector<BenchmarkResult> Benchmarks::RunAll() {
+        vector<BenchmarkResult> results;
+        Server server("BenchServer");
+
+        BenchProtocol(results);
+        BenchLookups(server, results);
+        BenchFanout(results);
+        BenchShards(results);
+        BenchHistory(results);
+        BenchLog(server, results);
+
+        return results;
+    }
+
+    void Benchmarks::BenchProtocol(vector<BenchmarkResult> &results) {
+        const ServerRequest request(ServerActionType::SendMessage, 7, "3|hello there, this is a message");
+        const string serialized = request.Serialize();
+
+        results.push_back(Measure("ServerRequest::Serialize", [&]() {
+            auto s = request.Serialize();
+            DoNotOptimize(s);
+        }));
+        results.push_back(Measure("ServerRequest::Deserialize", [&]() {
+            auto r = ServerRequest::Deserialize(serialized);
+            DoNotOptimize(r);
+        }));
+        results.push_back(Measure("RequestParser::ParseFrame", [&]() {
+            RequestView view{};
+            RequestParser::ParseFrame(serialized, view);
+            DoNotOptimize(view);
+        }));
+        results.push_back(Measure("RequestParser::Parse/SendMessage", [&]() {
+            RequestView view{};
+            SendMessagePayload payload{};
+            RequestParser::ParseFrame(serialized, view);
+            RequestParser::Parse(view.Data, payload);
+            DoNotOptimize(payload);
+        }));
+        stringstream batch{};
+        for (int i = 0; i < 64; i++)
+            batch << 3 << " " << 30 << "|hello there, this is a message ";
+        const string batched = ServerRequest(ServerActionType::SendMessages, 7, batch.str()).Serialize();
+        results.push_back(Measure("RequestParser::Parse/SendMessages/64", [&]() {
+            RequestView view{};
+            SendMessagesPayload payload{};
+            RequestParser::ParseFrame(batched, view);
+            RequestParser::Parse(view.Data, payload);
+            DoNotOptimize(payload);
+        }));
+        results.push_back(Measure("ClientResponse::ClientResponse", [&]() {
+            ClientResponse r(ClientActionType::MessageIn, 7, "3 41 12 hello there, this is a message");
+            DoNotOptimize(r);
+        }));
+        results.push_back(Measure("ClientResponse::Serialize", [&]() {
+            auto s = ClientResponse(ClientActionType::MessageIn, 7, "3 41 12 hello there").Serialize();
+            DoNotOptimize(s);
+        }));
+        Arena scratch;
+        results.push_back(Measure("ClientResponse::Frame", [&]() {
+            auto s = ClientResponse::Frame(scratch, ClientActionType::MessageIn, 7, "3 41 12 hello there");
+            DoNotOptimize(s);
+            scratch.Reset();
+        }));
+    }
+
+    void Benchmarks::BenchLookups(Server &server, vector<BenchmarkResult> &results) {
+        const int count = 1000;
+
+        for (int i = 0; i < count; i++) {
+            server.PushConnection(MakeSinkClient());
+            server.PushAccount(make_shared<Account>("bench" + to_string(i), BENCH_KEY));
+            server.PushRoom(make_shared<ChatRoom>("room" + to_string(i), server.GetAccount(-1)));
+        }
+        int lastFd = server.GetConnection(-1)->FileDescriptor;
+        Hash lastAccount = server.GetAccount(-1)->ID;
+        Hash lastRoom = server.GetRoom(-1)->ID;
+
+        results.push_back(Measure("Server::GetClientByFd/1000", [&]() {
+            auto c = server.GetClientByFd(lastFd);
+            DoNotOptimize(c);
+        }));
+        results.push_back(Measure("Server::FindAccount/1000", [&]() {
+            auto i = server.FindAccount(lastAccount);
+            DoNotOptimize(i);
+        }));
+        results.push_back(Measure("Server::FindRoom/1000", [&]() {
+            auto i = server.FindRoom(lastRoom);
+            DoNotOptimize(i);
+        }));
+
+        ChatRoom room("FindMemberRoom", server.GetAccount(0));
+        for (int i = 0; i < count; i++)
+            room.PushMember(server.GetAccount(i));
+        results.push_back(Measure("ChatRoom::FindMember/1000", [&]() {
+            auto f = room.FindMember(lastAccount);
+            DoNotOptimize(f);
+        }));
+
+        const int largeCount = 100000;
+        vector<shared_ptr<Account>> large;
+        ChatRoom largeRoom("LargeRoom", server.GetAccount(0));
+        for (int i = 0; i < largeCount; i++) {
+            large.push_back(make_shared<Account>("large" + to_string(i), BENCH_KEY));
+            largeRoom.PushMember(large.back());
+        }
+        Hash middle = large[largeCount / 2]->ID;
+        results.push_back(Measure("ChatRoom::FindMember/100000", [&]() {
+            auto f = largeRoom.FindMember(middle);
+            DoNotOptimize(f);
+        }));
+        unsigned long long next = 0;
+        results.push_back(Measure("ChatRoom::EraseMember+PushMember/100000", [&]() {
+            auto &member = large[next++ % largeCount];
+            largeRoom.EraseMember(member->ID);
+            largeRoom.PushMember(member);
+        }));
+        // Counting who is online intersects bitsets, 64 members a step, without touching an Account.
+        for (int i = 0; i < largeCount; i += 10)
+            server.Online->SetOnline(large[i], true);
+        vector<Hash> online;
+        results.push_back(Measure("ChatRoom::OnlineMembers/100000", [&]() {
+            size_t members;
+            DoNotOptimize(largeRoom.OnlineMembers(*server.Online, online, 0, members));
+        }, 10'000));
+        for (int i = 0; i < largeCount; i += 10)
+            server.Online->SetOnline(large[i], false);
+        server.Online->TakeChanges();
+
+        server.Connections.clear();
+        server.Accounts.clear();
+        server.Rooms.clear();
+    }
+
+    void Benchmarks::BenchFanout(vector<BenchmarkResult> &results) {
+        const string msg = "hello there, this is a message of a fairly typical length";
+        for (int size: {10, 100, 1000}) {
+            auto host = make_shared<Account>("host", BENCH_KEY);
+            ChatRoom room("FanoutRoom", host);
+            vector<shared_ptr<Account>> members;
+            Arena scratch;
+            for (int i = 0; i < size; i++) {
+                auto acc = make_shared<Account>("member" + to_string(i), BENCH_KEY);
+                acc->Attach(MakeSinkClient(), scratch);
+                room.PushMember(acc);
+                members.push_back(acc);
+            }
+            Hash mID = 0;
+            results.push_back(Measure("ChatRoom::PushMessage/" + to_string(size), [&]() {
+                room.PushMessage(++mID, host->ID, msg, scratch);
+                scratch.Reset();
+            }, 200'000));
+        }
+
+        // The same fan-out with sessions coalescing: each holds 64 events and then writes them as one frame.
+        {
+            EventCoalescer coalescer(1000000, 64);
+            auto host = make_shared<Account>("host", BENCH_KEY);
+            ChatRoom room("CoalescedRoom", host);
+            Arena scratch;
+            for (int i = 0; i < 100; i++) {
+                auto acc = make_shared<Account>("member" + to_string(i), BENCH_KEY);
+                auto sink = MakeSinkClient();
+                sink->Coalescer = &coalescer;
+                acc->Attach(sink, scratch);
+                room.PushMember(acc);
+            }
+            Hash mID = 0;
+            results.push_back(Measure("ChatRoom::PushMessage/100/coalesced-64", [&]() {
+                room.PushMessage(++mID, host->ID, msg, scratch);
+                scratch.Reset();
+            }, 200'000));
+            coalescer.Flush();
+        }
+
+        // An announcement room: what matters is how long the reactor is held, the workers deliver after.
+        const int large = 100000, sinks = 64, rounds = 20;
+        auto host = make_shared<Account>("host", BENCH_KEY);
+        ChatRoom room("AnnouncementRoom", host);
+        vector<IntrusivePtr<Client>> sinkClients;
+        for (int i = 0; i < sinks; i++)
+            sinkClients.push_back(MakeSinkClient());
+        Arena scratch;
+        for (int i = 0; i < large; i++) {
+            auto acc = make_shared<Account>("member" + to_string(i), BENCH_KEY);
+            acc->Attach(sinkClients[i % sinks], scratch);
+            room.PushMember(acc);
+        }
+        Hash mID = 0;
+        FanoutPool fanout;
+        chrono::steady_clock::duration inline_{}, reactor{}, delivered{};
+        for (int i = 0; i < rounds; i++) {
+            auto start = chrono::steady_clock::now();
+            room.PushMessage(++mID, host->ID, msg, scratch);
+            inline_ += chrono::steady_clock::now() - start;
+            scratch.Reset();
+
+            start = chrono::steady_clock::now();
+            room.PushMessage(++mID, host->ID, msg, scratch, &fanout);
+            reactor += chrono::steady_clock::now() - start;
+            fanout.Drain();
+            delivered += chrono::steady_clock::now() - start;
+            scratch.Reset();
+        }
+        results.push_back(Record("ChatRoom::PushMessage/100000", rounds, inline_));
+        results.push_back(Record("ChatRoom::PushMessage/100000/parallel-reactor", rounds, reactor));
+        results.push_back(Record("ChatRoom::PushMessage/100000/parallel-delivered", rounds, delivered));
+    }
+
+    void Benchmarks::BenchShards(vector<BenchmarkResult> &results) {
+        // Throughput of many small rooms: inline on one thread, then owned by room shards.
+        const string msg = "hello there, this is a message of a fairly typical length";
+        const int roomCount = 64, membersPerRoom = 8, messages = 200'000;
+        auto build = [&](bool sharded) {
+            vector<shared_ptr<ChatRoom>> rooms;
+            Arena setup;
+            for (int r = 0; r < roomCount; r++) {
+                auto host = make_shared<Account>("host", BENCH_KEY);
+                auto room = make_shared<ChatRoom>("ShardRoom", host);
+                if (sharded)
+                    room->ClaimForShard();
+                for (int i = 0; i < membersPerRoom; i++) {
+                    auto acc = make_shared<Account>("member" + to_string(i), BENCH_KEY);
+                    acc->Attach(MakeSinkClient(), setup);
+                    room->PushMember(acc);
+                }
+                rooms.push_back(room);
+            }
+            return rooms;
+        };
+
+        {
+            auto rooms = build(false);
+            Arena scratch;
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < messages; i++) {
+                rooms[i % roomCount]->PushMessage(i + 1, 0, msg, scratch);
+                scratch.Reset();
+            }
+            results.push_back(Record("RoomShards/inline", messages, chrono::steady_clock::now() - start));
+        }
+        for (unsigned shards: {1u, max(2u, thread::hardware_concurrency())}) {
+            auto rooms = build(true);
+            RoomShards owners(shards);
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < messages; i++) {
+                ChatRoom *room = rooms[i % roomCount].get();
+                owners.Post(room->ID, [room, i, &msg](Arena &scratch) {
+                    room->PushMessage(i + 1, 0, msg, scratch);
+                });
+            }
+            owners.Drain();
+            results.push_back(Record("RoomShards/" + to_string(shards), messages,
+                                     chrono::steady_clock::now() - start));
+        }
+    }
+
+    void Benchmarks::BenchHistory(vector<BenchmarkResult> &results) {
+        // A page deep in a long history should cost the same as the newest one: the cursor is a binary search.
+        const string msg = "hello there, this is a message of a fairly typical length";
+        const Hash size = 100000;
+        auto host = make_shared<Account>("host", BENCH_KEY);
+        ChatRoom room("HistoryRoom", host);
+        room.Messages.reserve(size);
+        for (Hash i = 1; i <= size; i++)
+            room.Messages.emplace_back(i, host->ID, msg);
+        auto sink = MakeSinkClient();
+        Arena scratch;
+        for (auto [name, cursor, limit]: {tuple<string, Hash, size_t>{"newest/50", 0, 50},
+                                          {"cursor/50", size / 2, 50},
+                                          {"cursor/500", size / 2, 500}}) {
+            results.push_back(Measure("ChatRoom::SendHistory/" + to_string(size) + "/" + name, [&]() {
+                Hash next;
+                DoNotOptimize(room.SendHistory(sink, cursor, limit, next, scratch));
+                scratch.Reset();
+            }, 100'000));
+        }
+        // A resync starts from a sequence number, which indexes the log directly.
+        results.push_back(Measure("ChatRoom::SendSince/" + to_string(size) + "/behind/50", [&]() {
+            Hash latest;
+            DoNotOptimize(room.SendSince(sink, size - 50, RESYNC_MAX_DELTA, latest, scratch));
+            scratch.Reset();
+        }, 100'000));
+    }
+
+    void Benchmarks::BenchLog(Server &server, vector<BenchmarkResult> &results) {
+        const string msg = "User (bench#12) had requested to send a message in a chatroom. Request Approved;";
+        results.push_back(Measure("Server::LogMessage", [&]() {
+            server.LogMessage(msg);
+            server.RequestArena.Reset();
+        }, 1'000'000));
+        server.ServerLog.clear();
+    }
+
+    void Benchmarks::WriteCSV(const vector<BenchmarkResult> &results, ostream &out) {
+        out << "name,iterations,ns_per_op\n";
+        for (auto &cur: results)
+            out << cur.Name << "," << cur.Iterations << "," << fixed << setprecision(2) << cur.NsPerOp << "\n";
+    }
+
+    vector<BenchmarkResult> Benchmarks::ReadCSV(istream &in) {
+        vector<BenchmarkResult> results;
+        string line;
+        getline(in, line); // Header
+        while (getline(in, line)) {
+            auto first = line.find(',');
+            auto second = line.find(',', first + 1);
+            if (first == string::npos || second == string::npos)
+                continue;
+            results.push_back({line.substr(0, first),
+                               stoull(line.substr(first + 1, second - first - 1)),
+                               stod(line.substr(second + 1))});
+        }
+        return results;
+    }
+
+    int Benchmarks::CompareToBaseline(const vector<BenchmarkResult> &current,
+                                      const vector<BenchmarkResult> &baseline,
+                                      double tolerance, ostream &out) {
+        map<string, double> base;
+        for (auto &cur: baseline)
+            base.emplace(cur.Name, cur.NsPerOp);
+
+        int regressions = 0;
+        out << "Comparison against baseline (tolerance " << fixed << setprecision(0) << tolerance * 100 << "%):\n";
+        for (auto &cur: current) {
+            auto it = base.find(cur.Name);
+            out << "  " << left << setw(40) << cur.Name << right;
+            if (it == base.end()) {
+                out << "   (no baseline)\n";
+                continue;
+            }
+            double delta = (cur.NsPerOp - it->second) / it->second;
+            bool regressed = delta > tolerance;
+            regressions += regressed;
+            out << setw(12) << setprecision(1) << it->second << " -> " << setw(12) << cur.NsPerOp << " ns/op ("
+                << showpos << setprecision(1) << delta * 100 << "%" << noshowpos << ")"
+                << (regressed ? "  REGRESSION" : "") << "\n";
+        }
+        return regressions;
+    }
+} // Testing
@@ -0,0 +1,50 @@
+#ifndef EPOLLCHAT_BENCHMARKS_H
+#define EPOLLCHAT_BENCHMARKS_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <iostream>
+
+#include "../classes/server/Server.h"
+
+using namespace std;
+
+namespace src::Testing {
+
+    struct BenchmarkResult {
+        string Name;
+        unsigned long long Iterations;
+        double NsPerOp;
+    };
+
+    class Benchmarks {
+    public:
+        static vector<BenchmarkResult> RunAll();
+
+        static void WriteCSV(const vector<BenchmarkResult> &results, ostream &out);
+        static vector<BenchmarkResult> ReadCSV(istream &in);
+
+        // Prints a per-benchmark delta against a baseline run, returns the number of regressions
+        // slower than the baseline by more than 'tolerance' (0.25 == 25%).
+        static int CompareToBaseline(const vector<BenchmarkResult> &current,
+                                     const vector<BenchmarkResult> &baseline,
+                                     double tolerance, ostream &out);
+    private:
+        static BenchmarkResult Measure(const string &name, const function<void()> &op,
+                                       unsigned long long maxIterations = 50'000'000);
+        static BenchmarkResult Record(const string &name, unsigned long long iterations,
+                                      chrono::steady_clock::duration elapsed);
+
+        static void BenchProtocol(vector<BenchmarkResult> &results);
+        static void BenchLookups(Server &server, vector<BenchmarkResult> &results);
+        static void BenchFanout(vector<BenchmarkResult> &results);
+        static void BenchShards(vector<BenchmarkResult> &results);
+        static void BenchHistory(vector<BenchmarkResult> &results);
+        static void BenchLog(Server &server, vector<BenchmarkResult> &results);
+    };
+
+} // Testing
+
+#endif //EPOLLCHAT_BENCHMARKS_H
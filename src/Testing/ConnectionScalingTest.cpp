@@ -0,0 +1,305 @@
+#include "ConnectionScalingTest.h"
+
+#include <chrono>
+#include <algorithm>
+#include <iomanip>
+#include <random>
+#include <sys/resource.h>
+
+using namespace std;
+
+namespace src::Testing {
+    shared_ptr<Server> ConnectionScalingTest::p_Server = nullptr;
+
+    int ConnectionScalingTest::Connect() {
+        addrinfo hints{}, *res = nullptr, *p = nullptr;
+        memset(&hints, 0, sizeof hints);
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        int stat = getaddrinfo("localhost", SERVER_PORT, &hints, &res);
+        if (stat != 0) {
+            fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(stat));
+            return -1;
+        }
+
+        int FD = -1;
+        for (p = res; p; p = p->ai_next) {
+            FD = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+            if (FD == -1)
+                continue;
+            if (connect(FD, p->ai_addr, p->ai_addrlen) == -1) {
+                close(FD);
+                FD = -1;
+                continue;
+            }
+            break;
+        }
+        freeaddrinfo(res);
+        return FD;
+    }
+
+    bool ConnectionScalingTest::Send(int fd, const ServerRequest &request) {
+        string data = request.Serialize();
+        return send(fd, data.c_str(), data.size(), 0) == (ssize_t) data.size();
+    }
+
+    ClientResponse ConnectionScalingTest::AwaitReply(int fd) {
+        string pending;
+        char buff[BUFFER_SIZE];
+        while (true) {
+            ssize_t b_rec = recv(fd, buff, sizeof buff, 0);
+            if (b_rec <= 0)
+                return {};
+            pending.append(buff, b_rec);
+
+            string::size_type end;
+            while ((end = pending.find(DELIMITER_END)) != string::npos) {
+                auto resp = ClientResponse::Deserialize(pending.substr(0, end + 1));
+                pending.erase(0, end + 1);
+                // Pushed events (MessageIn etc.) from room-mates are skipped, we only wait for our own reply.
+                if (resp.Type == ClientActionType::InformSuccess || resp.Type == ClientActionType::InformFailure)
+                    return resp;
+            }
+        }
+    }
+
+    void ConnectionScalingTest::Drain(int fd) {
+        char buff[BUFFER_SIZE];
+        while (recv(fd, buff, sizeof buff, MSG_DONTWAIT) > 0) {
+        }
+    }
+
+    long ConnectionScalingTest::ResidentKB() {
+        long pages = 0, resident = 0;
+        FILE *f = fopen("/proc/self/statm", "r");
+        if (!f)
+            return -1;
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+            resident = -1;
+        fclose(f);
+        return resident * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+
+    void ConnectionScalingTest::SetupActive(vector<Session> &active, unsigned long from) {
+        for (unsigned long i = from; i < active.size(); i++) {
+            auto &cur = active[i];
+            cur.Key = "k" + to_string(i);
+            Send(cur.FD, ServerRequest(ServerActionType::RegisterAccount, cur.FD,
+                                       "scaler" + to_string(i) + " | " + cur.Key));
+            stringstream ss{AwaitReply(cur.FD).Data};
+            ss >> cur.ID;
+
+            Send(cur.FD, ServerRequest(ServerActionType::LoginAccount, cur.FD, to_string(cur.ID) + " " + cur.Key));
+            AwaitReply(cur.FD);
+        }
+
+        // Group the new sessions into rooms, the first session of every group hosts it.
+        for (unsigned long i = from - from % ROOM_SIZE; i < active.size(); i += ROOM_SIZE) {
+            auto &host = active[i];
+            if (host.RoomID == 0) {
+                Send(host.FD, ServerRequest(ServerActionType::CreateRoom, host.FD,
+                                            "room" + to_string(i)));
+                stringstream ss{AwaitReply(host.FD).Data};
+                ss >> host.RoomID;
+            }
+            for (unsigned long j = max(i + 1, from); j < min(i + ROOM_SIZE, (unsigned long) active.size()); j++) {
+                stringstream ss{};
+                ss << host.RoomID << " " << active[j].ID;
+                Send(host.FD, ServerRequest(ServerActionType::AddMember, host.FD, ss.str()));
+                AwaitReply(host.FD);
+                active[j].RoomID = host.RoomID;
+            }
+        }
+        for (auto &cur: active)
+            Drain(cur.FD);
+    }
+
+    vector<double> ConnectionScalingTest::SampleLatencies(vector<Session> &active, mt19937 &rng) {
+        using clock = chrono::steady_clock;
+        // Round-trip latency of a message sent by a random active session
+        vector<double> latencies;
+        for (int i = 0; i < LATENCY_SAMPLES && !active.empty(); i++) {
+            auto &cur = active[rng() % active.size()];
+            stringstream ss{};
+            ss << cur.RoomID << "|scaling test message";
+            Drain(cur.FD);
+            auto sent = clock::now();
+            Send(cur.FD, ServerRequest(ServerActionType::SendMessage, cur.FD, ss.str()));
+            AwaitReply(cur.FD);
+            latencies.push_back(chrono::duration<double, micro>(clock::now() - sent).count());
+        }
+        sort(latencies.begin(), latencies.end());
+        return latencies;
+    }
+
+    double ConnectionScalingTest::Percentile(const vector<double> &sorted, double p) {
+        if (sorted.empty())
+            return 0;
+        return sorted[min(sorted.size() - 1, (size_t) (p * (double) sorted.size()))];
+    }
+
+    vector<ScalingSample> ConnectionScalingTest::Run(unsigned long maxConnections, unsigned long step) {
+        using clock = chrono::steady_clock;
+
+        //region Raise the descriptor limit, every connection costs two descriptors in this process
+        rlimit lim{};
+        getrlimit(RLIMIT_NOFILE, &lim);
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+        if (maxConnections * 2 + 64 > lim.rlim_cur) {
+            maxConnections = (lim.rlim_cur - 64) / 2;
+            cerr << "Descriptor limit is " << lim.rlim_cur << ", capping the test at "
+                 << maxConnections << " connections." << endl;
+        }
+        //endregion
+
+        p_Server = make_shared<Server>("ScalingServer");
+        // The test measures connections, not key hashing, so registrations use the cheapest cost.
+        p_Server->KeyCost = 1;
+        p_Server->Start();
+        this_thread::sleep_for(chrono::milliseconds(200));
+        long baseRss = ResidentKB();
+
+        vector<int> idle;
+        vector<Session> active;
+        vector<ScalingSample> samples;
+        mt19937 rng(42);
+
+        for (unsigned long target = step; target <= maxConnections; target += step) {
+            unsigned long activeBefore = active.size();
+
+            //region Open the next batch and wait for the server to accept all of it
+            auto start = clock::now();
+            for (unsigned long i = idle.size() + active.size(); i < target; i++) {
+                int fd = Connect();
+                if (fd == -1) {
+                    perror("connect");
+                    continue;
+                }
+                if (i % 2)
+                    active.push_back({fd, 0, "", 0});
+                else
+                    idle.push_back(fd);
+            }
+            unsigned long opened = idle.size() + active.size();
+            while (true) {
+                {
+                    lock_guard<ProfiledMutex> guard(*p_Server->m_Connections);
+                    if (p_Server->Connections.size() >= opened)
+                        break;
+                }
+                this_thread::sleep_for(chrono::microseconds(100));
+            }
+            double acceptSeconds = chrono::duration<double>(clock::now() - start).count();
+            long rss = ResidentKB();
+            //endregion
+
+            SetupActive(active, activeBefore);
+
+            auto latencies = SampleLatencies(active, rng);
+
+            unsigned long batch = opened - (samples.empty() ? 0 : samples.back().Connections);
+            ScalingSample sample{opened, active.size(),
+                                 (double) batch / acceptSeconds,
+                                 rss,
+                                 (double) (rss - baseRss) * 1024.0 / (double) opened,
+                                 Percentile(latencies, 0.5), Percentile(latencies, 0.99),
+                                 latencies.empty() ? 0 : latencies.back()};
+            samples.push_back(sample);
+            cout << "  " << opened << " connections: " << fixed << setprecision(0)
+                 << sample.BytesPerConnection << " B/conn, p99 " << sample.LatencyP99Us << " us" << endl;
+        }
+
+        p_Server->Stop();
+        for (int fd: idle)
+            close(fd);
+        for (auto &cur: active)
+            close(cur.FD);
+        return samples;
+    }
+
+    void ConnectionScalingTest::LoginBurst(unsigned long logins, ostream &out) {
+        p_Server = make_shared<Server>("LoginBurstServer");
+        p_Server->KeyCost = 1;
+        p_Server->Start();
+        this_thread::sleep_for(chrono::milliseconds(200));
+        mt19937 rng(42);
+
+        //region Chatting sessions, and one account registered at the real cost for the burst to log into
+        vector<Session> active;
+        for (int i = 0; i < ROOM_SIZE * 2; i++)
+            active.push_back({Connect(), 0, "", 0});
+        SetupActive(active, 0);
+
+        p_Server->KeyCost = KEY_HASH_COST;
+        int registrar = Connect();
+        Send(registrar, ServerRequest(ServerActionType::RegisterAccount, registrar, "burst | burstkey"));
+        Hash burstID;
+        stringstream{AwaitReply(registrar).Data} >> burstID;
+        close(registrar);
+        //endregion
+
+        auto baseline = SampleLatencies(active, rng);
+
+        //region Fire every login at once and sample while they are being verified
+        vector<int> burst;
+        for (unsigned long i = 0; i < logins; i++) {
+            int fd = Connect();
+            if (fd == -1) {
+                perror("connect");
+                continue;
+            }
+            Send(fd, ServerRequest(ServerActionType::LoginAccount, fd, to_string(burstID) + " burstkey"));
+            burst.push_back(fd);
+        }
+        auto during = SampleLatencies(active, rng);
+        long long pending = p_Server->Verifier->Pending();
+        //endregion
+
+        unsigned long verified = 0;
+        for (int fd: burst)
+            if (AwaitReply(fd).Type == ClientActionType::InformSuccess)
+                verified++;
+
+        out << "Login burst of " << burst.size() << " logins at cost " << KEY_HASH_COST << " ("
+            << verified << " verified, " << pending << " still pending after sampling)\n"
+            << setw(12) << "" << setw(12) << "rtt p50us" << setw(12) << "rtt p99us" << setw(12) << "rtt max us" << "\n"
+            << fixed << setprecision(1)
+            << setw(12) << "baseline" << setw(12) << Percentile(baseline, 0.5) << setw(12) << Percentile(baseline, 0.99)
+            << setw(12) << (baseline.empty() ? 0 : baseline.back()) << "\n"
+            << setw(12) << "burst" << setw(12) << Percentile(during, 0.5) << setw(12) << Percentile(during, 0.99)
+            << setw(12) << (during.empty() ? 0 : during.back()) << "\n";
+
+        for (int fd: burst) {
+            Send(fd, ServerRequest(ServerActionType::TerminateConnection, fd, ""));
+            AwaitReply(fd);
+            close(fd);
+        }
+        p_Server->Stop();
+        for (auto &cur: active)
+            close(cur.FD);
+    }
+
+    void ConnectionScalingTest::WriteReport(const vector<ScalingSample> &samples, ostream &out) {
+        out << "Connection scaling report (" << ROOM_SIZE << "-member rooms, "
+            << LATENCY_SAMPLES << " round-trip samples per step)\n"
+            << "  sizeof(Client) = " << sizeof(Client) << " B, IO_BUFFER_SIZE = " << IO_BUFFER_SIZE << " B (borrowed while busy)\n\n";
+        out << setw(12) << "connections" << setw(10) << "active" << setw(14) << "accept/s"
+            << setw(12) << "rss(KB)" << setw(12) << "B/conn" << setw(12) << "rtt p50us"
+            << setw(12) << "rtt p99us" << setw(12) << "rtt max us" << "\n";
+        for (auto &cur: samples)
+            out << setw(12) << cur.Connections << setw(10) << cur.Active << fixed << setprecision(0)
+                << setw(14) << cur.AcceptPerSecond << setw(12) << cur.RssKB << setw(12) << cur.BytesPerConnection
+                << setprecision(1) << setw(12) << cur.LatencyP50Us << setw(12) << cur.LatencyP99Us
+                << setw(12) << cur.LatencyMaxUs << "\n";
+    }
+
+    void ConnectionScalingTest::WriteCSV(const vector<ScalingSample> &samples, ostream &out) {
+        out << "connections,active,accept_per_sec,rss_kb,bytes_per_conn,rtt_p50_us,rtt_p99_us,rtt_max_us\n";
+        for (auto &cur: samples)
+            out << cur.Connections << "," << cur.Active << "," << fixed << setprecision(1) << cur.AcceptPerSecond
+                << "," << cur.RssKB << "," << cur.BytesPerConnection << "," << cur.LatencyP50Us << ","
+                << cur.LatencyP99Us << "," << cur.LatencyMaxUs << "\n";
+    }
+} // Testing
@@ -0,0 +1,59 @@
+#ifndef EPOLLCHAT_CONNECTIONSCALINGTEST_H
+#define EPOLLCHAT_CONNECTIONSCALINGTEST_H
+
+#include <memory>
+#include <vector>
+#include <iostream>
+#include <random>
+
+#include "../classes/server/Server.h"
+
+namespace src::Testing {
+
+    struct ScalingSample {
+        unsigned long Connections;
+        unsigned long Active;
+        double AcceptPerSecond;
+        long RssKB;
+        double BytesPerConnection;
+        double LatencyP50Us;
+        double LatencyP99Us;
+        double LatencyMaxUs;
+    };
+
+    // Opens loopback connections against a live Server in steps, half of them idle and half of them
+    // registered, logged-in and chatting in rooms of ROOM_SIZE members. After each step it samples RSS,
+    // accept throughput and request round-trip latency. The output is a report, not a pass/fail check.
+    class ConnectionScalingTest {
+    public:
+        static shared_ptr<Server> p_Server;
+
+        static vector<ScalingSample> Run(unsigned long maxConnections, unsigned long step);
+        static void WriteReport(const vector<ScalingSample> &samples, ostream &out);
+        static void WriteCSV(const vector<ScalingSample> &samples, ostream &out);
+        // Message round-trip latency of chatting sessions before and during a burst of logins at the
+        // default key cost, which are verified off the reactor and should leave it unchanged.
+        static void LoginBurst(unsigned long logins, ostream &out);
+    private:
+        struct Session {
+            int FD;
+            Hash ID;
+            string Key;
+            Hash RoomID;
+        };
+        static const int ROOM_SIZE = 10;
+        static const int LATENCY_SAMPLES = 200;
+
+        static int Connect();
+        static bool Send(int fd, const ServerRequest &request);
+        static ClientResponse AwaitReply(int fd);
+        static void Drain(int fd);
+        static long ResidentKB();
+        static void SetupActive(vector<Session> &active, unsigned long from);
+        static vector<double> SampleLatencies(vector<Session> &active, mt19937 &rng);
+        static double Percentile(const vector<double> &sorted, double p);
+    };
+
+} // Testing
+
+#endif //EPOLLCHAT_CONNECTIONSCALINGTEST_H
@@ -4,9 +4,23 @@
 
 #include "ChatRoomInfo.h"
 
+#include <algorithm>
+
 namespace src {
     namespace classes {
         namespace client {
+            Hash ChatRoomInfo::LastSeq() const {
+                return Messages.empty() ? 0 : get<0>(Messages.back());
+            }
+
+            bool ChatRoomInfo::Merge(Hash seq, Hash sID, string msg) {
+                auto at = lower_bound(Messages.begin(), Messages.end(), seq,
+                                      [](const tuple<Hash,Hash,string> &cur, Hash s) { return get<0>(cur) < s; });
+                if (at != Messages.end() && get<0>(*at) == seq)
+                    return false;
+                Messages.emplace(at, seq, sID, move(msg));
+                return true;
+            }
         } // src
     } // classes
 } // client
\ No newline at end of file
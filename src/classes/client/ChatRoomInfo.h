@@ -20,9 +20,15 @@ namespace src::classes::client {
     public:
         Hash ID{};
         string DisplayName;
-        vector<tuple<Hash,string>> Messages;
+        // (sequence number, sender id, content), ordered by the room's sequence numbers.
+        vector<tuple<Hash,Hash,string>> Messages;
         ChatRoomInfo()=default;
         ChatRoomInfo(Hash id, string dn):ID(id),DisplayName(move(dn)){}
+        // The last sequence number seen in this room, what a resync asks the server to continue from.
+        [[nodiscard]] Hash LastSeq() const;
+        // Files a message by its sequence number, live messages and resync deltas may arrive interleaved.
+        // Returns false when it was already known.
+        bool Merge(Hash seq, Hash sID, string msg);
     };
 
 } // client
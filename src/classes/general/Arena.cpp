@@ -0,0 +1,87 @@
+#include "Arena.h"
+
+#include <cstring>
+#include <cstdint>
+
+namespace src::classes::general {
+
+    Arena::Arena(size_t blockSize) : BlockSize(blockSize), Current(0), Offset(0) {}
+
+    void *Arena::Allocate(size_t size, size_t alignment) {
+        while (Current < Blocks.size()) {
+            auto &block = Blocks[Current];
+            auto base = reinterpret_cast<uintptr_t>(block.Data.get());
+            size_t aligned = ((base + Offset + alignment - 1) & ~(uintptr_t) (alignment - 1)) - base;
+            if (aligned + size <= block.Size) {
+                Offset = aligned + size;
+                return block.Data.get() + aligned;
+            }
+            Current++;
+            Offset = 0;
+        }
+
+        // Out of warmed-up blocks, oversized requests get a block of their own.
+        size_t blockSize = max(BlockSize, size + alignment);
+        Blocks.push_back({make_unique<char[]>(blockSize), blockSize});
+        Current = Blocks.size() - 1;
+        Offset = 0;
+        return Allocate(size, alignment);
+    }
+
+    void Arena::Reset() {
+        Current = 0;
+        Offset = 0;
+    }
+
+    size_t Arena::Capacity() const {
+        size_t total = 0;
+        for (auto &block: Blocks)
+            total += block.Size;
+        return total;
+    }
+
+    ArenaWriter::ArenaWriter(Arena &arena, size_t initialCapacity)
+            : Owner(arena), Data(nullptr), Length(0), Cap(0) {
+        Reserve(initialCapacity);
+    }
+
+    void ArenaWriter::Reserve(size_t extra) {
+        if (Length + extra <= Cap)
+            return;
+        size_t cap = max(Cap * 2, Length + extra);
+        auto data = static_cast<char *>(Owner.Allocate(cap, 1));
+        if (Length)
+            memcpy(data, Data, Length);
+        Data = data;
+        Cap = cap;
+    }
+
+    ArenaWriter &ArenaWriter::operator<<(string_view s) {
+        Reserve(s.size());
+        memcpy(Data + Length, s.data(), s.size());
+        Length += s.size();
+        return *this;
+    }
+
+    ArenaWriter &ArenaWriter::operator<<(const char *s) {
+        return *this << string_view(s);
+    }
+
+    ArenaWriter &ArenaWriter::operator<<(char c) {
+        Reserve(1);
+        Data[Length++] = c;
+        return *this;
+    }
+
+    string_view ArenaWriter::View() const {
+        return {Data, Length};
+    }
+
+    size_t ArenaWriter::Size() const {
+        return Length;
+    }
+
+    void ArenaWriter::Clear() {
+        Length = 0;
+    }
+} // general
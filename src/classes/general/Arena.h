@@ -0,0 +1,73 @@
+#ifndef EPOLLCHAT_ARENA_H
+#define EPOLLCHAT_ARENA_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <concepts>
+#include <charconv>
+
+using namespace std;
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+namespace src::classes::general {
+
+    // Bump-pointer allocator for request-scoped temporaries. Nothing is freed individually, the
+    // owner calls Reset() once the batch is done and every block is kept for the next one, so a
+    // warmed-up arena never touches the global allocator. Not thread-safe; one arena per thread.
+    class Arena {
+    public:
+        explicit Arena(size_t blockSize = ARENA_BLOCK_SIZE);
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+
+        void *Allocate(size_t size, size_t alignment = alignof(max_align_t));
+        void Reset();
+
+        [[nodiscard]] size_t Capacity() const;
+    private:
+        struct Block {
+            unique_ptr<char[]> Data;
+            size_t Size;
+        };
+        vector<Block> Blocks;
+        size_t BlockSize;
+        size_t Current;
+        size_t Offset;
+    };
+
+    // Append-only text buffer living in an Arena, a stand-in for stringstream in the handlers.
+    // The view it returns stays valid until the arena is reset.
+    class ArenaWriter {
+    public:
+        explicit ArenaWriter(Arena &arena, size_t initialCapacity = 128);
+
+        ArenaWriter &operator<<(string_view s);
+        ArenaWriter &operator<<(const char *s);
+        ArenaWriter &operator<<(char c);
+
+        template<integral T> requires (!same_as<T, char> && !same_as<T, bool>)
+        ArenaWriter &operator<<(T value) {
+            char buf[24];
+            auto res = to_chars(buf, buf + sizeof buf, value);
+            return *this << string_view(buf, res.ptr - buf);
+        }
+
+        [[nodiscard]] string_view View() const;
+        [[nodiscard]] size_t Size() const;
+        void Clear();
+    private:
+        void Reserve(size_t extra);
+
+        Arena &Owner;
+        char *Data;
+        size_t Length;
+        size_t Cap;
+    };
+
+} // general
+
+#endif //EPOLLCHAT_ARENA_H
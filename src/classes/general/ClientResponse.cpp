@@ -1,5 +1,7 @@
 #include "ClientResponse.h"
 
+#include <charconv>
+
 namespace src::classes::general {
     string ClientResponse::Serialize() const {
         stringstream result{};
@@ -13,6 +15,71 @@ namespace src::classes::general {
         return result.str();
     }
 
+    string_view ClientResponse::Frame(Arena &arena, ClientActionType type, int fd, string_view data) {
+        ArenaWriter result(arena, data.size() + 32);
+        result << DELIMITER_START << " "
+               << static_cast<int>(type) << " "
+               << fd << " "
+               << DATA_START << " "
+               << data << "  "
+               << DATA_END << " "
+               << DELIMITER_END;
+        return result.View();
+    }
+
+    bool ClientResponse::ParseHistory(string_view data, Hash &roomID, vector<tuple<Hash,Hash,Hash,string>> &out) {
+        //format {roomID} {count} ({msgID} {seq} {senderID} {length} [content])...
+        auto number = [&data](auto &value) -> bool {
+            while (!data.empty() && data.front() == ' ')
+                data.remove_prefix(1);
+            auto res = from_chars(data.data(), data.data() + data.size(), value);
+            if (res.ec != errc() || res.ptr == data.data())
+                return false;
+            data.remove_prefix(res.ptr - data.data());
+            return true;
+        };
+        size_t count;
+        if (!number(roomID) || !number(count))
+            return false;
+        for (size_t i = 0; i < count; i++) {
+            Hash mID, seq, sID;
+            size_t length;
+            if (!number(mID) || !number(seq) || !number(sID) || !number(length) || data.size() < length + 1)
+                return false;
+            out.emplace_back(mID, seq, sID, string(data.substr(1, length)));
+            data.remove_prefix(length + 1);
+        }
+        return true;
+    }
+
+    bool ClientResponse::ParseEvents(string_view data, int fd, vector<ClientResponse> &out) {
+        //format {count} ({type} {length}|[data])...
+        auto number = [&data](auto &value) -> bool {
+            while (!data.empty() && data.front() == ' ')
+                data.remove_prefix(1);
+            auto res = from_chars(data.data(), data.data() + data.size(), value);
+            if (res.ec != errc() || res.ptr == data.data())
+                return false;
+            data.remove_prefix(res.ptr - data.data());
+            return true;
+        };
+        size_t count;
+        if (!number(count))
+            return false;
+        for (size_t i = 0; i < count; i++) {
+            int type;
+            size_t length;
+            if (!number(type) || !number(length) || data.size() < length + 1 || data.front() != '|')
+                return false;
+            // A frame of its own would have read ' [data]  ', see Frame.
+            ClientResponse event(static_cast<ClientActionType>(type), fd);
+            event.Data.reserve(length + 3);
+            event.Data.append(" ").append(data.substr(1, length)).append("  ");
+            out.push_back(std::move(event));
+            data.remove_prefix(length + 1);
+        }
+        return true;
+    }
 
     ClientResponse::ClientResponse()=default;
 } // general
\ No newline at end of file
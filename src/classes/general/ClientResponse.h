@@ -5,15 +5,19 @@
 #include <cstring>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <tuple>
 
 #include "./Constants.h"
 #include "./Enums.h"
+#include "./Arena.h"
+#include "./ObjectPool.h"
 
 using namespace std;
 using namespace src::classes::general;
 
 namespace src::classes::general {
-    struct ClientResponse {
+    struct ClientResponse : public RefCounted<ClientResponse> {
     public:
         ClientActionType Type;
         int TargetFD;
@@ -28,6 +32,14 @@ namespace src::classes::general {
             Data = ss.str();
         }
         [[nodiscard]] string Serialize() const;
+        // Same bytes as ClientResponse(type, fd, data).Serialize(), built in the arena instead of the heap.
+        static string_view Frame(Arena &arena, ClientActionType type, int fd, string_view data);
+        // Unpacks a HistoryBatch payload into (message id, sequence number, sender id, content) entries
+        // appended to 'out'. Contents are length-prefixed, so they may hold anything but a frame's DATA_END.
+        static bool ParseHistory(string_view data, Hash &roomID, vector<tuple<Hash,Hash,Hash,string>> &out);
+        // Unpacks an EventBatch payload into the events it carries, appended to 'out' in the order raised,
+        // each as it would have been deserialized from a frame of its own.
+        static bool ParseEvents(string_view data, int fd, vector<ClientResponse> &out);
         template<typename... Args>
         static ClientResponse Deserialize(const string& inp) {
             stringstream input(inp);
@@ -41,7 +53,7 @@ namespace src::classes::general {
 
             int typeInt;
             input >> typeInt;
-            if (typeInt < 0 || typeInt >= static_cast<int>(ClientActionType::LeaveRoom)) {
+            if (typeInt < 0 || typeInt > static_cast<int>(ClientActionType::UnreadCounts)) {
                 cerr << "Error: Invalid ClientActionType value." << endl;
                 return {};
             }
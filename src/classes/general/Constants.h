@@ -3,9 +3,11 @@
 
 namespace src::classes::general{
 #define SERVER_PORT "3490"
+#define METRICS_PORT 3491
 #define DELIMITER_START '['
 #define DELIMITER_END ']'
 #define BUFFER_SIZE 1024
+#define IO_BUFFER_SIZE 4096
 #define DATA_START '('
 #define DATA_END ')'
     typedef unsigned long long Hash;
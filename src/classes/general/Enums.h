@@ -8,7 +8,12 @@ namespace src::classes::general{
         InformFailure,
         MessageIn,
         JoinRoom,
-        LeaveRoom
+        LeaveRoom,
+        HistoryBatch,
+        PresenceUpdate,
+        EventBatch,
+        UnreadBump,
+        UnreadCounts
     };
     enum class ServerActionType{
         NONE=0,
@@ -19,7 +24,31 @@ namespace src::classes::general{
         AddMember,
         RemoveMember,
         SendMessage,
-        TerminateConnection
+        TerminateConnection,
+        FetchMetrics,
+        FetchHistory,
+        Resync,
+        QueryPresence,
+        AddMembers,
+        RemoveMembers,
+        SendMessages,
+        Subscribe,
+        Unsubscribe,
+        AckRead
+    };
+    // Per-room outcome of a Resync.
+    enum class ResyncStatus{
+        Delta=0,
+        Reload,
+        Denied
+    };
+    // Per-account outcome of an AddMembers or RemoveMembers.
+    enum class MemberStatus{
+        Done=0,
+        // Already a member when adding, not one when removing.
+        Unchanged,
+        NoAccount,
+        Denied
     };
 
 }
@@ -0,0 +1,189 @@
+#include "KeyHasher.h"
+
+#include <cstring>
+#include <random>
+
+namespace src::classes::general {
+
+    static const uint32_t ROUND_CONSTANTS[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+
+    static inline uint32_t RotateRight(uint32_t x, int n) {
+        return (x >> n) | (x << (32 - n));
+    }
+
+    void KeyHasher::Compress(State &state, const uint8_t *block) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++)
+            w[i] = (uint32_t) block[i * 4] << 24 | (uint32_t) block[i * 4 + 1] << 16 |
+                   (uint32_t) block[i * 4 + 2] << 8 | (uint32_t) block[i * 4 + 3];
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = RotateRight(w[i - 15], 7) ^ RotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = RotateRight(w[i - 2], 17) ^ RotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state.H[0], b = state.H[1], c = state.H[2], d = state.H[3];
+        uint32_t e = state.H[4], f = state.H[5], g = state.H[6], h = state.H[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = h + (RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25)) +
+                          ((e & f) ^ (~e & g)) + ROUND_CONSTANTS[i] + w[i];
+            uint32_t t2 = (RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22)) +
+                          ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state.H[0] += a;
+        state.H[1] += b;
+        state.H[2] += c;
+        state.H[3] += d;
+        state.H[4] += e;
+        state.H[5] += f;
+        state.H[6] += g;
+        state.H[7] += h;
+    }
+
+    void KeyHasher::Init(Context &ctx) {
+        static const State IV = {{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19}};
+        ctx.Hash = IV;
+        ctx.Used = 0;
+        ctx.Length = 0;
+    }
+
+    void KeyHasher::Update(Context &ctx, const uint8_t *data, size_t size) {
+        ctx.Length += size;
+        while (size > 0) {
+            size_t chunk = min(size, sizeof ctx.Block - ctx.Used);
+            memcpy(ctx.Block + ctx.Used, data, chunk);
+            ctx.Used += chunk;
+            data += chunk;
+            size -= chunk;
+            if (ctx.Used == sizeof ctx.Block) {
+                Compress(ctx.Hash, ctx.Block);
+                ctx.Used = 0;
+            }
+        }
+    }
+
+    void KeyHasher::Final(Context &ctx, uint8_t *out) {
+        uint64_t bits = ctx.Length * 8;
+        ctx.Block[ctx.Used++] = 0x80;
+        if (ctx.Used > 56) {
+            memset(ctx.Block + ctx.Used, 0, sizeof ctx.Block - ctx.Used);
+            Compress(ctx.Hash, ctx.Block);
+            ctx.Used = 0;
+        }
+        memset(ctx.Block + ctx.Used, 0, 56 - ctx.Used);
+        for (int i = 0; i < 8; i++)
+            ctx.Block[56 + i] = (uint8_t) (bits >> (56 - i * 8));
+        Compress(ctx.Hash, ctx.Block);
+        for (int i = 0; i < 8; i++) {
+            out[i * 4] = (uint8_t) (ctx.Hash.H[i] >> 24);
+            out[i * 4 + 1] = (uint8_t) (ctx.Hash.H[i] >> 16);
+            out[i * 4 + 2] = (uint8_t) (ctx.Hash.H[i] >> 8);
+            out[i * 4 + 3] = (uint8_t) ctx.Hash.H[i];
+        }
+    }
+
+    KeyHasher::Digest KeyHasher::Sha256(string_view data) {
+        Context ctx{};
+        Digest out{};
+        Init(ctx);
+        Update(ctx, (const uint8_t *) data.data(), data.size());
+        Final(ctx, out.data());
+        return out;
+    }
+
+    void KeyHasher::Pbkdf2(string_view key, const uint8_t *salt, size_t saltSize, unsigned iterations,
+                           uint8_t *out, size_t outSize) {
+        //region HMAC key schedule, the padded key blocks are compressed once and reused by every iteration
+        uint8_t padded[64] = {};
+        if (key.size() > sizeof padded) {
+            auto digest = Sha256(key);
+            memcpy(padded, digest.data(), digest.size());
+        } else
+            memcpy(padded, key.data(), key.size());
+
+        Context inner{}, outer{};
+        Init(inner);
+        Init(outer);
+        uint8_t block[64];
+        for (int i = 0; i < 64; i++)
+            block[i] = padded[i] ^ 0x36;
+        Update(inner, block, sizeof block);
+        for (int i = 0; i < 64; i++)
+            block[i] = padded[i] ^ 0x5c;
+        Update(outer, block, sizeof block);
+        auto hmac = [&](const uint8_t *data, size_t size, uint8_t *mac) {
+            Context ctx = inner;
+            Update(ctx, data, size);
+            Final(ctx, mac);
+            ctx = outer;
+            Update(ctx, mac, KEY_DIGEST_SIZE);
+            Final(ctx, mac);
+        };
+        //endregion
+
+        uint8_t u[KEY_DIGEST_SIZE], t[KEY_DIGEST_SIZE];
+        for (uint32_t index = 1; outSize > 0; index++) {
+            // U1 = HMAC(key, salt || INT(index))
+            Context ctx = inner;
+            uint8_t counter[4] = {(uint8_t) (index >> 24), (uint8_t) (index >> 16),
+                                  (uint8_t) (index >> 8), (uint8_t) index};
+            Update(ctx, salt, saltSize);
+            Update(ctx, counter, sizeof counter);
+            Final(ctx, u);
+            ctx = outer;
+            Update(ctx, u, sizeof u);
+            Final(ctx, u);
+            memcpy(t, u, sizeof t);
+
+            for (unsigned i = 1; i < iterations; i++) {
+                hmac(u, sizeof u, u);
+                for (int j = 0; j < KEY_DIGEST_SIZE; j++)
+                    t[j] ^= u[j];
+            }
+
+            size_t chunk = min(outSize, sizeof t);
+            memcpy(out, t, chunk);
+            out += chunk;
+            outSize -= chunk;
+        }
+    }
+
+    KeyRecord KeyHasher::Hash(string_view key, unsigned cost) {
+        static thread_local random_device entropy;
+        KeyRecord record{};
+        for (size_t i = 0; i < record.Salt.size(); i += 4) {
+            uint32_t r = entropy();
+            memcpy(record.Salt.data() + i, &r, min((size_t) 4, record.Salt.size() - i));
+        }
+        record.Cost = cost ? cost : 1;
+        Pbkdf2(key, record.Salt.data(), record.Salt.size(), record.Cost, record.Digest.data(), record.Digest.size());
+        return record;
+    }
+
+    bool KeyHasher::Verify(const KeyRecord &record, string_view key) {
+        Digest candidate{};
+        Pbkdf2(key, record.Salt.data(), record.Salt.size(), record.Cost, candidate.data(), candidate.size());
+        uint8_t difference = 0;
+        for (size_t i = 0; i < candidate.size(); i++)
+            difference |= candidate[i] ^ record.Digest[i];
+        return difference == 0;
+    }
+} // general
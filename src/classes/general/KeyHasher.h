@@ -0,0 +1,68 @@
+#ifndef EPOLLCHAT_KEYHASHER_H
+#define EPOLLCHAT_KEYHASHER_H
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+#include "./Constants.h"
+
+using namespace std;
+
+#define KEY_SALT_SIZE 16
+#define KEY_DIGEST_SIZE 32
+// PBKDF2 iterations for newly hashed keys, set through the ECHAT_KEY_COST cmake cache variable.
+#ifndef KEY_HASH_COST
+#define KEY_HASH_COST 10000
+#endif
+
+namespace src::classes::general {
+
+    // A salted key as it is kept at rest. The cost is stored with it, so raising KEY_HASH_COST later
+    // doesn't invalidate existing records.
+    struct KeyRecord {
+        array<uint8_t, KEY_SALT_SIZE> Salt{};
+        array<uint8_t, KEY_DIGEST_SIZE> Digest{};
+        unsigned Cost = 0;
+    };
+
+    // PBKDF2-HMAC-SHA256 key hashing. Deliberately slow at any useful cost: call it off the reactor.
+    class KeyHasher {
+    public:
+        typedef array<uint8_t, KEY_DIGEST_SIZE> Digest;
+
+        static Digest Sha256(string_view data);
+        static void Pbkdf2(string_view key, const uint8_t *salt, size_t saltSize, unsigned iterations,
+                           uint8_t *out, size_t outSize);
+
+        // Hashes 'key' under a fresh random salt.
+        static KeyRecord Hash(string_view key, unsigned cost = KEY_HASH_COST);
+        // Constant-time comparison of 'key' against the record.
+        static bool Verify(const KeyRecord &record, string_view key);
+
+        KeyHasher() = delete;
+        ~KeyHasher() = delete;
+        KeyHasher(const KeyHasher&) = delete;
+        KeyHasher(KeyHasher&&) = delete;
+        KeyHasher& operator=(const KeyHasher&) = delete;
+        KeyHasher& operator=(KeyHasher&&) = delete;
+    private:
+        struct State {
+            uint32_t H[8];
+        };
+        struct Context {
+            State Hash;
+            uint8_t Block[64];
+            size_t Used;
+            uint64_t Length;
+        };
+
+        static void Init(Context &ctx);
+        static void Update(Context &ctx, const uint8_t *data, size_t size);
+        static void Final(Context &ctx, uint8_t *out);
+        static void Compress(State &state, const uint8_t *block);
+    };
+
+} // general
+
+#endif //EPOLLCHAT_KEYHASHER_H
@@ -0,0 +1,180 @@
+#ifndef EPOLLCHAT_OBJECTPOOL_H
+#define EPOLLCHAT_OBJECTPOOL_H
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <new>
+#include <utility>
+#include <cstddef>
+
+using namespace std;
+
+#define CACHE_LINE_SIZE 64
+#define POOL_SLAB_SIZE (64 * 1024)
+
+namespace src::classes::general {
+    template<typename T>
+    class IntrusivePtr;
+
+    // Base for pooled types, the reference count lives in the object itself instead of a separate
+    // control block. Copying an object never copies its count.
+    template<typename T>
+    class RefCounted {
+    public:
+        RefCounted() = default;
+        RefCounted(const RefCounted &) : RefCount(0) {}
+        RefCounted &operator=(const RefCounted &) { return *this; }
+    private:
+        mutable atomic<unsigned> RefCount{0};
+        friend class IntrusivePtr<T>;
+    };
+
+    // Fixed-size slots carved out of slabs, each slot on its own cache line(s) so objects owned by
+    // different threads never share one. Slabs are never returned to the allocator; once the pool has
+    // grown to the peak live count, creating and destroying objects is a free-list push/pop.
+    template<typename T>
+    class ObjectPool {
+    public:
+        // Leaked on purpose, pooled objects held by other statics may be released after exit() runs.
+        static ObjectPool &Instance() {
+            static auto *pool = new ObjectPool();
+            return *pool;
+        }
+
+        template<typename... Args>
+        T *Create(Args &&... args) {
+            Slot *slot;
+            {
+                lock_guard<mutex> guard(m_Free);
+                if (!Free)
+                    Grow();
+                slot = Free;
+                Free = slot->Next;
+                InUse++;
+            }
+            try {
+                return new(slot->Storage) T(std::forward<Args>(args)...);
+            } catch (...) {
+                Recycle(slot);
+                throw;
+            }
+        }
+
+        void Destroy(T *object) {
+            object->~T();
+            Recycle(reinterpret_cast<Slot *>(object));
+        }
+
+        size_t Capacity() {
+            lock_guard<mutex> guard(m_Free);
+            return Slabs.size() * SLOTS_PER_SLAB;
+        }
+
+        size_t Live() {
+            lock_guard<mutex> guard(m_Free);
+            return InUse;
+        }
+
+        static constexpr size_t SlotSize() {
+            return sizeof(Slot);
+        }
+
+        ObjectPool(const ObjectPool &) = delete;
+        ObjectPool &operator=(const ObjectPool &) = delete;
+    private:
+        static constexpr size_t SLOT_ALIGN = alignof(T) > CACHE_LINE_SIZE ? alignof(T) : CACHE_LINE_SIZE;
+
+        union alignas(SLOT_ALIGN) Slot {
+            Slot *Next;
+            alignas(T) unsigned char Storage[sizeof(T)];
+        };
+        static constexpr size_t SLOTS_PER_SLAB = POOL_SLAB_SIZE / sizeof(Slot) ? POOL_SLAB_SIZE / sizeof(Slot) : 1;
+
+        ObjectPool() : Free(nullptr), InUse(0) {}
+
+        void Grow() {
+            Slabs.push_back(make_unique<Slot[]>(SLOTS_PER_SLAB));
+            Slot *slab = Slabs.back().get();
+            for (size_t i = 0; i < SLOTS_PER_SLAB; i++) {
+                slab[i].Next = Free;
+                Free = &slab[i];
+            }
+        }
+
+        void Recycle(Slot *slot) {
+            lock_guard<mutex> guard(m_Free);
+            slot->Next = Free;
+            Free = slot;
+            InUse--;
+        }
+
+        mutex m_Free;
+        Slot *Free;
+        size_t InUse;
+        vector<unique_ptr<Slot[]>> Slabs;
+    };
+
+    // Owning pointer to a pooled RefCounted object, released back to ObjectPool<T> with the last reference.
+    template<typename T>
+    class IntrusivePtr {
+    public:
+        IntrusivePtr() : Ptr(nullptr) {}
+        IntrusivePtr(nullptr_t) : Ptr(nullptr) {}
+        explicit IntrusivePtr(T *ptr) : Ptr(ptr) { Retain(); }
+        IntrusivePtr(const IntrusivePtr &other) : Ptr(other.Ptr) { Retain(); }
+        IntrusivePtr(IntrusivePtr &&other) noexcept : Ptr(other.Ptr) { other.Ptr = nullptr; }
+        ~IntrusivePtr() { Release(); }
+
+        IntrusivePtr &operator=(const IntrusivePtr &other) {
+            if (Ptr != other.Ptr) {
+                IntrusivePtr tmp(other);
+                swap(Ptr, tmp.Ptr);
+            }
+            return *this;
+        }
+
+        IntrusivePtr &operator=(IntrusivePtr &&other) noexcept {
+            if (this != &other) {
+                Release();
+                Ptr = other.Ptr;
+                other.Ptr = nullptr;
+            }
+            return *this;
+        }
+
+        IntrusivePtr &operator=(nullptr_t) {
+            Release();
+            Ptr = nullptr;
+            return *this;
+        }
+
+        T *get() const { return Ptr; }
+        T *operator->() const { return Ptr; }
+        T &operator*() const { return *Ptr; }
+        explicit operator bool() const { return Ptr != nullptr; }
+        bool operator==(const IntrusivePtr &other) const { return Ptr == other.Ptr; }
+        bool operator==(nullptr_t) const { return Ptr == nullptr; }
+    private:
+        void Retain() {
+            if (Ptr)
+                Ptr->RefCount.fetch_add(1, memory_order_relaxed);
+        }
+
+        void Release() {
+            if (Ptr && Ptr->RefCount.fetch_sub(1, memory_order_acq_rel) == 1)
+                ObjectPool<T>::Instance().Destroy(Ptr);
+        }
+
+        T *Ptr;
+    };
+
+    template<typename T, typename... Args>
+    IntrusivePtr<T> MakePooled(Args &&... args) {
+        return IntrusivePtr<T>(ObjectPool<T>::Instance().Create(std::forward<Args>(args)...));
+    }
+
+} // general
+
+#endif //EPOLLCHAT_OBJECTPOOL_H
@@ -0,0 +1,181 @@
+#include "RequestParser.h"
+
+#include <charconv>
+#include <cctype>
+
+namespace src::classes::general {
+
+    void RequestParser::SkipSpaces(string_view &in) {
+        while (!in.empty() && isspace((unsigned char) in.front()))
+            in.remove_prefix(1);
+    }
+
+    string_view RequestParser::NextToken(string_view &in) {
+        SkipSpaces(in);
+        string_view::size_type i = 0;
+        while (i < in.size() && !isspace((unsigned char) in[i]))
+            i++;
+        auto token = in.substr(0, i);
+        in.remove_prefix(i);
+        return token;
+    }
+
+    template<typename T>
+    bool RequestParser::NextNumber(string_view &in, T &out) {
+        SkipSpaces(in);
+        auto [ptr, ec] = from_chars(in.data(), in.data() + in.size(), out);
+        if (ec != errc())
+            return false;
+        in.remove_prefix(ptr - in.data());
+        return true;
+    }
+
+    bool RequestParser::Unwrap(string_view in, string_view &out) {
+        // Fields are written with a single separating space on each side, e.g. " key "
+        if (in.size() < 2)
+            return false;
+        out = in.substr(1, in.size() - 2);
+        return true;
+    }
+
+    bool RequestParser::SplitRest(string_view in, string_view &rest) {
+        // "|rest "
+        if (in.size() < 2 || in.front() != '|')
+            return false;
+        rest = in.substr(1, in.size() - 2);
+        return true;
+    }
+
+    size_t RequestParser::FrameLength(string_view buffer) {
+        auto end = buffer.find(DATA_END);
+        if (end == string_view::npos)
+            return 0;
+        end = buffer.find(DELIMITER_END, end);
+        if (end == string_view::npos)
+            return 0;
+        return end + 1;
+    }
+
+    bool RequestParser::ParseFrame(string_view frame, RequestView &out) {
+        //format [ {type} {fd} ( [data] ) ]
+        auto token = NextToken(frame);
+        if (token.empty() || token[0] != DELIMITER_START)
+            return false;
+
+        int type, fd;
+        if (!NextNumber(frame, type) || !NextNumber(frame, fd))
+            return false;
+
+        token = NextToken(frame);
+        if (token.empty() || token[0] != DATA_START)
+            return false;
+
+        auto end = frame.find('\n');
+        if (end != string_view::npos)
+            frame = frame.substr(0, end);
+        end = frame.find(DATA_END);
+        if (end != string_view::npos)
+            frame = frame.substr(0, end);
+
+        out.Type = static_cast<ServerActionType>(type);
+        out.TargetFD = fd;
+        out.Data = frame;
+        return true;
+    }
+
+    bool RequestParser::Parse(string_view data, CredentialsPayload &out) {
+        return NextNumber(data, out.ID) && Unwrap(data, out.Key);
+    }
+
+    bool RequestParser::Parse(string_view data, RegisterPayload &out) {
+        // " name | key "
+        auto separator = data.find('|');
+        if (separator == string_view::npos || separator < 2 || separator + 3 > data.size())
+            return false;
+        out.Name = data.substr(1, separator - 2);
+        out.Key = data.substr(separator + 2);
+        out.Key.remove_suffix(1);
+        return true;
+    }
+
+    bool RequestParser::Parse(string_view data, CreateRoomPayload &out) {
+        return Unwrap(data, out.Name) && !out.Name.empty();
+    }
+
+    bool RequestParser::Parse(string_view data, MemberPayload &out) {
+        return NextNumber(data, out.RoomID) && NextNumber(data, out.MemberID);
+    }
+
+    bool RequestParser::Parse(string_view data, MembersPayload &out) {
+        out.Count = 0;
+        if (!NextNumber(data, out.RoomID))
+            return false;
+        SkipSpaces(data);
+        while (!data.empty()) {
+            if (out.Count == out.IDs.size() || !NextNumber(data, out.IDs[out.Count++]))
+                return false;
+            SkipSpaces(data);
+        }
+        return out.Count > 0;
+    }
+
+    bool RequestParser::Parse(string_view data, SendMessagePayload &out) {
+        return NextNumber(data, out.RoomID) && SplitRest(data, out.Message);
+    }
+
+    bool RequestParser::Parse(string_view data, SendMessagesPayload &out) {
+        out.Count = 0;
+        SkipSpaces(data);
+        while (!data.empty()) {
+            if (out.Count == out.Messages.size())
+                return false;
+            auto &[roomID, message] = out.Messages[out.Count++];
+            size_t length;
+            if (!NextNumber(data, roomID) || !NextNumber(data, length))
+                return false;
+            if (data.empty() || data.front() != '|' || length > data.size() - 1)
+                return false;
+            message = data.substr(1, length);
+            data.remove_prefix(length + 1);
+            if (!data.empty() && !isspace((unsigned char) data.front()))
+                return false;
+            SkipSpaces(data);
+        }
+        return out.Count > 0;
+    }
+
+    bool RequestParser::Parse(string_view data, HistoryPayload &out) {
+        return NextNumber(data, out.RoomID) && NextNumber(data, out.Cursor) && NextNumber(data, out.Limit);
+    }
+
+    template<size_t N>
+    bool RequestParser::NumberPairs(string_view in, size_t &count, array<pair<Hash, Hash>, N> &out) {
+        count = 0;
+        SkipSpaces(in);
+        while (!in.empty()) {
+            if (count == N)
+                return false;
+            auto &[first, second] = out[count++];
+            if (!NextNumber(in, first) || !NextNumber(in, second))
+                return false;
+            SkipSpaces(in);
+        }
+        return count > 0;
+    }
+
+    bool RequestParser::Parse(string_view data, ResyncPayload &out) {
+        return NumberPairs(data, out.Count, out.Rooms);
+    }
+
+    bool RequestParser::Parse(string_view data, PresencePayload &out) {
+        return NextNumber(data, out.RoomID);
+    }
+
+    bool RequestParser::Parse(string_view data, SubscribePayload &out) {
+        return NextNumber(data, out.RoomID);
+    }
+
+    bool RequestParser::Parse(string_view data, AckReadPayload &out) {
+        return NumberPairs(data, out.Count, out.Rooms);
+    }
+} // general
@@ -0,0 +1,142 @@
+#ifndef EPOLLCHAT_REQUESTPARSER_H
+#define EPOLLCHAT_REQUESTPARSER_H
+
+#include <string_view>
+#include <array>
+#include <utility>
+
+#include "./Constants.h"
+#include "./Enums.h"
+
+using namespace std;
+
+// Rooms a single Resync may name.
+#define RESYNC_MAX_ROOMS 256
+// Accounts a single AddMembers or RemoveMembers may name.
+#define MEMBERS_MAX_IDS 256
+// Messages a single SendMessages may carry.
+#define SEND_MAX_MESSAGES 256
+// Rooms a single AckRead may name.
+#define ACK_MAX_ROOMS 256
+
+namespace src::classes::general {
+
+    // A frame as it sits in the receive buffer, Data points into that buffer.
+    struct RequestView {
+        ServerActionType Type;
+        int TargetFD;
+        string_view Data;
+    };
+
+    //region Payloads
+    //format {id} [key]
+    struct CredentialsPayload {
+        Hash ID;
+        string_view Key;
+    };
+    //format [name] | [key]
+    struct RegisterPayload {
+        string_view Name;
+        string_view Key;
+    };
+    // Requests made after login carry no credentials, the server acts for the connection's session.
+    //format [name]
+    struct CreateRoomPayload {
+        string_view Name;
+    };
+    //format {roomID} {memID}
+    struct MemberPayload {
+        Hash RoomID;
+        Hash MemberID;
+    };
+    //format {roomID} ({memID})...
+    struct MembersPayload {
+        Hash RoomID;
+        size_t Count;
+        array<Hash, MEMBERS_MAX_IDS> IDs;
+    };
+    //format {rID}|[msg]
+    struct SendMessagePayload {
+        Hash RoomID;
+        string_view Message;
+    };
+    // Each message is prefixed with its length in bytes, so it may hold anything a frame can.
+    //format ({rID} {length}|[msg])...
+    struct SendMessagesPayload {
+        size_t Count;
+        array<pair<Hash, string_view>, SEND_MAX_MESSAGES> Messages;
+    };
+    // A cursor of 0 asks for the newest messages, otherwise for the ones older than that message id.
+    //format {roomID} {cursor} {limit}
+    struct HistoryPayload {
+        Hash RoomID;
+        Hash Cursor;
+        unsigned Limit;
+    };
+    // The last sequence number a client has seen in each of its rooms.
+    //format ({roomID} {lastSeq})...
+    struct ResyncPayload {
+        size_t Count;
+        array<pair<Hash, Hash>, RESYNC_MAX_ROOMS> Rooms;
+    };
+    // A room of 0 asks about the requester's contacts, everyone sharing a room with them.
+    //format {roomID}
+    struct PresencePayload {
+        Hash RoomID;
+    };
+    // A room of 0 on Unsubscribe stops viewing every room.
+    //format {roomID}
+    struct SubscribePayload {
+        Hash RoomID;
+    };
+    // The sequence number read up to in each room.
+    //format ({roomID} {readSeq})...
+    struct AckReadPayload {
+        size_t Count;
+        array<pair<Hash, Hash>, ACK_MAX_ROOMS> Rooms;
+    };
+    //endregion
+
+    // Allocation-free parsing of request frames and their payloads. Every view returned points into
+    // the input, so the input must outlive it. All functions return false on malformed input.
+    class RequestParser {
+    public:
+        // Length of the first complete frame in a stream buffer, 0 while it is still partial. Data cannot
+        // hold a DATA_END, so a frame ends at the first DELIMITER_END after the first DATA_END.
+        static size_t FrameLength(string_view buffer);
+        static bool ParseFrame(string_view frame, RequestView &out);
+
+        static bool Parse(string_view data, CredentialsPayload &out);
+        static bool Parse(string_view data, RegisterPayload &out);
+        static bool Parse(string_view data, CreateRoomPayload &out);
+        static bool Parse(string_view data, MemberPayload &out);
+        static bool Parse(string_view data, MembersPayload &out);
+        static bool Parse(string_view data, SendMessagePayload &out);
+        static bool Parse(string_view data, SendMessagesPayload &out);
+        static bool Parse(string_view data, HistoryPayload &out);
+        static bool Parse(string_view data, ResyncPayload &out);
+        static bool Parse(string_view data, PresencePayload &out);
+        static bool Parse(string_view data, SubscribePayload &out);
+        static bool Parse(string_view data, AckReadPayload &out);
+
+        RequestParser() = delete;
+        ~RequestParser() = delete;
+        RequestParser(const RequestParser&) = delete;
+        RequestParser(RequestParser&&) = delete;
+        RequestParser& operator=(const RequestParser&) = delete;
+        RequestParser& operator=(RequestParser&&) = delete;
+    private:
+        static void SkipSpaces(string_view &in);
+        static string_view NextToken(string_view &in);
+        template<typename T>
+        static bool NextNumber(string_view &in, T &out);
+        static bool Unwrap(string_view in, string_view &out);
+        static bool SplitRest(string_view in, string_view &rest);
+        // Reads ({number} {number})... into 'out', at least one and at most N pairs.
+        template<size_t N>
+        static bool NumberPairs(string_view in, size_t &count, array<pair<Hash, Hash>, N> &out);
+    };
+
+} // general
+
+#endif //EPOLLCHAT_REQUESTPARSER_H
@@ -4,59 +4,196 @@
 
 #include "Account.h"
 #include "Client.h"
+#include "ChatRoom.h"
+#include "../general/ClientResponse.h"
 
 namespace src::classes::server {
     Hash Account::count =1;
     Account::Account():
-    DisplayName("Anonymous"), Key(""){
+    DisplayName("Anonymous"), Key(){
         Setup();
     }
 
-    Account::Account(string dispName, string key):
-    DisplayName(move(dispName)), Key(move(key)){
+    Account::Account(string dispName, KeyRecord key):
+    DisplayName(move(dispName)), Key(key){
         Setup();
     }
 
+    // Defined here, where Client is complete, so the Connection can be released.
+    Account::~Account() = default;
+
     void Account::Setup() {
         this->ID=count++;
-        this->m_Rooms= make_shared<mutex>();
+        this->m_Rooms= make_shared<ProfiledMutex>("Account::m_Rooms");
+        this->MailboxBytes= 0;
+        this->Rooms.store(make_shared<const RoomMap>());
     }
 
-    void Account::PushRoom(Hash id, string name) {
+    void Account::PushRoom(const shared_ptr<ChatRoom> &room) {
         {
-            lock_guard<mutex> guard(*m_Rooms);
-            Rooms.emplace(id,move(name));
+            lock_guard<ProfiledMutex> guard(*m_Rooms);
+            auto current = Rooms.load();
+            auto found = current->find(room->ID);
+            if (found != current->end() && found->second.Name == room->DisplayName)
+                return;
+            auto next = make_shared<RoomMap>(*current);
+            (*next)[room->ID] = JoinedRoom{room->DisplayName, room};
+            Rooms.store(move(next));
         }
     }
 
-    string Account::RoomForID(Hash idIn) {
+    void Account::EraseRoom(Hash id) {
         {
-            lock_guard<mutex> guard(*m_Rooms);
-            return Rooms[idIn];
+            lock_guard<ProfiledMutex> guard(*m_Rooms);
+            auto current = Rooms.load();
+            if (current->find(id) == current->end())
+                return;
+            auto next = make_shared<RoomMap>(*current);
+            next->erase(id);
+            Rooms.store(move(next));
         }
+        lock_guard<mutex> guard(m_ReadCursors);
+        ReadCursors.erase(id);
+    }
+
+    shared_ptr<const Account::RoomMap> Account::RoomsSnapshot() const {
+        return Rooms.load();
+    }
+
+    string Account::RoomForID(Hash idIn) {
+        auto rooms = RoomsSnapshot();
+        auto found = rooms->find(idIn);
+        return found == rooms->end() ? string() : found->second.Name;
     }
 
     vector<Hash> Account::RoomsForName(const string& nameIn) {
-        {
-            lock_guard<mutex> guard(*m_Rooms);
-            vector<Hash> matches{};
-            for(auto& cur :Rooms)
-                if(cur.second==nameIn)
-                    matches.push_back(cur.first);
-            return matches;
-        }
+        auto rooms = RoomsSnapshot();
+        vector<Hash> matches{};
+        for(auto& cur :*rooms)
+            if(cur.second.Name==nameIn)
+                matches.push_back(cur.first);
+        return matches;
     }
 
-    void Account::SetConnection(const shared_ptr<Client>& connection) {
+    void Account::SetConnection(const IntrusivePtr<Client>& connection) {
         connection->SetOwner(shared_from_this());
     }
 
-    Account::Account(const Account &other): Account(other.DisplayName,other.Key) {
-        ID = other.ID;
-        count--;
-        for(const auto& cur: other.Rooms)
-            Rooms.emplace(cur.first,cur.second);
-        m_Rooms= other.m_Rooms;
-        Connection = other.Connection;
+    bool Account::Hold(ClientActionType type, string_view data) {
+        if (Session)
+            return false;
+        // Each event is charged its bookkeeping too, so a flood of tiny ones is capped as well.
+        MailboxBytes += data.size() + sizeof(HeldEvent);
+        Mailbox.push_back({type, string(data)});
+        while (MailboxBytes > MAILBOX_MAX_BYTES && Mailbox.size() > 1) {
+            MailboxBytes -= Mailbox.front().Data.size() + sizeof(HeldEvent);
+            Mailbox.pop_front();
+        }
+        return true;
+    }
+
+    bool Account::SessionsOrHold(ClientActionType type, string_view data, vector<IntrusivePtr<Client>> &out,
+                                 const Client *except, Hash room, vector<IntrusivePtr<Client>> *passedOver) {
+        lock_guard<mutex> guard(m_Mailbox);
+        if (!except && Hold(type, data))
+            return false;
+        ForEachSession([&](const IntrusivePtr<Client> &session) {
+            if (session.get() == except)
+                return;
+            if (room && !session->Views(room)) {
+                if (passedOver)
+                    passedOver->push_back(session);
+                return;
+            }
+            out.push_back(session);
+        });
+        return true;
+    }
+
+    void Account::Deliver(ClientActionType type, string_view data, Arena &scratch, const Client *except,
+                          Hash room, vector<IntrusivePtr<Client>> *passedOver) {
+        lock_guard<mutex> guard(m_Mailbox);
+        if (!except && Hold(type, data))
+            return;
+        ForEachSession([&](const IntrusivePtr<Client> &session) {
+            if (session.get() == except)
+                return;
+            if (room && !session->Views(room)) {
+                if (passedOver)
+                    passedOver->push_back(session);
+                return;
+            }
+            session->PushEvent(type, data, scratch);
+        });
+    }
+
+    void Account::Notify(ClientActionType type, string_view data, Arena &scratch) {
+        lock_guard<mutex> guard(m_Mailbox);
+        ForEachSession([&](const IntrusivePtr<Client> &session) {
+            session->PushEvent(type, data, scratch);
+        });
+    }
+
+    bool Account::Attach(const IntrusivePtr<Client> &connection, Arena &scratch) {
+        // Flushed under the lock, so events raised meanwhile queue up behind the held ones.
+        lock_guard<mutex> guard(m_Mailbox);
+        if (Session) {
+            connection->SessionIndex = MoreSessions.size() + 1;
+            MoreSessions.push_back(connection);
+            return false;
+        }
+        connection->SessionIndex = 0;
+        Session = connection;
+        if (Mailbox.empty())
+            return true;
+        for (auto &held: Mailbox)
+            connection->EnqueueResponse(ClientResponse::Frame(scratch, held.Type, connection->FileDescriptor,
+                                                              held.Data));
+        Mailbox.clear();
+        MailboxBytes = 0;
+        connection->Write();
+        return true;
+    }
+
+    bool Account::Detach(const IntrusivePtr<Client> &connection) {
+        lock_guard<mutex> guard(m_Mailbox);
+        size_t i = connection->SessionIndex;
+        IntrusivePtr<Client> *slot = i == 0 ? &Session : i <= MoreSessions.size() ? &MoreSessions[i - 1] : nullptr;
+        if (!slot || *slot != connection)
+            return false;
+        // The last session fills the hole, so leaving is O(1) like joining.
+        if (MoreSessions.empty()) {
+            Session = nullptr;
+            return true;
+        }
+        if (slot != &MoreSessions.back()) {
+            *slot = std::move(MoreSessions.back());
+            (*slot)->SessionIndex = i;
+        }
+        MoreSessions.pop_back();
+        return false;
+    }
+
+    size_t Account::SessionCount() const {
+        lock_guard<mutex> guard(m_Mailbox);
+        return (Session ? 1 : 0) + MoreSessions.size();
+    }
+
+    void Account::AdvanceRead(Hash roomID, Hash seq) {
+        lock_guard<mutex> guard(m_ReadCursors);
+        Hash &cursor = ReadCursors[roomID];
+        if (seq > cursor)
+            cursor = seq;
+    }
+
+    Hash Account::ReadCursor(Hash roomID) const {
+        lock_guard<mutex> guard(m_ReadCursors);
+        auto found = ReadCursors.find(roomID);
+        return found == ReadCursors.end() ? 0 : found->second;
+    }
+
+    size_t Account::HeldEvents() const {
+        lock_guard<mutex> guard(m_Mailbox);
+        return Mailbox.size();
     }
 } // server
\ No newline at end of file
@@ -2,39 +2,121 @@
 #define EPOLLCHAT_ACCOUNT_H
 
 #include <vector>
+#include <deque>
 #include <string>
+#include <string_view>
 #include <map>
 #include <mutex>
 #include <memory>
+#include <atomic>
 #include "../general/Constants.h"
-
-
+#include "../general/Enums.h"
+#include "../general/Arena.h"
+#include "../general/ObjectPool.h"
+#include "../general/KeyHasher.h"
+#include "ProfiledMutex.h"
 
 using namespace std;
 using namespace src::classes::general;
 
+// Bytes of events an offline account's mailbox holds, the oldest are dropped beyond it.
+#define MAILBOX_MAX_BYTES 65536
+
 namespace src::classes::server {
     class Client;
-    class Account : enable_shared_from_this<Account>{
+    class ChatRoom;
+    // The one record of an account: the registry and every session share it, nothing copies it. The room
+    // list is an immutable snapshot that writers replace (copy-on-write), so readers never take a lock.
+    class Account : public enable_shared_from_this<Account>{
     public:
+        // A joined room's name and a handle to it, so reading the room needs no lookup by its id.
+        struct JoinedRoom {
+            string Name;
+            weak_ptr<ChatRoom> Room;
+        };
+        typedef map<Hash,JoinedRoom> RoomMap;
+
         string DisplayName;
-        string Key;
+        // Salted hash of the account's key, the plaintext is never kept.
+        KeyRecord Key;
         Hash ID;
-        shared_ptr<Client> Connection;
-        map<Hash,string> Rooms;
 
         Account();
-        explicit Account(string dispName, string key);
-        Account(const Account& other);
+        explicit Account(string dispName, KeyRecord key);
+        Account(const Account& other) = delete;
+        Account &operator=(const Account& other) = delete;
+        ~Account();
 
-        void PushRoom(Hash id, string name);
+        void PushRoom(const shared_ptr<ChatRoom> &room);
+        // Also forgets the room's read cursor.
+        void EraseRoom(Hash id);
+        [[nodiscard]] shared_ptr<const RoomMap> RoomsSnapshot() const;
         string RoomForID(Hash idIn);
         vector<Hash> RoomsForName(const string& nameIn);
-        void SetConnection(const shared_ptr<Client>& connection);
+        void SetConnection(const IntrusivePtr<Client>& connection);
+
+        // Appends the account's sessions to 'out' for an event to be delivered to. Without any the
+        // event is kept in the mailbox instead and false is returned. 'except' is set when the account
+        // raised the event itself: that session is skipped and nothing is held. With 'room' set, sessions
+        // viewing other rooms are skipped too and appended to 'passedOver' when given.
+        bool SessionsOrHold(ClientActionType type, string_view data, vector<IntrusivePtr<Client>> &out,
+                            const Client *except = nullptr, Hash room = 0,
+                            vector<IntrusivePtr<Client>> *passedOver = nullptr);
+        // Queues an event to every session, or keeps it in the mailbox while there are none. 'room' and
+        // 'passedOver' as for SessionsOrHold.
+        void Deliver(ClientActionType type, string_view data, Arena &scratch, const Client *except = nullptr,
+                     Hash room = 0, vector<IntrusivePtr<Client>> *passedOver = nullptr);
+        // Queues an event that is only of use now, e.g. a presence change, to every session; it is
+        // dropped while there are none.
+        void Notify(ClientActionType type, string_view data, Arena &scratch);
+        // Adds 'connection' as a session; the first one is written what the mailbox held, in one burst.
+        // Returns true when it is the first, i.e. the account came online.
+        bool Attach(const IntrusivePtr<Client> &connection, Arena &scratch);
+        // Ends the session of 'connection', once none are left events go to the mailbox. Returns true
+        // when it was the last, i.e. the account went offline.
+        bool Detach(const IntrusivePtr<Client> &connection);
+        // Moves the account's read cursor in a room forward to 'seq', never back: acknowledgements may
+        // arrive out of order and a session may lag behind another. Sending a message reads the room up
+        // to it, so the room's unread count is always its LatestSeq less the cursor.
+        void AdvanceRead(Hash roomID, Hash seq);
+        // The sequence number the account has read up to in a room, 0 when it never read it.
+        [[nodiscard]] Hash ReadCursor(Hash roomID) const;
+        [[nodiscard]] size_t SessionCount() const;
+        [[nodiscard]] size_t HeldEvents() const;
     private:
+        struct HeldEvent {
+            ClientActionType Type;
+            string Data;
+        };
+
         static Hash count;
-        shared_ptr<mutex> m_Rooms;
+        atomic<shared_ptr<const RoomMap>> Rooms;
+        // Serialises writers only
+        shared_ptr<ProfiledMutex> m_Rooms;
+        // Live sessions, e.g. a desktop and a terminal client. The first sits inline, so a large room's
+        // fan-out touches no other memory for the usual single-session account; it is only null when
+        // there are none, and then the mailbox fills. Each session knows its index (0 is Session, i is
+        // MoreSessions[i - 1]), so attaching and detaching are both O(1).
+        IntrusivePtr<Client> Session;
+        vector<IntrusivePtr<Client>> MoreSessions;
+        deque<HeldEvent> Mailbox;
+        size_t MailboxBytes;
+        // Taken once per delivery, so a plain mutex: profiling it would cost a large room's fan-out
+        // two clock reads per member.
+        mutable mutex m_Mailbox;
+        // Room id -> the sequence number read up to, see AdvanceRead.
+        map<Hash, Hash> ReadCursors;
+        mutable mutex m_ReadCursors;
         void Setup();
+        // Keeps the event in the mailbox when there is no session, the caller holds m_Mailbox.
+        bool Hold(ClientActionType type, string_view data);
+        template<typename F>
+        void ForEachSession(F f) {
+            if (Session)
+                f(Session);
+            for (auto &session: MoreSessions)
+                f(session);
+        }
     };
 } // server
 
@@ -1,7 +1,11 @@
 #include "ChatRoom.h"
 #include "Client.h"
+#include "Trace.h"
+#include "FanoutPool.h"
 #include "../general/ClientResponse.h"
 
+#include <algorithm>
+
 using namespace src::classes::general;
 
 namespace src::classes::server {
@@ -19,44 +23,80 @@ namespace src::classes::server {
 
     void ChatRoom::PushMember(const shared_ptr<Account>& p_member) {
         {
-            lock_guard<mutex> guard(*m_Members);
-            Members.push_back(p_member);
+            auto guard = Guard(*m_Members);
+            Members.Insert(p_member);
         }
     }
 
     void ChatRoom::Setup() {
         this->ID=count++;
-        this->m_Members= make_unique<mutex>();
-        this->m_Messages= make_unique<mutex>();
+        this->ParallelFanout= false;
+        this->ShardOwned= false;
+        this->BumpQueued= false;
+        this->Latest= 0;
+        this->m_Members= make_unique<ProfiledMutex>("ChatRoom::m_Members");
+        this->m_Messages= make_unique<ProfiledMutex>("ChatRoom::m_Messages");
+    }
+
+    void ChatRoom::ClaimForShard() {
+        ShardOwned = true;
+    }
+
+    unique_lock<ProfiledMutex> ChatRoom::Guard(ProfiledMutex &m) const {
+        if (ShardOwned)
+            return {};
+        return unique_lock<ProfiledMutex>(m);
     }
 
-    tuple<Hash,string> ChatRoom::GetMessage(int i) {
+    tuple<Hash,Hash,string> ChatRoom::GetMessage(int i) {
         {
-            lock_guard<mutex> guard(*m_Messages);
+            auto guard = Guard(*m_Messages);
             return Messages[i];
         }
     }
 
     shared_ptr<Account> ChatRoom::GetMember(int i) {
         {
-            lock_guard<mutex> guard(*m_Members);
+            auto guard = Guard(*m_Members);
             return Members[i];
         }
     }
 
     bool ChatRoom::FindMember(Hash id) {
         {
-            lock_guard<mutex> guard(*m_Members);
-            for(auto& cur : Members)
-                if(cur->ID==id)
-                    return true;
+            auto guard = Guard(*m_Members);
+            return Members.Contains(id);
         }
-        return false;
+    }
+
+    size_t ChatRoom::OnlineMembers(const Presence &presence, vector<Hash> &ids, size_t limit, size_t &members) {
+        auto guard = Guard(*m_Members);
+        members = Members.Size();
+        size_t online = 0;
+        for (auto &[word, bits]: Members.Words()) {
+            uint64_t present = bits & presence.Word(word);
+            online += __builtin_popcountll(present);
+            for (; present && limit; present &= present - 1, limit--)
+                ids.push_back(word * 64 + __builtin_ctzll(present));
+        }
+        return online;
+    }
+
+    void ChatRoom::OnlineAccounts(const Presence &presence, vector<shared_ptr<Account>> &out) {
+        auto guard = Guard(*m_Members);
+        for (auto &[word, bits]: Members.Words())
+            for (uint64_t present = bits & presence.Word(word); present; present &= present - 1)
+                out.push_back(*Members.Get(word * 64 + __builtin_ctzll(present)));
+    }
+
+    vector<pair<Hash, uint64_t>> ChatRoom::MemberWords() {
+        auto guard = Guard(*m_Members);
+        return Members.Words();
     }
 
     bool ChatRoom::FindMessage(unsigned long i) {
         {
-            lock_guard<mutex> guard(*m_Messages);
+            auto guard = Guard(*m_Messages);
             if (i>Messages.size())
                 return false;
         }
@@ -65,43 +105,164 @@ namespace src::classes::server {
 
     void ChatRoom::EraseMember(Hash id) {
         {
-            int index =0;
-            lock_guard<mutex> guard(*m_Members);
-            for(auto& cur: Members)
-            {
-                if (cur->ID==id)
-                    break;
-                else
-                    index++;
-            }
-            if(index==Members.size())
-                return;
-            Members.erase(Members.begin() + index);
+            auto guard = Guard(*m_Members);
+            Members.Erase(id);
         }
     }
 
-    void ChatRoom::PushMessage(Hash sID, const string &p_msg) {
+    void ChatRoom::PushMembers(const vector<shared_ptr<Account>> &members, vector<bool> &changed) {
+        changed.assign(members.size(), false);
+        auto guard = Guard(*m_Members);
+        for (size_t i = 0; i < members.size(); i++)
+            if (members[i])
+                changed[i] = Members.Insert(members[i]);
+    }
+
+    void ChatRoom::EraseMembers(const vector<Hash> &ids, vector<bool> &changed) {
+        changed.assign(ids.size(), false);
+        auto guard = Guard(*m_Members);
+        for (size_t i = 0; i < ids.size(); i++)
+            changed[i] = Members.Erase(ids[i]);
+    }
+
+    Hash ChatRoom::PushMessage(Hash mID, Hash sID, string_view p_msg, Arena &scratch, FanoutPool *fanout,
+                               const Client *origin) {
+        TRACE_SPAN_ARG("ChatRoom::PushMessage", ID);
+        Hash seq;
         {
-            lock_guard<mutex> guard(*m_Messages);
-            Messages.emplace_back(sID,p_msg);
+            auto guard = Guard(*m_Messages);
+            Messages.emplace_back(mID,sID,p_msg);
+            seq = Messages.size();
         }
+        Latest.store(seq, memory_order_release);
+        ArenaWriter data(scratch, p_msg.size() + 64);
+        data << ID
+             << " "
+             << seq
+             << " "
+             << sID
+             << " "
+             << p_msg;
         {
-            lock_guard<mutex> guard(*m_Members);
-            for(auto& cur : Members) {
-                if (cur->ID != sID) {
-                    stringstream ss{};
-                    ss << ID
-                       << " "
-                       << sID
-                       << " "
-                       << p_msg;
-                    cur->Connection->EnqueueResponse(ClientResponse(
-                            ClientActionType::MessageIn,
-                            cur->Connection->FileDescriptor,
-                            ss.str()).Serialize());
-                    cur->Connection->Write();
+            auto guard = Guard(*m_Members);
+            if (fanout && (ParallelFanout || Members.Size() >= FANOUT_PARALLEL_THRESHOLD)) {
+                ParallelFanout = true;
+                auto payload = make_shared<const string>(data.View());
+                vector<FanoutPool::Task> parts(fanout->Workers());
+                for (auto& part : parts) {
+                    part.Type = ClientActionType::MessageIn;
+                    part.Data = payload;
+                    part.Recipients.reserve(Members.Size() / parts.size() + 1);
+                }
+                for(size_t i = 0; i < Members.Size(); i++) {
+                    Hash id = Members.IDAt(i);
+                    if (id == sID && !origin)
+                        continue;
+                    // Every session of an account goes to the same worker, which keeps them in order.
+                    Members[i]->SessionsOrHold(ClientActionType::MessageIn, data.View(),
+                                               parts[fanout->WorkerFor(id)].Recipients, id == sID ? origin : nullptr,
+                                               ID, &Passed);
                 }
+                for (unsigned w = 0; w < parts.size(); w++)
+                    if (!parts[w].Recipients.empty())
+                        fanout->Submit(w, std::move(parts[w]));
+            } else {
+                for (size_t i = 0; i < Members.Size(); i++) {
+                    if (Members.IDAt(i) != sID)
+                        Members[i]->Deliver(ClientActionType::MessageIn, data.View(), scratch, nullptr, ID, &Passed);
+                    else if (origin)
+                        Members[i]->Deliver(ClientActionType::MessageIn, data.View(), scratch, origin, ID, &Passed);
+                }
+            }
+        }
+        for (auto &session: Passed) {
+            auto &[held, missed] = Unbumped[session.get()];
+            held = session;
+            missed++;
+        }
+        Passed.clear();
+        return seq;
+    }
+
+    size_t ChatRoom::SendHistory(const IntrusivePtr<Client> &connection, Hash before, size_t limit, Hash &next,
+                                 Arena &scratch) {
+        TRACE_SPAN_ARG("ChatRoom::SendHistory", ID);
+        auto guard = Guard(*m_Messages);
+        size_t end = Messages.size();
+        if (before)
+            end = lower_bound(Messages.begin(), Messages.end(), before,
+                              [](const tuple<Hash,Hash,string> &msg, Hash id) { return get<0>(msg) < id; })
+                  - Messages.begin();
+        size_t begin = end - min(limit, end);
+        next = begin == 0 ? 0 : get<0>(Messages[begin]);
+        SendBatches(connection, begin, end, scratch);
+        return end - begin;
+    }
+
+    Hash ChatRoom::LatestSeq() const {
+        return Latest.load(memory_order_acquire);
+    }
+
+    bool ChatRoom::QueueBump() {
+        if (Unbumped.empty() || BumpQueued)
+            return false;
+        BumpQueued = true;
+        return true;
+    }
+
+    void ChatRoom::TakeBumps(vector<pair<IntrusivePtr<Client>, Hash>> &sessions) {
+        for (auto &[key, entry]: Unbumped)
+            sessions.push_back(std::move(entry));
+        Unbumped.clear();
+        BumpQueued = false;
+    }
+
+    bool ChatRoom::SendSince(const IntrusivePtr<Client> &connection, Hash seq, size_t limit, Hash &latest,
+                             Arena &scratch) {
+        TRACE_SPAN_ARG("ChatRoom::SendSince", ID);
+        auto guard = Guard(*m_Messages);
+        latest = Messages.size();
+        // A client ahead of the room saw a history this server no longer has.
+        if (seq > latest || latest - seq > limit)
+            return false;
+        SendBatches(connection, seq, latest, scratch);
+        return true;
+    }
+
+    void ChatRoom::SendBatches(const IntrusivePtr<Client> &connection, size_t begin, size_t end, Arena &scratch) {
+        //format {roomID} {count} ({msgID} {seq} {senderID} {length} [content])...
+        auto flush = [&](ArenaWriter &entries, size_t count) {
+            ArenaWriter data(scratch, entries.Size() + 48);
+            data << ID
+                 << " "
+                 << count
+                 << entries.View();
+            connection->EnqueueResponse(ClientResponse::Frame(scratch, ClientActionType::HistoryBatch,
+                                                              connection->FileDescriptor, data.View()));
+        };
+        ArenaWriter entries(scratch, HISTORY_FRAME_BYTES);
+        size_t count = 0;
+        for (size_t i = begin; i < end; i++) {
+            auto &[mID, sID, content] = Messages[i];
+            if (count && entries.Size() + content.size() + 80 > HISTORY_FRAME_BYTES) {
+                flush(entries, count);
+                entries.Clear();
+                count = 0;
             }
+            entries << " "
+                    << mID
+                    << " "
+                    << i + 1
+                    << " "
+                    << sID
+                    << " "
+                    << content.size()
+                    << " "
+                    << content;
+            count++;
         }
+        if (count)
+            flush(entries, count);
+        connection->Write();
     }
-} // server
\ No newline at end of file
+} // server
@@ -2,40 +2,112 @@
 #define EPOLLCHAT_CHATROOM_H
 
 #include <string>
+#include <string_view>
 #include <memory>
 #include <mutex>
 #include <vector>
+#include <atomic>
+#include <unordered_map>
 
 #include "../general/Constants.h"
+#include "../general/Arena.h"
 #include "Account.h"
+#include "MemberSet.h"
+#include "Presence.h"
+#include "ProfiledMutex.h"
 
 using namespace std;
 using namespace src::classes::general;
 
+// Most messages a single FetchHistory returns, and the payload size its HistoryBatch frames are cut at.
+#define HISTORY_PAGE_LIMIT 500
+#define HISTORY_FRAME_BYTES 32768
+// Most missed messages a Resync sends for one room, a client further behind is told to reload it.
+#define RESYNC_MAX_DELTA 1000
+
 namespace src::classes::server {
+    class FanoutPool;
+    class Client;
 
     class ChatRoom {
     public :
         Hash ID;
         string DisplayName;
-        vector<tuple<Hash,string>> Messages;
-        vector<shared_ptr<Account>> Members;
+        // (message id, sender id, content), ordered by id: ids come from one counter and a room's
+        // messages are all pushed by its one owner, so a cursor is found by binary search. The log is
+        // append-only, a message's position + 1 is its per-room sequence number.
+        vector<tuple<Hash,Hash,string>> Messages;
+        MemberSet Members;
         shared_ptr<Account> Host;
 
         ChatRoom();
         explicit ChatRoom(string dispName, const shared_ptr<Account>& p_hostPtr);
-        void PushMessage(Hash sID, const string& p_msg);
+        // Rooms of FANOUT_PARALLEL_THRESHOLD members or more are delivered by 'fanout' when given, the
+        // call then returns as soon as the message is stored and the deliveries are queued.
+        // The sender's sessions other than 'origin' get the message too, none do without one.
+        // Sessions viewing other rooms are passed over, see Client::Views; QueueBump then tells whether
+        // the room has to be handed to the unread-bump flush.
+        // Returns the message's sequence number in this room.
+        Hash PushMessage(Hash mID, Hash sID, string_view p_msg, Arena &scratch, FanoutPool *fanout = nullptr,
+                         const Client *origin = nullptr);
+        // Queues up to 'limit' messages older than 'before' (the newest ones when 0) to 'connection',
+        // oldest first, as HistoryBatch frames. Returns how many were sent; 'next' is set to the cursor
+        // of the page before them, 0 when there is nothing older.
+        size_t SendHistory(const IntrusivePtr<Client> &connection, Hash before, size_t limit, Hash &next,
+                           Arena &scratch);
+        // Queues the messages after sequence number 'seq' to 'connection' as HistoryBatch frames and sets
+        // 'latest' to the room's last sequence number. Sends nothing and returns false when more than
+        // 'limit' were missed, or when 'seq' is ahead of the room.
+        bool SendSince(const IntrusivePtr<Client> &connection, Hash seq, size_t limit, Hash &latest,
+                       Arena &scratch);
         void PushMember(const shared_ptr<Account>& p_member);
-        tuple<Hash,string> GetMessage(int i);
+        tuple<Hash,Hash,string> GetMessage(int i);
         shared_ptr<Account> GetMember(int i);
         void EraseMember(Hash id);
+        // Add or remove several members under one lock, 'changed[i]' is set when the i-th one was. Null
+        // accounts are skipped.
+        void PushMembers(const vector<shared_ptr<Account>> &members, vector<bool> &changed);
+        void EraseMembers(const vector<Hash> &ids, vector<bool> &changed);
         bool FindMember(Hash id);
+        // The members 'presence' has online, found by intersecting the two bitsets. Returns how many there
+        // are, sets 'members' to the room's size and appends the IDs of up to 'limit' of them to 'ids'.
+        size_t OnlineMembers(const Presence &presence, vector<Hash> &ids, size_t limit, size_t &members);
+        // Appends every online member to 'out'.
+        void OnlineAccounts(const Presence &presence, vector<shared_ptr<Account>> &out);
+        // A copy of the member bitset, see MemberSet::Words.
+        vector<pair<Hash, uint64_t>> MemberWords();
         bool FindMessage(unsigned long i);
+        // The sequence number of the room's last message, 0 while it has none. Safe from any thread, so
+        // unread counts (LatestSeq less the reader's cursor, see Account::ReadCursor) never wait on the owner.
+        [[nodiscard]] Hash LatestSeq() const;
+        // True once after messages were pushed past a session, until the next TakeBumps.
+        bool QueueBump();
+        // Appends each session that was passed over since the last call, with how many of the room's
+        // messages passed it by, to 'sessions'.
+        void TakeBumps(vector<pair<IntrusivePtr<Client>, Hash>> &sessions);
+        // Called before the room is published when a RoomShards worker will own it. Its members and
+        // messages are then only touched from that worker, so the room stops taking its locks.
+        void ClaimForShard();
     private:
         static Hash count;
-        unique_ptr<mutex> m_Messages;
-        unique_ptr<mutex> m_Members;
+        // Latched once the room crosses the threshold, so a room never goes back to inline delivery
+        // while earlier messages may still be queued on the workers.
+        bool ParallelFanout;
+        bool ShardOwned;
+        // Per passed-over session, how many messages passed it by since the last TakeBumps; counted for
+        // each session on its own, as sessions change views at any time. Owner-only.
+        unordered_map<Client *, pair<IntrusivePtr<Client>, Hash>> Unbumped;
+        bool BumpQueued;
+        // The sessions PushMessage's deliveries passed over, kept to be reused. Owner-only.
+        vector<IntrusivePtr<Client>> Passed;
+        // Messages.size(), published by the owner after each push.
+        atomic<Hash> Latest;
+        unique_ptr<ProfiledMutex> m_Messages;
+        unique_ptr<ProfiledMutex> m_Members;
         void Setup();
+        unique_lock<ProfiledMutex> Guard(ProfiledMutex &m) const;
+        // Messages[begin, end) as HistoryBatch frames, the caller holds m_Messages.
+        void SendBatches(const IntrusivePtr<Client> &connection, size_t begin, size_t end, Arena &scratch);
     };
 
 } // server
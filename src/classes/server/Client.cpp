@@ -1,75 +1,324 @@
 #include "../general/Constants.h"
 #include "Client.h"
 #include "Account.h"
+#include "EventCoalescer.h"
+#include "Trace.h"
+#include "../general/ClientResponse.h"
 #include <unistd.h>
 #include <memory>
 #include <cstring>
+#include <cerrno>
+#include <algorithm>
 
 namespace src::classes::server {
     Hash Client::count = 0;
 
     Client::Client(int fd, sockaddr_storage addr, bool guest)
-            : FileDescriptor(fd), Address(addr), IsGuest(guest) {
+            : FileDescriptor(fd), Address(addr), IsGuest(guest),
+              WriteMutex(WriteStats()), ReadMutex(ReadStats()), OwnerMutex(OwnerStats()) {
         Setup();
     }
 
     Client::~Client() {
-        WriteBuffer.clear();
-        WriteBuffer.resize(0);
-        ReadBuffer.clear();
-        ReadBuffer.resize(0);
+        {
+            lock_guard<ProfiledMutex> guard(ReadMutex);
+            if (Inbound)
+                IOBuffer::Return(Inbound);
+            Inbound = nullptr;
+        }
+        {
+            lock_guard<ProfiledMutex> guard(WriteMutex);
+            while (OutboundHead) {
+                IOBuffer *next = OutboundHead->Next;
+                IOBuffer::Return(OutboundHead);
+                OutboundHead = next;
+            }
+            OutboundTail = nullptr;
+        }
         Owner = nullptr;
-        close(FileDescriptor);
-
-        // No need to manually delete the unique_ptr mutexes, they are automatically cleaned up.
+        Close();
     }
 
     ssize_t Client::Read() {
-        std::lock_guard<std::mutex> guard(*ReadMutex);
+        TRACE_SPAN_ARG("Client::Read", FileDescriptor);
+        std::lock_guard<ProfiledMutex> guard(ReadMutex);
+        if (!Inbound)
+            Inbound = IOBuffer::Borrow();
+        if (Inbound->Space() == 0) {
+            errno = ENOBUFS;
+            return -1;
+        }
+
+        ssize_t totalBytesRead = 0;
         ssize_t bytesRead = 0;
-        size_t totalBytesRead = 0;
-        const int buffer_size = 1024;
-        char tmp_r_buff[buffer_size] = {};
-        memset(&tmp_r_buff, 0, sizeof tmp_r_buff);
-        bytesRead = recv(FileDescriptor, &tmp_r_buff, buffer_size - totalBytesRead, 0);
-
-        // Transfer data to ReadBuffer
-        ReadBuffer.clear();
-        for (int i = 0; i < buffer_size && tmp_r_buff[i] != '\0'; ++i) {
-            ReadBuffer.push_back(tmp_r_buff[i]);
-            totalBytesRead++;
+        while (Inbound->Space() > 0) {
+            bytesRead = recv(FileDescriptor, Inbound->Data + Inbound->End, Inbound->Space(), 0);
+            if (bytesRead <= 0)
+                break;
+            Inbound->End += bytesRead;
+            totalBytesRead += bytesRead;
+        }
+
+        int savedErrno = errno;
+        if (Inbound->Size() == 0) {
+            IOBuffer::Return(Inbound);
+            Inbound = nullptr;
+        }
+        errno = savedErrno;
+        return totalBytesRead > 0 ? totalBytesRead : bytesRead;
+    }
+
+    string_view Client::PendingInput() {
+        std::lock_guard<ProfiledMutex> guard(ReadMutex);
+        if (!Inbound)
+            return {};
+        return {Inbound->Data + Inbound->Begin, Inbound->Size()};
+    }
+
+    void Client::ConsumeInput(size_t bytes) {
+        std::lock_guard<ProfiledMutex> guard(ReadMutex);
+        if (!Inbound)
+            return;
+        Inbound->Begin += min(bytes, Inbound->Size());
+        if (Inbound->Size() == 0) {
+            IOBuffer::Return(Inbound);
+            Inbound = nullptr;
+        } else if (Inbound->Begin > 0) {
+            // Keep the partial frame at the front so the next Read() has the most room.
+            memmove(Inbound->Data, Inbound->Data + Inbound->Begin, Inbound->Size());
+            Inbound->End -= Inbound->Begin;
+            Inbound->Begin = 0;
         }
-        return totalBytesRead;
+    }
+
+    bool Client::InputFull() {
+        std::lock_guard<ProfiledMutex> guard(ReadMutex);
+        return Inbound && Inbound->Space() == 0;
     }
 
     ssize_t Client::Write() {
-        std::lock_guard<std::mutex> guard(*WriteMutex);
-        ssize_t bytesWritten = write(FileDescriptor, WriteBuffer.data(), WriteBuffer.size());
-        if (bytesWritten > 0) {
-            WriteBuffer.clear();  // Clear buffer after writing
+        TRACE_SPAN_ARG("Client::Write", FileDescriptor);
+        std::lock_guard<ProfiledMutex> guard(WriteMutex);
+        if (Closed) {
+            errno = EBADF;
+            return -1;
+        }
+        ssize_t totalBytesWritten = 0;
+        while (OutboundHead) {
+            ssize_t bytesWritten = write(FileDescriptor, OutboundHead->Data + OutboundHead->Begin,
+                                         OutboundHead->Size());
+            if (bytesWritten <= 0)
+                return totalBytesWritten > 0 ? totalBytesWritten : bytesWritten;
+            totalBytesWritten += bytesWritten;
+            OutboundHead->Begin += bytesWritten;
+            if (OutboundHead->Size() == 0) {
+                IOBuffer *next = OutboundHead->Next;
+                IOBuffer::Return(OutboundHead);
+                OutboundHead = next;
+                if (!OutboundHead)
+                    OutboundTail = nullptr;
+            }
+        }
+        return totalBytesWritten;
+    }
+
+    bool Client::HasPendingOutput() {
+        std::lock_guard<ProfiledMutex> guard(WriteMutex);
+        return OutboundHead != nullptr;
+    }
+
+    void Client::EnqueueResponse(string_view s_resp) {
+        std::lock_guard<ProfiledMutex> guard(WriteMutex);
+        if (Closed)
+            return;
+        ReleaseHeld();
+        Append(s_resp);
+    }
+
+    void Client::PushEvent(ClientActionType type, string_view data, Arena &scratch) {
+        if (!Coalescer) {
+            EnqueueResponse(ClientResponse::Frame(scratch, type, FileDescriptor, data));
+            Write();
+            return;
+        }
+        bool full, mark = false;
+        {
+            std::lock_guard<ProfiledMutex> guard(WriteMutex);
+            if (Closed)
+                return;
+            //format {type} {length}|[data]
+            ArenaWriter entry(scratch, data.size() + 32);
+            entry << " "
+                  << static_cast<int>(type)
+                  << " "
+                  << data.size()
+                  << "|"
+                  << data;
+            HeldEvents.append(entry.View());
+            HeldCount++;
+            if ((full = Coalescer->Full(HeldCount, HeldEvents.size())))
+                ReleaseHeld();
+            else if (!HeldMarked)
+                mark = HeldMarked = true;
+        }
+        if (full)
+            Write();
+        else if (mark)
+            Coalescer->MarkPending(IntrusivePtr<Client>(this));
+    }
+
+    void Client::FlushEvents() {
+        {
+            std::lock_guard<ProfiledMutex> guard(WriteMutex);
+            HeldMarked = false;
+            if (Closed || HeldCount == 0)
+                return;
+            ReleaseHeld();
+        }
+        Write();
+    }
+
+    void Client::Append(string_view bytes) {
+        while (!bytes.empty()) {
+            if (!OutboundTail || OutboundTail->Space() == 0) {
+                IOBuffer *buffer = IOBuffer::Borrow();
+                if (OutboundTail)
+                    OutboundTail->Next = buffer;
+                else
+                    OutboundHead = buffer;
+                OutboundTail = buffer;
+            }
+            size_t chunk = min(bytes.size(), OutboundTail->Space());
+            memcpy(OutboundTail->Data + OutboundTail->End, bytes.data(), chunk);
+            OutboundTail->End += chunk;
+            bytes.remove_prefix(chunk);
         }
-        return bytesWritten;
     }
 
-    void Client::EnqueueResponse(const std::string &s_resp) {
-        std::lock_guard<std::mutex> guard(*WriteMutex);
-        WriteBuffer.insert(WriteBuffer.end(), s_resp.begin(), s_resp.end());
+    void Client::ReleaseHeld() {
+        if (HeldCount == 0)
+            return;
+        // Same layout as ClientResponse::Frame, the entries already sit in HeldEvents.
+        //format {count} ({type} {length}|[data])...
+        char header[64];
+        int length = snprintf(header, sizeof header, "%c %d %d %c %zu", DELIMITER_START,
+                              static_cast<int>(ClientActionType::EventBatch), FileDescriptor, DATA_START, HeldCount);
+        static const char trailer[] = {' ', ' ', DATA_END, ' ', DELIMITER_END};
+        Append({header, (size_t) length});
+        Append(HeldEvents);
+        Append({trailer, sizeof trailer});
+        HeldEvents.clear();
+        HeldCount = 0;
     }
 
     void Client::Setup() {
-        WriteMutex = std::make_unique<std::mutex>();
-        ReadMutex = std::make_unique<std::mutex>();
-        OwnerMutex = std::make_unique<std::mutex>();
-        ReadBuffer.reserve(BUFFER_SIZE);
-        WriteBuffer.reserve(BUFFER_SIZE);
+        Inbound = nullptr;
+        OutboundHead = nullptr;
+        OutboundTail = nullptr;
+        Closed = false;
+        HeldCount = 0;
+        HeldMarked = false;
+        Coalescer = nullptr;
+        SkippingFrame = false;
+        Selective = false;
+        for (auto &viewed: Viewed)
+            viewed = 0;
+        SessionIndex = 0;
         Owner = nullptr;
         ID = count++;
     }
 
+    void Client::Close() {
+        std::lock_guard<ProfiledMutex> guard(WriteMutex);
+        if (Closed)
+            return;
+        Closed = true;
+        while (OutboundHead) {
+            IOBuffer *next = OutboundHead->Next;
+            IOBuffer::Return(OutboundHead);
+            OutboundHead = next;
+        }
+        OutboundTail = nullptr;
+        HeldEvents.clear();
+        HeldCount = 0;
+        close(FileDescriptor);
+    }
+
     void Client::SetOwner(std::shared_ptr<src::classes::server::Account> owner) {
-        std::lock_guard<std::mutex> guard(*OwnerMutex);
+        std::lock_guard<ProfiledMutex> guard(OwnerMutex);
         this->Owner = std::move(owner);
     }
 
-    Client::Client() = default;
+    bool Client::Views(Hash roomID) const {
+        if (!Selective.load(memory_order_relaxed))
+            return true;
+        for (auto &viewed: Viewed)
+            if (viewed.load(memory_order_relaxed) == roomID)
+                return true;
+        return false;
+    }
+
+    bool Client::IsSelective() const {
+        return Selective.load(memory_order_relaxed);
+    }
+
+    bool Client::Subscribe(Hash roomID) {
+        Selective.store(true, memory_order_relaxed);
+        while (true) {
+            // Checked again on every attempt, a concurrent call may have taken the room or the slot.
+            if (Views(roomID))
+                return true;
+            size_t slot = 0;
+            while (slot < CLIENT_MAX_VIEWED && Viewed[slot].load() != 0)
+                slot++;
+            if (slot == CLIENT_MAX_VIEWED)
+                return false;
+            Hash free = 0;
+            if (!Viewed[slot].compare_exchange_strong(free, roomID))
+                continue;
+            // A concurrent call for the same room may have won another slot in between. Of two such slots
+            // the higher one is freed, whichever of the two calls gets to it; one of them always sees the
+            // other, as both write before they look.
+            for (size_t other = 0; other < CLIENT_MAX_VIEWED; other++) {
+                Hash held = roomID;
+                if (other != slot && Viewed[other].load() == roomID)
+                    Viewed[max(slot, other)].compare_exchange_strong(held, 0);
+            }
+            return true;
+        }
+    }
+
+    void Client::Unsubscribe(Hash roomID) {
+        Selective.store(true, memory_order_relaxed);
+        for (auto &viewed: Viewed) {
+            Hash expected = roomID;
+            if (roomID == 0)
+                viewed.store(0, memory_order_relaxed);
+            else
+                viewed.compare_exchange_strong(expected, 0, memory_order_relaxed);
+        }
+    }
+
+    void Client::ResetViews() {
+        for (auto &viewed: Viewed)
+            viewed.store(0, memory_order_relaxed);
+        Selective.store(false, memory_order_relaxed);
+    }
+
+    Client::Client() : Client(-1, sockaddr_storage{}, true) {}
+
+    LockStats *Client::WriteStats() {
+        static LockStats *stats = LockRegistry::For("Client::WriteMutex");
+        return stats;
+    }
+
+    LockStats *Client::ReadStats() {
+        static LockStats *stats = LockRegistry::For("Client::ReadMutex");
+        return stats;
+    }
+
+    LockStats *Client::OwnerStats() {
+        static LockStats *stats = LockRegistry::For("Client::OwnerMutex");
+        return stats;
+    }
 } // namespace server
\ No newline at end of file
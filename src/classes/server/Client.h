@@ -6,46 +6,109 @@
 #define EPOLLCHAT_CLIENT_H
 
 #include <string>
-#include <vector>
+#include <string_view>
 #include <sys/socket.h>
 #include <memory>
 #include <mutex>
+#include <atomic>
 
 #include "../general/Constants.h"
+#include "../general/Enums.h"
+#include "../general/Arena.h"
+#include "../general/ObjectPool.h"
+#include "ProfiledMutex.h"
+#include "IOBuffer.h"
 
 using namespace std;
 using namespace src::classes::general;
 
+// Rooms one session may have subscribed to at once.
+#define CLIENT_MAX_VIEWED 4
+
 namespace src::classes::server {
     class Account;
-    class Client {
+    class EventCoalescer;
+    class Client : public RefCounted<Client> {
     public:
         Hash ID;
         shared_ptr<Account> Owner;
         bool IsGuest;
         int FileDescriptor;
+        // Position in the owner's session list, maintained by Account::Attach/Detach.
+        size_t SessionIndex;
         sockaddr_storage Address;
-        vector<char> ReadBuffer;
-        vector<char> WriteBuffer;
+        // Set when the server coalesces pushed events, see PushEvent.
+        EventCoalescer *Coalescer;
+        // Set while the rest of an oversized frame, already answered, is being skipped; reactor-only.
+        bool SkippingFrame;
 
         Client();
         explicit Client(int fd, sockaddr_storage addr, bool guest);
 
         ~Client();
 
+        // Reads until the socket would block or the inbound buffer is full. Returns the bytes read,
+        // 0 on end of stream and -1 with errno set otherwise (EAGAIN once everything was read).
         ssize_t Read();
+        // Unparsed inbound bytes, valid until the next Read() or ConsumeInput().
+        string_view PendingInput();
+        void ConsumeInput(size_t bytes);
+        [[nodiscard]] bool InputFull();
 
+        // Flushes queued output until the socket would block, the rest goes out on EPOLLOUT.
         ssize_t Write();
+        [[nodiscard]] bool HasPendingOutput();
 
-        void EnqueueResponse(const string &s_resp);
+        // Queues a frame, after any events held back, so the session sees everything in the order raised.
+        void EnqueueResponse(string_view s_resp);
+        // Queues and writes a pushed event. With a coalescer it is held instead and joins the session's
+        // next EventBatch frame, which goes out when the coalescer flushes or once the batch is full.
+        void PushEvent(ClientActionType type, string_view data, Arena &scratch);
+        // Queues and writes the held batch, called by the coalescer.
+        void FlushEvents();
+        // Closes the socket once. Output queued or written afterwards is dropped, the descriptor may
+        // already belong to a newer connection while an account still holds this one.
+        void Close();
         void SetOwner(shared_ptr<Account> owner);
 
+        // The rooms the session has on screen. One that never subscribed is sent every room's messages in
+        // full; once it has, only these rooms' are, the others' are counted into UnreadBump frames.
+        // Lock-free, the reactor and room shards both read and change them.
+        [[nodiscard]] bool Views(Hash roomID) const;
+        [[nodiscard]] bool IsSelective() const;
+        // Returns false when CLIENT_MAX_VIEWED rooms are viewed already.
+        bool Subscribe(Hash roomID);
+        // A room of 0 stops viewing every room.
+        void Unsubscribe(Hash roomID);
+        // Stops viewing every room and makes the session one that never subscribed, as it is when the
+        // account is logged out and the next one logged in on the connection.
+        void ResetViews();
+
     private:
         static Hash count;
-        unique_ptr<mutex> WriteMutex;
-        unique_ptr<mutex> ReadMutex;
-        unique_ptr<mutex> OwnerMutex;
+        IOBuffer *Inbound;
+        IOBuffer *OutboundHead;
+        IOBuffer *OutboundTail;
+        bool Closed;
+        atomic<bool> Selective;
+        // Viewed room ids, 0 marks a free slot.
+        atomic<Hash> Viewed[CLIENT_MAX_VIEWED];
+        // Pushed events waiting for the coalescer, as '({type} {length}|[data])...'.
+        string HeldEvents;
+        size_t HeldCount;
+        // Whether the coalescer knows about the held events.
+        bool HeldMarked;
+        ProfiledMutex WriteMutex;
+        ProfiledMutex ReadMutex;
+        ProfiledMutex OwnerMutex;
         void Setup();
+        // Appends to the outbound queue, the caller holds WriteMutex.
+        void Append(string_view bytes);
+        // Moves the held events into the outbound queue as one EventBatch frame, the caller holds WriteMutex.
+        void ReleaseHeld();
+        static LockStats *WriteStats();
+        static LockStats *ReadStats();
+        static LockStats *OwnerStats();
     };
 }// server
 
@@ -0,0 +1,36 @@
+#include "EventCoalescer.h"
+
+
+namespace src::classes::server {
+
+    EventCoalescer::EventCoalescer(unsigned windowMicros, unsigned maxEvents)
+            : WindowMicros(windowMicros), MaxEvents(maxEvents) {
+    }
+
+    bool EventCoalescer::Full(size_t events, size_t bytes) const {
+        return (MaxEvents && events >= MaxEvents) || bytes >= COALESCE_MAX_BYTES;
+    }
+
+    void EventCoalescer::MarkPending(IntrusivePtr<Client> session) {
+        lock_guard<mutex> guard(m_Pending);
+        Pending.push_back(std::move(session));
+        Timer.Arm(WindowMicros);
+    }
+
+    int EventCoalescer::FlushFD() const {
+        return Timer.FD();
+    }
+
+    size_t EventCoalescer::Flush() {
+        {
+            lock_guard<mutex> guard(m_Pending);
+            Timer.Expire();
+            Flushing.swap(Pending);
+        }
+        size_t sessions = Flushing.size();
+        for (auto &session: Flushing)
+            session->FlushEvents();
+        Flushing.clear();
+        return sessions;
+    }
+} // server
@@ -0,0 +1,60 @@
+#ifndef EPOLLCHAT_EVENTCOALESCER_H
+#define EPOLLCHAT_EVENTCOALESCER_H
+
+#include <vector>
+#include <mutex>
+#include <cstddef>
+
+#include "../general/ObjectPool.h"
+#include "Client.h"
+#include "FlushTimer.h"
+
+using namespace std;
+using namespace src::classes::general;
+
+// How long a session's pushed events may be held for one EventBatch frame, and how many events one
+// batch holds before it is sent right away; coalescing is off while both are 0. Set through the
+// ECHAT_COALESCE_US and ECHAT_COALESCE_EVENTS cmake cache variables.
+#ifndef COALESCE_WINDOW_US
+#define COALESCE_WINDOW_US 0
+#endif
+#ifndef COALESCE_MAX_EVENTS
+#define COALESCE_MAX_EVENTS 0
+#endif
+// Bytes of events a batch holds before it is sent right away, whatever the limits above.
+#define COALESCE_MAX_BYTES 32768
+
+namespace src::classes::server {
+
+    // Sessions whose pushed events are being held. A session registers itself when it holds its first
+    // event; once the window of the oldest registration is over the reactor writes every held batch,
+    // one frame and one write() per session, however many events it gathered. Without a window the
+    // batches go out on the reactor's next loop iteration.
+    class EventCoalescer {
+    public:
+        EventCoalescer(unsigned windowMicros, unsigned maxEvents);
+        EventCoalescer(const EventCoalescer &) = delete;
+        EventCoalescer &operator=(const EventCoalescer &) = delete;
+
+        // Whether a batch of 'events' events and 'bytes' bytes has to go out without waiting.
+        [[nodiscard]] bool Full(size_t events, size_t bytes) const;
+        // Called from any thread by a session that started holding events.
+        void MarkPending(IntrusivePtr<Client> session);
+        // Readable once held batches are due, meant to be registered with the reactor's epoll.
+        [[nodiscard]] int FlushFD() const;
+        // Reactor-only. Writes out the batch of every registered session, returns how many there were.
+        size_t Flush();
+    private:
+        unsigned WindowMicros;
+        unsigned MaxEvents;
+        mutex m_Pending;
+        vector<IntrusivePtr<Client>> Pending;
+        // Swapped with Pending on every flush, so neither is reallocated once warm.
+        vector<IntrusivePtr<Client>> Flushing;
+        // Guarded by m_Pending.
+        FlushTimer Timer;
+    };
+
+} // server
+
+#endif //EPOLLCHAT_EVENTCOALESCER_H
@@ -0,0 +1,82 @@
+#include "FanoutPool.h"
+#include "Trace.h"
+
+namespace src::classes::server {
+
+    FanoutPool::FanoutPool(unsigned workers) : Stopping(false), InFlight(0) {
+        if (workers == 0)
+            workers = 1;
+        for (unsigned i = 0; i < workers; i++)
+            Pool.push_back(make_unique<Worker>());
+        for (auto &worker: Pool)
+            worker->Thread = thread([this, w = worker.get()]() { Run(*w); });
+    }
+
+    FanoutPool::~FanoutPool() {
+        Stopping.store(true);
+        for (auto &worker: Pool) {
+            {
+                lock_guard<mutex> guard(worker->m_Tasks);
+            }
+            worker->Wake.notify_all();
+        }
+        for (auto &worker: Pool)
+            if (worker->Thread.joinable())
+                worker->Thread.join();
+    }
+
+    unsigned FanoutPool::Workers() const {
+        return (unsigned) Pool.size();
+    }
+
+    unsigned FanoutPool::WorkerFor(Hash recipientID) const {
+        return (unsigned) (recipientID % Pool.size());
+    }
+
+    void FanoutPool::Submit(unsigned worker, Task task) {
+        InFlight.fetch_add(1);
+        auto &target = *Pool[worker];
+        {
+            lock_guard<mutex> guard(target.m_Tasks);
+            target.Tasks.push_back(std::move(task));
+        }
+        target.Wake.notify_one();
+    }
+
+    long long FanoutPool::Pending() const {
+        return InFlight.load();
+    }
+
+    void FanoutPool::Drain() {
+        unique_lock<mutex> lock(m_Idle);
+        Idle.wait(lock, [this]() { return InFlight.load() == 0; });
+    }
+
+    void FanoutPool::Run(Worker &worker) {
+        Arena scratch;
+        while (true) {
+            Task task;
+            {
+                unique_lock<mutex> lock(worker.m_Tasks);
+                worker.Wake.wait(lock, [&]() { return Stopping.load() || !worker.Tasks.empty(); });
+                if (worker.Tasks.empty())
+                    return;
+                task = std::move(worker.Tasks.front());
+                worker.Tasks.pop_front();
+            }
+
+            {
+                TRACE_SPAN_ARG("FanoutPool::Deliver", task.Recipients.size());
+                for (auto &recipient: task.Recipients) {
+                    recipient->PushEvent(task.Type, *task.Data, scratch);
+                    scratch.Reset();
+                }
+            }
+
+            if (InFlight.fetch_sub(1) == 1) {
+                lock_guard<mutex> guard(m_Idle);
+                Idle.notify_all();
+            }
+        }
+    }
+} // server
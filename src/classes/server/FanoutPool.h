@@ -0,0 +1,68 @@
+#ifndef EPOLLCHAT_FANOUTPOOL_H
+#define EPOLLCHAT_FANOUTPOOL_H
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "../general/Constants.h"
+#include "../general/Enums.h"
+#include "../general/ObjectPool.h"
+#include "Client.h"
+
+using namespace std;
+using namespace src::classes::general;
+
+#define FANOUT_PARALLEL_THRESHOLD 1024
+
+namespace src::classes::server {
+
+    // Workers that write large-room deliveries off the reactor thread. A recipient is always handled
+    // by worker (ID % Workers) and every worker drains its queue in order, so messages of a room reach
+    // each recipient in the order they were committed.
+    class FanoutPool {
+    public:
+        struct Task {
+            ClientActionType Type;
+            shared_ptr<const string> Data;
+            vector<IntrusivePtr<Client>> Recipients;
+        };
+
+        explicit FanoutPool(unsigned workers = thread::hardware_concurrency());
+        ~FanoutPool();
+        FanoutPool(const FanoutPool &) = delete;
+        FanoutPool &operator=(const FanoutPool &) = delete;
+
+        [[nodiscard]] unsigned Workers() const;
+        [[nodiscard]] unsigned WorkerFor(Hash recipientID) const;
+        // Hands one partition of a delivery to worker 'worker'; the task's recipients must all map to it.
+        void Submit(unsigned worker, Task task);
+        // Number of queued and in-flight tasks over all workers.
+        [[nodiscard]] long long Pending() const;
+        // Blocks until every submitted task has been delivered.
+        void Drain();
+    private:
+        struct Worker {
+            mutex m_Tasks;
+            condition_variable Wake;
+            deque<Task> Tasks;
+            thread Thread;
+        };
+
+        vector<unique_ptr<Worker>> Pool;
+        atomic<bool> Stopping;
+        atomic<long long> InFlight;
+        mutex m_Idle;
+        condition_variable Idle;
+
+        void Run(Worker &worker);
+    };
+
+} // server
+
+#endif //EPOLLCHAT_FANOUTPOOL_H
@@ -0,0 +1,46 @@
+#include "FlushTimer.h"
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+namespace src::classes::server {
+
+    FlushTimer::FlushTimer() : Armed(false) {
+        TimerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (TimerFD == -1) {
+            perror("timerfd_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    FlushTimer::~FlushTimer() {
+        close(TimerFD);
+    }
+
+    void FlushTimer::Arm(unsigned long micros) {
+        if (Armed)
+            return;
+        if (micros == 0)
+            micros = 1;
+        itimerspec when{};
+        when.it_value.tv_sec = (time_t) (micros / 1000000);
+        when.it_value.tv_nsec = (long) (micros % 1000000) * 1000L;
+        if (timerfd_settime(TimerFD, 0, &when, nullptr) == -1)
+            perror("timerfd_settime");
+        Armed = true;
+    }
+
+    void FlushTimer::Expire() {
+        uint64_t expirations;
+        while (read(TimerFD, &expirations, sizeof expirations) > 0) {
+        }
+        Armed = false;
+    }
+
+    int FlushTimer::FD() const {
+        return TimerFD;
+    }
+} // server
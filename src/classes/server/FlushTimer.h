@@ -0,0 +1,30 @@
+#ifndef EPOLLCHAT_FLUSHTIMER_H
+#define EPOLLCHAT_FLUSHTIMER_H
+
+namespace src::classes::server {
+
+    // The one-shot timerfd behind the modules that gather work for a window and have the reactor flush
+    // it once the window is over (Presence, EventCoalescer, UnreadBumps). Not synchronised, the owning
+    // module serialises Arm and Expire under its own lock.
+    class FlushTimer {
+    public:
+        FlushTimer();
+        ~FlushTimer();
+        FlushTimer(const FlushTimer &) = delete;
+        FlushTimer &operator=(const FlushTimer &) = delete;
+
+        // Opens a window of 'micros' unless one is open already. A zero it_value would disarm the timer,
+        // so a window of 0 still waits a microsecond.
+        void Arm(unsigned long micros);
+        // Drains the expirations and closes the window, so the next Arm opens a new one.
+        void Expire();
+        // Readable once the window is over, meant to be registered with the reactor's epoll.
+        [[nodiscard]] int FD() const;
+    private:
+        int TimerFD;
+        bool Armed;
+    };
+
+} // server
+
+#endif //EPOLLCHAT_FLUSHTIMER_H
@@ -0,0 +1,34 @@
+#ifndef EPOLLCHAT_IOBUFFER_H
+#define EPOLLCHAT_IOBUFFER_H
+
+#include <cstddef>
+
+#include "../general/Constants.h"
+#include "../general/ObjectPool.h"
+
+using namespace std;
+using namespace src::classes::general;
+
+namespace src::classes::server {
+
+    // Fixed-size chunk of connection I/O. A connection borrows one only while it holds a partial
+    // inbound frame or unsent output and hands it back once drained, so idle connections hold none.
+    struct IOBuffer {
+        IOBuffer *Next;
+        size_t Begin;
+        size_t End;
+        char Data[IO_BUFFER_SIZE];
+
+        // Leaves Data uninitialized, it is only ever read between Begin and End.
+        IOBuffer() : Next(nullptr), Begin(0), End(0) {}
+
+        [[nodiscard]] size_t Size() const { return End - Begin; }
+        [[nodiscard]] size_t Space() const { return IO_BUFFER_SIZE - End; }
+
+        static IOBuffer *Borrow() { return ObjectPool<IOBuffer>::Instance().Create(); }
+        static void Return(IOBuffer *buffer) { ObjectPool<IOBuffer>::Instance().Destroy(buffer); }
+    };
+
+} // server
+
+#endif //EPOLLCHAT_IOBUFFER_H
@@ -0,0 +1,99 @@
+#include "KeyVerifier.h"
+#include "Trace.h"
+
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+
+namespace src::classes::server {
+
+    KeyVerifier::KeyVerifier(unsigned workers) : Stopping(false), InFlight(0) {
+        EventFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (EventFD == -1) {
+            perror("eventfd");
+            exit(EXIT_FAILURE);
+        }
+        if (workers == 0)
+            workers = 1;
+        for (unsigned i = 0; i < workers; i++)
+            Workers.emplace_back([this]() { Run(); });
+    }
+
+    KeyVerifier::~KeyVerifier() {
+        Stopping.store(true);
+        {
+            lock_guard<mutex> guard(m_Jobs);
+        }
+        Wake.notify_all();
+        for (auto &worker: Workers)
+            if (worker.joinable())
+                worker.join();
+        close(EventFD);
+    }
+
+    int KeyVerifier::CompletionFD() const {
+        return EventFD;
+    }
+
+    void KeyVerifier::Submit(Job job) {
+        InFlight.fetch_add(1);
+        {
+            lock_guard<mutex> guard(m_Jobs);
+            Jobs.push_back(std::move(job));
+        }
+        Wake.notify_one();
+    }
+
+    size_t KeyVerifier::RunCompletions() {
+        uint64_t signalled;
+        while (read(EventFD, &signalled, sizeof signalled) > 0) {
+        }
+
+        deque<Completion> ready;
+        {
+            lock_guard<mutex> guard(m_Completions);
+            ready.swap(Completions);
+        }
+        for (auto &done: ready) {
+            done();
+            InFlight.fetch_sub(1);
+        }
+        return ready.size();
+    }
+
+    long long KeyVerifier::Pending() const {
+        return InFlight.load();
+    }
+
+    void KeyVerifier::Run() {
+        // Linux nices threads individually, this only lowers the verifier and leaves the reactor alone.
+        setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid), VERIFIER_NICE);
+        while (true) {
+            Job job;
+            {
+                unique_lock<mutex> lock(m_Jobs);
+                Wake.wait(lock, [this]() { return Stopping.load() || !Jobs.empty(); });
+                if (Stopping.load())
+                    return;
+                job = std::move(Jobs.front());
+                Jobs.pop_front();
+            }
+
+            Completion done;
+            {
+                TRACE_SPAN("KeyVerifier::Job");
+                done = job();
+            }
+            {
+                lock_guard<mutex> guard(m_Completions);
+                Completions.push_back(std::move(done));
+            }
+            uint64_t one = 1;
+            if (write(EventFD, &one, sizeof one) == -1)
+                perror("eventfd write");
+        }
+    }
+} // server
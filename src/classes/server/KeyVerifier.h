@@ -0,0 +1,56 @@
+#ifndef EPOLLCHAT_KEYVERIFIER_H
+#define EPOLLCHAT_KEYVERIFIER_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+using namespace std;
+
+// Threads hashing and verifying keys, they run niced so a login burst yields the CPU to the reactor.
+#define VERIFIER_THREADS 2
+#define VERIFIER_NICE 10
+
+namespace src::classes::server {
+
+    // Runs credential hashing off the reactor. A job does its expensive part on a verifier thread and
+    // returns a completion, which is queued and handed back to the reactor through an eventfd; the
+    // reactor runs completions on its own thread, so they may touch reactor-only state freely.
+    class KeyVerifier {
+    public:
+        typedef function<void()> Completion;
+        typedef function<Completion()> Job;
+
+        explicit KeyVerifier(unsigned workers = VERIFIER_THREADS);
+        ~KeyVerifier();
+        KeyVerifier(const KeyVerifier &) = delete;
+        KeyVerifier &operator=(const KeyVerifier &) = delete;
+
+        // Readable while completions are waiting, meant to be registered with the reactor's epoll.
+        [[nodiscard]] int CompletionFD() const;
+        void Submit(Job job);
+        // Runs every finished completion on the calling thread, returns how many ran.
+        size_t RunCompletions();
+        // Number of jobs submitted whose completion has not run yet.
+        [[nodiscard]] long long Pending() const;
+    private:
+        vector<thread> Workers;
+        mutex m_Jobs;
+        condition_variable Wake;
+        deque<Job> Jobs;
+        mutex m_Completions;
+        deque<Completion> Completions;
+        int EventFD;
+        atomic<bool> Stopping;
+        atomic<long long> InFlight;
+
+        void Run();
+    };
+
+} // server
+
+#endif //EPOLLCHAT_KEYVERIFIER_H
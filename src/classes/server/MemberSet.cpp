@@ -0,0 +1,100 @@
+#include "MemberSet.h"
+#include "Account.h"
+
+namespace src::classes::server {
+
+    MemberSet::MemberSet() : Table(MIN_CAPACITY, Slot{EMPTY, 0}) {}
+
+    size_t MemberSet::Home(Hash id) const {
+        // Fibonacci hashing, account IDs are sequential so the multiply spreads neighbours apart.
+        return (size_t) ((id * 11400714819323198485ULL) >> 32) & (Table.size() - 1);
+    }
+
+    size_t MemberSet::Find(Hash id) const {
+        size_t mask = Table.size() - 1;
+        size_t i = Home(id);
+        while (Table[i].ID != EMPTY && Table[i].ID != id)
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    bool MemberSet::Contains(Hash id) const {
+        return Table[Find(id)].ID == id;
+    }
+
+    const shared_ptr<Account> *MemberSet::Get(Hash id) const {
+        const Slot &slot = Table[Find(id)];
+        return slot.ID == id ? &Members[slot.Index] : nullptr;
+    }
+
+    bool MemberSet::Insert(const shared_ptr<Account> &member) {
+        Hash id = member->ID;
+        size_t i = Find(id);
+        if (Table[i].ID == id)
+            return false;
+
+        Table[i] = {id, (uint32_t) Members.size()};
+        IDs.push_back(id);
+        Members.push_back(member);
+        auto [word, fresh] = WordIndex.try_emplace(id / 64, (uint32_t) BitWords.size());
+        if (fresh)
+            BitWords.emplace_back(id / 64, 0);
+        BitWords[word->second].second |= 1ULL << (id % 64);
+
+        // Keep the load factor at or below one half so probe runs stay short.
+        if (Members.size() * 2 > Table.size())
+            Rehash(Table.size() * 2);
+        return true;
+    }
+
+    bool MemberSet::Erase(Hash id) {
+        size_t i = Find(id);
+        if (Table[i].ID != id)
+            return false;
+
+        // Swap the last member into the freed position.
+        uint32_t index = Table[i].Index;
+        uint32_t last = (uint32_t) Members.size() - 1;
+        if (index != last) {
+            IDs[index] = IDs[last];
+            Members[index] = std::move(Members[last]);
+            Table[Find(IDs[index])].Index = index;
+        }
+        IDs.pop_back();
+        Members.pop_back();
+        auto word = WordIndex.find(id / 64);
+        if ((BitWords[word->second].second &= ~(1ULL << (id % 64))) == 0) {
+            uint32_t at = word->second;
+            WordIndex.erase(word);
+            if (at != BitWords.size() - 1) {
+                BitWords[at] = BitWords.back();
+                WordIndex[BitWords[at].first] = at;
+            }
+            BitWords.pop_back();
+        }
+
+        // Backward-shift deletion: pull later entries of the probe run into the hole so lookups
+        // never need tombstones.
+        size_t mask = Table.size() - 1;
+        size_t hole = i;
+        size_t j = (i + 1) & mask;
+        while (Table[j].ID != EMPTY) {
+            size_t home = Home(Table[j].ID);
+            if (((j - home) & mask) >= ((j - hole) & mask)) {
+                Table[hole] = Table[j];
+                hole = j;
+            }
+            j = (j + 1) & mask;
+        }
+        Table[hole] = {EMPTY, 0};
+        return true;
+    }
+
+    void MemberSet::Rehash(size_t capacity) {
+        vector<Slot> old = std::move(Table);
+        Table.assign(capacity, Slot{EMPTY, 0});
+        for (auto &slot: old)
+            if (slot.ID != EMPTY)
+                Table[Find(slot.ID)] = slot;
+    }
+} // server
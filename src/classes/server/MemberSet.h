@@ -0,0 +1,63 @@
+#ifndef EPOLLCHAT_MEMBERSET_H
+#define EPOLLCHAT_MEMBERSET_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <utility>
+#include <unordered_map>
+
+#include "../general/Constants.h"
+
+using namespace std;
+using namespace src::classes::general;
+
+namespace src::classes::server {
+    class Account;
+
+    // Room membership. Members sit in a dense array (with their IDs alongside) for fan-out, and an
+    // open-addressing table maps an account ID to its position. Lookups touch one or two table lines
+    // and never dereference an Account; joins and leaves are O(1), leaves swap the last member in.
+    // The IDs are also kept as a sparse bitset, for presence to be intersected with the room in bulk.
+    class MemberSet {
+    public:
+        MemberSet();
+
+        // Returns false when the account is already a member.
+        bool Insert(const shared_ptr<Account> &member);
+        bool Erase(Hash id);
+        [[nodiscard]] bool Contains(Hash id) const;
+        // The member with 'id', null when there is none.
+        [[nodiscard]] const shared_ptr<Account> *Get(Hash id) const;
+        // A (word, bits) pair, in no particular order, for every 64 account IDs holding a member: bit i
+        // of word w is account w * 64 + i.
+        [[nodiscard]] const vector<pair<Hash, uint64_t>> &Words() const { return BitWords; }
+
+        [[nodiscard]] size_t Size() const { return Members.size(); }
+        [[nodiscard]] Hash IDAt(size_t i) const { return IDs[i]; }
+        const shared_ptr<Account> &operator[](size_t i) const { return Members[i]; }
+        [[nodiscard]] vector<shared_ptr<Account>>::const_iterator begin() const { return Members.begin(); }
+        [[nodiscard]] vector<shared_ptr<Account>>::const_iterator end() const { return Members.end(); }
+    private:
+        struct Slot {
+            Hash ID;
+            uint32_t Index;
+        };
+        static const Hash EMPTY = ~0ULL;
+        static const size_t MIN_CAPACITY = 8;
+
+        vector<Slot> Table;
+        vector<Hash> IDs;
+        vector<shared_ptr<Account>> Members;
+        vector<pair<Hash, uint64_t>> BitWords;
+        // Word -> its position in BitWords, emptied words are swapped out like members.
+        unordered_map<Hash, uint32_t> WordIndex;
+
+        [[nodiscard]] size_t Home(Hash id) const;
+        [[nodiscard]] size_t Find(Hash id) const;
+        void Rehash(size_t capacity);
+    };
+
+} // server
+
+#endif //EPOLLCHAT_MEMBERSET_H
@@ -0,0 +1,198 @@
+#include "Metrics.h"
+
+#include <sstream>
+#include <iomanip>
+
+namespace src::classes::server {
+
+    //region LatencyHistogram
+    int LatencyHistogram::BucketFor(unsigned long long ns) {
+        if (ns < 16)
+            return (int) ns;
+        int exponent = 63 - __builtin_clzll(ns);
+        if (exponent > MAX_EXPONENT)
+            return BUCKET_COUNT - 1;
+        int sub = (int) (ns >> (exponent - SUB_BUCKET_BITS)) & ((1 << SUB_BUCKET_BITS) - 1);
+        return 16 + (exponent - 4) * (1 << SUB_BUCKET_BITS) + sub;
+    }
+
+    unsigned long long LatencyHistogram::UpperBound(int bucket) {
+        if (bucket < 16)
+            return bucket;
+        int exponent = (bucket - 16) / (1 << SUB_BUCKET_BITS) + 4;
+        int sub = (bucket - 16) % (1 << SUB_BUCKET_BITS);
+        return (((unsigned long long) (1 << SUB_BUCKET_BITS) + sub + 1) << (exponent - SUB_BUCKET_BITS)) - 1;
+    }
+
+    unsigned long long LatencyHistogram::Percentile(const vector<unsigned long long> &buckets, double p) {
+        unsigned long long total = 0;
+        for (auto cur: buckets)
+            total += cur;
+        if (total == 0)
+            return 0;
+        auto rank = (unsigned long long) (p * (double) total);
+        if (rank >= total)
+            rank = total - 1;
+        unsigned long long seen = 0;
+        for (int i = 0; i < (int) buckets.size(); i++) {
+            seen += buckets[i];
+            if (seen > rank)
+                return UpperBound(i);
+        }
+        return UpperBound((int) buckets.size() - 1);
+    }
+
+    void LatencyHistogram::Record(unsigned long long ns) {
+        m_Buckets[BucketFor(ns)].fetch_add(1, memory_order_relaxed);
+    }
+
+    void LatencyHistogram::MergeInto(vector<unsigned long long> &buckets) const {
+        buckets.resize(BUCKET_COUNT);
+        for (int i = 0; i < BUCKET_COUNT; i++)
+            buckets[i] += m_Buckets[i].load(memory_order_relaxed);
+    }
+    //endregion
+
+    atomic<Hash> Metrics::count = 1;
+
+    Metrics::Metrics() {
+        ID = count++;
+        m_Shards = make_unique<mutex>();
+    }
+
+    Metrics::Shard *Metrics::LocalShard() {
+        // One-slot cache per thread; only a thread switching between Metrics instances pays for the lock.
+        thread_local Hash cachedOwner = 0;
+        thread_local Shard *cachedShard = nullptr;
+        if (cachedOwner == ID)
+            return cachedShard;
+
+        lock_guard<mutex> guard(*m_Shards);
+        Shard *found = nullptr;
+        for (auto &cur: Shards)
+            if (cur->Owner == this_thread::get_id())
+                found = cur.get();
+        if (!found) {
+            Shards.push_back(make_unique<Shard>());
+            found = Shards.back().get();
+            found->Owner = this_thread::get_id();
+        }
+        cachedOwner = ID;
+        cachedShard = found;
+        return found;
+    }
+
+    void Metrics::RecordRequest(ServerActionType type, ClientActionType outcome, unsigned long long ns) {
+        int t = static_cast<int>(type);
+        if (t < 0 || t >= MAX_ACTION_TYPES)
+            return;
+        int o = outcome == ClientActionType::InformSuccess ? 0 : 1;
+        Shard *shard = LocalShard();
+        shard->Counts[t][o].fetch_add(1, memory_order_relaxed);
+        shard->SumNs[t][o].fetch_add(ns, memory_order_relaxed);
+        shard->Latency[t][o].Record(ns);
+    }
+
+    void Metrics::SetGauge(Gauge g, long long value) {
+        m_Gauges[static_cast<int>(g)].store(value, memory_order_relaxed);
+    }
+
+    long long Metrics::GetGauge(Gauge g) const {
+        return m_Gauges[static_cast<int>(g)].load(memory_order_relaxed);
+    }
+
+    Metrics::Aggregate Metrics::Collect(int type, int outcome) const {
+        Aggregate res{};
+        lock_guard<mutex> guard(*m_Shards);
+        for (auto &cur: Shards) {
+            res.Count += cur->Counts[type][outcome].load(memory_order_relaxed);
+            res.SumNs += cur->SumNs[type][outcome].load(memory_order_relaxed);
+            cur->Latency[type][outcome].MergeInto(res.Buckets);
+        }
+        return res;
+    }
+
+    const char *Metrics::ActionName(ServerActionType type) {
+        switch (type) {
+            case ServerActionType::NONE: return "NONE";
+            case ServerActionType::LoginAccount: return "LoginAccount";
+            case ServerActionType::LogoutAccount: return "LogoutAccount";
+            case ServerActionType::RegisterAccount: return "RegisterAccount";
+            case ServerActionType::CreateRoom: return "CreateRoom";
+            case ServerActionType::AddMember: return "AddMember";
+            case ServerActionType::RemoveMember: return "RemoveMember";
+            case ServerActionType::SendMessage: return "SendMessage";
+            case ServerActionType::TerminateConnection: return "TerminateConnection";
+            case ServerActionType::FetchMetrics: return "FetchMetrics";
+            case ServerActionType::FetchHistory: return "FetchHistory";
+            case ServerActionType::Resync: return "Resync";
+            case ServerActionType::QueryPresence: return "QueryPresence";
+            case ServerActionType::AddMembers: return "AddMembers";
+            case ServerActionType::RemoveMembers: return "RemoveMembers";
+            case ServerActionType::SendMessages: return "SendMessages";
+            case ServerActionType::Subscribe: return "Subscribe";
+            case ServerActionType::Unsubscribe: return "Unsubscribe";
+            case ServerActionType::AckRead: return "AckRead";
+        }
+        return "Unknown";
+    }
+
+    static const char *GaugeName(Gauge g) {
+        switch (g) {
+            case Gauge::Connections: return "connections";
+            case Gauge::Accounts: return "accounts";
+            case Gauge::Rooms: return "rooms";
+            case Gauge::Messages: return "messages";
+            case Gauge::RequestQueue: return "request_queue_depth";
+            case Gauge::ResponseQueue: return "response_queue_depth";
+            case Gauge::FanoutQueue: return "fanout_pending_tasks";
+            case Gauge::RoomShardQueue: return "room_shard_pending_jobs";
+            case Gauge::KeyVerifyQueue: return "key_verify_pending";
+            case Gauge::OnlineAccounts: return "online_accounts";
+            default: return "unknown";
+        }
+    }
+
+    string Metrics::Scrape() const {
+        static const char *outcomes[2] = {"InformSuccess", "InformFailure"};
+        static const double quantiles[] = {0.5, 0.9, 0.99, 0.999, 1};
+        stringstream ss{};
+
+        for (int g = 0; g < static_cast<int>(Gauge::COUNT); g++)
+            ss << "echat_" << GaugeName(static_cast<Gauge>(g)) << " " << GetGauge(static_cast<Gauge>(g)) << "\n";
+
+        for (int t = 0; t < MAX_ACTION_TYPES; t++) {
+            for (int o = 0; o < 2; o++) {
+                auto agg = Collect(t, o);
+                if (agg.Count == 0)
+                    continue;
+                string labels = string("action=\"") + ActionName(static_cast<ServerActionType>(t)) +
+                                "\",outcome=\"" + outcomes[o] + "\"";
+                ss << "echat_requests_total{" << labels << "} " << agg.Count << "\n";
+                ss << "echat_request_latency_ns_sum{" << labels << "} " << agg.SumNs << "\n";
+                for (double q: quantiles)
+                    ss << "echat_request_latency_ns{" << labels << ",quantile=\"" << q << "\"} "
+                       << LatencyHistogram::Percentile(agg.Buckets, q) << "\n";
+            }
+        }
+        return ss.str();
+    }
+
+    string Metrics::Summary() const {
+        stringstream ss{};
+        for (int g = 0; g < static_cast<int>(Gauge::COUNT); g++)
+            ss << GaugeName(static_cast<Gauge>(g)) << "=" << GetGauge(static_cast<Gauge>(g)) << " ";
+        for (int t = 0; t < MAX_ACTION_TYPES; t++) {
+            for (int o = 0; o < 2; o++) {
+                auto agg = Collect(t, o);
+                if (agg.Count == 0)
+                    continue;
+                ss << ActionName(static_cast<ServerActionType>(t)) << (o ? ":fail" : ":ok")
+                   << "=" << agg.Count
+                   << "/p50=" << LatencyHistogram::Percentile(agg.Buckets, 0.5)
+                   << "/p99=" << LatencyHistogram::Percentile(agg.Buckets, 0.99) << "ns ";
+            }
+        }
+        return ss.str();
+    }
+} // server
@@ -0,0 +1,94 @@
+#ifndef EPOLLCHAT_METRICS_H
+#define EPOLLCHAT_METRICS_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "../general/Constants.h"
+#include "../general/Enums.h"
+
+using namespace std;
+using namespace src::classes::general;
+
+namespace src::classes::server {
+
+    enum class Gauge {
+        Connections = 0,
+        Accounts,
+        Rooms,
+        Messages,
+        RequestQueue,
+        ResponseQueue,
+        FanoutQueue,
+        RoomShardQueue,
+        KeyVerifyQueue,
+        OnlineAccounts,
+        COUNT
+    };
+
+    // Log-linear (HDR-style) latency histogram: exact below 16ns, then 8 sub-buckets per power of two,
+    // which bounds the relative error of any reported percentile to 12.5%. Written by a single thread,
+    // read by the scraper, so all accesses are relaxed atomics.
+    class LatencyHistogram {
+    public:
+        static const int SUB_BUCKET_BITS = 3;
+        static const int MAX_EXPONENT = 40;
+        static const int BUCKET_COUNT = 16 + (MAX_EXPONENT - 3) * (1 << SUB_BUCKET_BITS);
+
+        void Record(unsigned long long ns);
+        void MergeInto(vector<unsigned long long> &buckets) const;
+
+        static int BucketFor(unsigned long long ns);
+        static unsigned long long UpperBound(int bucket);
+        static unsigned long long Percentile(const vector<unsigned long long> &buckets, double p);
+    private:
+        atomic<unsigned long long> m_Buckets[BUCKET_COUNT]{};
+    };
+
+    class Metrics {
+    public:
+        static const int MAX_ACTION_TYPES = 32;
+
+        Metrics();
+
+        // Lock-free on the hot path: every thread records into its own shard.
+        void RecordRequest(ServerActionType type, ClientActionType outcome, unsigned long long ns);
+        void SetGauge(Gauge g, long long value);
+        long long GetGauge(Gauge g) const;
+
+        // Plain-text exposition, one sample per line, for the scrape endpoint.
+        [[nodiscard]] string Scrape() const;
+        // Single line summary, safe to embed in a ClientResponse.
+        [[nodiscard]] string Summary() const;
+
+        static const char *ActionName(ServerActionType type);
+    private:
+        struct Shard {
+            thread::id Owner;
+            atomic<unsigned long long> Counts[MAX_ACTION_TYPES][2]{};
+            atomic<unsigned long long> SumNs[MAX_ACTION_TYPES][2]{};
+            LatencyHistogram Latency[MAX_ACTION_TYPES][2];
+        };
+        struct Aggregate {
+            unsigned long long Count = 0;
+            unsigned long long SumNs = 0;
+            vector<unsigned long long> Buckets;
+        };
+
+        static atomic<Hash> count;
+        Hash ID;
+        atomic<long long> m_Gauges[static_cast<int>(Gauge::COUNT)]{};
+        vector<unique_ptr<Shard>> Shards;
+        unique_ptr<mutex> m_Shards;
+
+        Shard *LocalShard();
+        [[nodiscard]] Aggregate Collect(int type, int outcome) const;
+    };
+
+} // server
+
+#endif //EPOLLCHAT_METRICS_H
@@ -0,0 +1,71 @@
+#include "Presence.h"
+
+
+namespace src::classes::server {
+
+    Presence::Presence() : Chunks(new atomic<atomic<uint64_t> *>[CHUNKS]()), Online(0) {
+    }
+
+    Presence::~Presence() {
+        for (size_t i = 0; i < CHUNKS; i++)
+            delete[] Chunks[i].load();
+    }
+
+    void Presence::SetOnline(const shared_ptr<Account> &account, bool online) {
+        Hash id = account->ID;
+        Hash word = id / 64;
+        if (word >= CHUNKS * CHUNK_WORDS)
+            return;
+        auto *chunk = Chunks[word / CHUNK_WORDS].load(memory_order_acquire);
+        if (!chunk) {
+            if (!online)
+                return;
+            chunk = new atomic<uint64_t>[CHUNK_WORDS]();
+            Chunks[word / CHUNK_WORDS].store(chunk, memory_order_release);
+        }
+
+        uint64_t bit = 1ULL << (id % 64);
+        auto &bits = chunk[word % CHUNK_WORDS];
+        uint64_t before = bits.load(memory_order_relaxed);
+        if (((before & bit) != 0) == online)
+            return;
+        bits.store(online ? before | bit : before & ~bit, memory_order_relaxed);
+        if (online)
+            Online.fetch_add(1, memory_order_relaxed);
+        else
+            Online.fetch_sub(1, memory_order_relaxed);
+
+        Pending.try_emplace(id, account, !online);
+        Timer.Arm(PRESENCE_FLUSH_MS * 1000UL);
+    }
+
+    bool Presence::IsOnline(Hash id) const {
+        return Word(id / 64) >> (id % 64) & 1;
+    }
+
+    uint64_t Presence::Word(Hash word) const {
+        if (word >= CHUNKS * CHUNK_WORDS)
+            return 0;
+        auto *chunk = Chunks[word / CHUNK_WORDS].load(memory_order_acquire);
+        return chunk ? chunk[word % CHUNK_WORDS].load(memory_order_relaxed) : 0;
+    }
+
+    size_t Presence::OnlineCount() const {
+        return Online.load(memory_order_relaxed);
+    }
+
+    int Presence::FlushFD() const {
+        return Timer.FD();
+    }
+
+    vector<pair<shared_ptr<Account>, bool>> Presence::TakeChanges() {
+        Timer.Expire();
+
+        vector<pair<shared_ptr<Account>, bool>> changes;
+        for (auto &[id, pending]: Pending)
+            if (IsOnline(id) != pending.second)
+                changes.emplace_back(std::move(pending.first), !pending.second);
+        Pending.clear();
+        return changes;
+    }
+} // server
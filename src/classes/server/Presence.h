@@ -0,0 +1,64 @@
+#ifndef EPOLLCHAT_PRESENCE_H
+#define EPOLLCHAT_PRESENCE_H
+
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <cstdint>
+
+#include "../general/Constants.h"
+#include "Account.h"
+#include "FlushTimer.h"
+
+using namespace std;
+using namespace src::classes::general;
+
+// How long presence changes are gathered before anyone is told about them, and the most account ids one
+// QueryPresence reply or PresenceUpdate frame lists.
+#define PRESENCE_FLUSH_MS 200
+#define PRESENCE_LIST_LIMIT 1000
+
+namespace src::classes::server {
+
+    // Which accounts have at least one live session, as a bitset over account IDs: bit i of word w is
+    // account w * 64 + i. Words are allocated a chunk at a time and never move, so room shards intersect
+    // their member bitsets with it lock-free while the reactor, its only writer, flips bits.
+    // Changes are also gathered for PRESENCE_FLUSH_MS, the reactor then notifies once for all of them,
+    // so a reconnect storm costs each watcher one frame rather than one per account.
+    class Presence {
+    public:
+        Presence();
+        ~Presence();
+        Presence(const Presence &) = delete;
+        Presence &operator=(const Presence &) = delete;
+
+        // Reactor-only, called when an account gains its first session or loses its last one.
+        void SetOnline(const shared_ptr<Account> &account, bool online);
+        [[nodiscard]] bool IsOnline(Hash id) const;
+        // The 64 accounts from 'word' * 64 on.
+        [[nodiscard]] uint64_t Word(Hash word) const;
+        [[nodiscard]] size_t OnlineCount() const;
+
+        // Readable once the gathering window of the oldest pending change is over, meant to be registered
+        // with the reactor's epoll.
+        [[nodiscard]] int FlushFD() const;
+        // Reactor-only. The accounts whose state differs from the previous call, with their state now;
+        // one that went offline and came back within the window is not a change.
+        vector<pair<shared_ptr<Account>, bool>> TakeChanges();
+    private:
+        static const size_t CHUNK_WORDS = 1024;
+        static const size_t CHUNKS = 4096;
+
+        // Accounts past CHUNKS * CHUNK_WORDS * 64 (about 268M) always read as offline.
+        unique_ptr<atomic<atomic<uint64_t> *>[]> Chunks;
+        atomic<size_t> Online;
+        // Account id -> the account and its state when the window opened.
+        unordered_map<Hash, pair<shared_ptr<Account>, bool>> Pending;
+        FlushTimer Timer;
+    };
+
+} // server
+
+#endif //EPOLLCHAT_PRESENCE_H
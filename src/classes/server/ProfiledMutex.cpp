@@ -0,0 +1,97 @@
+#include "ProfiledMutex.h"
+
+#include <chrono>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+
+namespace src::classes::server {
+    atomic<bool> LockRegistry::Timing = true;
+    mutex LockRegistry::m_Locks = {};
+    map<string, unique_ptr<LockStats>> LockRegistry::Locks = {};
+
+    static inline unsigned long long NowNs() {
+        return (unsigned long long) chrono::duration_cast<chrono::nanoseconds>(
+                chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    LockStats *LockRegistry::For(const string &name) {
+        lock_guard<mutex> guard(m_Locks);
+        auto &stats = Locks[name];
+        if (!stats) {
+            stats = make_unique<LockStats>();
+            stats->Name = name;
+        }
+        return stats.get();
+    }
+
+    string LockRegistry::Scrape() {
+        stringstream ss{};
+        lock_guard<mutex> guard(m_Locks);
+        for (auto &[name, stats]: Locks) {
+            string label = "{lock=\"" + name + "\"}";
+            ss << "echat_lock_acquisitions_total" << label << " " << stats->Acquisitions.load() << "\n"
+               << "echat_lock_contended_total" << label << " " << stats->Contended.load() << "\n"
+               << "echat_lock_wait_ns_sum" << label << " " << stats->WaitNs.load() << "\n"
+               << "echat_lock_wait_ns_max" << label << " " << stats->MaxWaitNs.load() << "\n"
+               << "echat_lock_hold_ns_sum" << label << " " << stats->HoldNs.load() << "\n";
+        }
+        return ss.str();
+    }
+
+    string LockRegistry::Summary(int top) {
+        vector<LockStats *> sorted;
+        {
+            lock_guard<mutex> guard(m_Locks);
+            for (auto &cur: Locks)
+                sorted.push_back(cur.second.get());
+        }
+        sort(sorted.begin(), sorted.end(), [](LockStats *a, LockStats *b) {
+            return a->WaitNs.load() > b->WaitNs.load();
+        });
+
+        stringstream ss{};
+        for (int i = 0; i < top && i < (int) sorted.size(); i++)
+            ss << sorted[i]->Name << ":acq=" << sorted[i]->Acquisitions.load()
+               << "/contended=" << sorted[i]->Contended.load()
+               << "/wait=" << sorted[i]->WaitNs.load()
+               << "/hold=" << sorted[i]->HoldNs.load() << "ns ";
+        return ss.str();
+    }
+
+    ProfiledMutex::ProfiledMutex(const string &name) : m_Stats(LockRegistry::For(name)), m_AcquiredNs(0) {}
+
+    ProfiledMutex::ProfiledMutex(LockStats *stats) : m_Stats(stats), m_AcquiredNs(0) {}
+
+    void ProfiledMutex::lock() {
+        bool timing = LockRegistry::Timing.load(memory_order_relaxed);
+        if (!m_Mutex.try_lock()) {
+            unsigned long long start = timing ? NowNs() : 0;
+            m_Mutex.lock();
+            m_Stats->Contended.fetch_add(1, memory_order_relaxed);
+            if (timing) {
+                unsigned long long waited = NowNs() - start;
+                m_Stats->WaitNs.fetch_add(waited, memory_order_relaxed);
+                unsigned long long prev = m_Stats->MaxWaitNs.load(memory_order_relaxed);
+                while (waited > prev && !m_Stats->MaxWaitNs.compare_exchange_weak(prev, waited,
+                                                                                  memory_order_relaxed));
+            }
+        }
+        m_Stats->Acquisitions.fetch_add(1, memory_order_relaxed);
+        m_AcquiredNs = timing ? NowNs() : 0;
+    }
+
+    bool ProfiledMutex::try_lock() {
+        if (!m_Mutex.try_lock())
+            return false;
+        m_Stats->Acquisitions.fetch_add(1, memory_order_relaxed);
+        m_AcquiredNs = LockRegistry::Timing.load(memory_order_relaxed) ? NowNs() : 0;
+        return true;
+    }
+
+    void ProfiledMutex::unlock() {
+        if (m_AcquiredNs)
+            m_Stats->HoldNs.fetch_add(NowNs() - m_AcquiredNs, memory_order_relaxed);
+        m_Mutex.unlock();
+    }
+} // server
@@ -0,0 +1,59 @@
+#ifndef EPOLLCHAT_PROFILEDMUTEX_H
+#define EPOLLCHAT_PROFILEDMUTEX_H
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+
+using namespace std;
+
+namespace src::classes::server {
+
+    // Counters shared by every lock constructed under the same name, e.g. all "ChatRoom::m_Members".
+    struct LockStats {
+        string Name;
+        atomic<unsigned long long> Acquisitions{0};
+        atomic<unsigned long long> Contended{0};
+        atomic<unsigned long long> WaitNs{0};
+        atomic<unsigned long long> MaxWaitNs{0};
+        atomic<unsigned long long> HoldNs{0};
+    };
+
+    class LockRegistry {
+    public:
+        // When false only acquisitions and contentions are counted and no clock is read.
+        static atomic<bool> Timing;
+
+        static LockStats *For(const string &name);
+        // Plain-text exposition, appended to the metrics scrape.
+        static string Scrape();
+        // Single line of the locks with the most wait time, safe to embed in a ClientResponse.
+        static string Summary(int top = 5);
+    private:
+        static mutex m_Locks;
+        static map<string, unique_ptr<LockStats>> Locks;
+    };
+
+    // Drop-in replacement for std::mutex (satisfies Lockable) that records per-name contention.
+    class ProfiledMutex {
+    public:
+        explicit ProfiledMutex(const string &name);
+        // For locks created at a high rate, the stats are looked up once by the owner instead of per lock.
+        explicit ProfiledMutex(LockStats *stats);
+        ProfiledMutex(const ProfiledMutex &) = delete;
+        ProfiledMutex &operator=(const ProfiledMutex &) = delete;
+
+        void lock();
+        bool try_lock();
+        void unlock();
+    private:
+        mutex m_Mutex;
+        LockStats *m_Stats;
+        unsigned long long m_AcquiredNs;
+    };
+
+} // server
+
+#endif //EPOLLCHAT_PROFILEDMUTEX_H
@@ -0,0 +1,85 @@
+#include "RoomShards.h"
+#include "Trace.h"
+
+namespace src::classes::server {
+
+    RoomShards::RoomShards(unsigned shards) : Stopping(false), InFlight(0) {
+        if (shards == 0)
+            shards = 1;
+        for (unsigned i = 0; i < shards; i++)
+            Pool.push_back(make_unique<Shard>());
+        for (auto &shard: Pool)
+            shard->Thread = thread([this, s = shard.get()]() { Run(*s); });
+    }
+
+    RoomShards::~RoomShards() {
+        Stopping.store(true);
+        for (auto &shard: Pool) {
+            {
+                lock_guard<mutex> guard(shard->m_Mailbox);
+            }
+            shard->Wake.notify_all();
+        }
+        for (auto &shard: Pool)
+            if (shard->Thread.joinable())
+                shard->Thread.join();
+    }
+
+    unsigned RoomShards::Shards() const {
+        return (unsigned) Pool.size();
+    }
+
+    unsigned RoomShards::ShardFor(Hash roomID) const {
+        // Room IDs are sequential, mix them so neighbouring rooms don't stripe the shards in lockstep.
+        return (unsigned) (((roomID * 11400714819323198485ULL) >> 32) % Pool.size());
+    }
+
+    void RoomShards::Post(Hash roomID, Job job) {
+        InFlight.fetch_add(1);
+        auto &target = *Pool[ShardFor(roomID)];
+        {
+            lock_guard<mutex> guard(target.m_Mailbox);
+            target.Mailbox.push_back(std::move(job));
+        }
+        target.Wake.notify_one();
+    }
+
+    long long RoomShards::Pending() const {
+        return InFlight.load();
+    }
+
+    void RoomShards::Drain() {
+        unique_lock<mutex> lock(m_Idle);
+        Idle.wait(lock, [this]() { return InFlight.load() == 0; });
+    }
+
+    void RoomShards::Run(Shard &shard) {
+        Arena scratch;
+        deque<Job> batch;
+        while (true) {
+            {
+                unique_lock<mutex> lock(shard.m_Mailbox);
+                shard.Wake.wait(lock, [&]() { return Stopping.load() || !shard.Mailbox.empty(); });
+                if (shard.Mailbox.empty())
+                    return;
+                // Take the whole mailbox at once, the reactor only contends with us once per batch.
+                batch.swap(shard.Mailbox);
+            }
+
+            {
+                TRACE_SPAN_ARG("RoomShards::Run", batch.size());
+                for (auto &job: batch) {
+                    job(scratch);
+                    scratch.Reset();
+                }
+            }
+
+            long long done = (long long) batch.size();
+            batch.clear();
+            if (InFlight.fetch_sub(done) == done) {
+                lock_guard<mutex> guard(m_Idle);
+                Idle.notify_all();
+            }
+        }
+    }
+} // server
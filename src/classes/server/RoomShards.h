@@ -0,0 +1,67 @@
+#ifndef EPOLLCHAT_ROOMSHARDS_H
+#define EPOLLCHAT_ROOMSHARDS_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+#include "../general/Constants.h"
+#include "../general/Arena.h"
+
+using namespace std;
+using namespace src::classes::general;
+
+// Default number of room shards for servers started from the terminal, 0 keeps every room on the
+// reactor thread. Set through the ECHAT_ROOM_SHARDS cmake cache variable.
+#ifndef ROOM_SHARDS
+#define ROOM_SHARDS 0
+#endif
+
+namespace src::classes::server {
+
+    // Actor-style owners for chat rooms. Every room belongs to exactly one shard (picked by hashing
+    // its ID) and everything that reads or changes its members and messages is posted to that shard's
+    // mailbox, so a room is only ever touched by one thread and needs no locks. Jobs run in the order
+    // they were posted, which keeps per-room ordering strict while different rooms run in parallel.
+    class RoomShards {
+    public:
+        // A job gets its shard's scratch arena, which is reset after it returns.
+        typedef function<void(Arena &)> Job;
+
+        explicit RoomShards(unsigned shards = thread::hardware_concurrency());
+        ~RoomShards();
+        RoomShards(const RoomShards &) = delete;
+        RoomShards &operator=(const RoomShards &) = delete;
+
+        [[nodiscard]] unsigned Shards() const;
+        [[nodiscard]] unsigned ShardFor(Hash roomID) const;
+        void Post(Hash roomID, Job job);
+        // Number of queued and running jobs over all shards.
+        [[nodiscard]] long long Pending() const;
+        // Blocks until every posted job has run.
+        void Drain();
+    private:
+        struct Shard {
+            mutex m_Mailbox;
+            condition_variable Wake;
+            deque<Job> Mailbox;
+            thread Thread;
+        };
+
+        vector<unique_ptr<Shard>> Pool;
+        atomic<bool> Stopping;
+        atomic<long long> InFlight;
+        mutex m_Idle;
+        condition_variable Idle;
+
+        void Run(Shard &shard);
+    };
+
+} // server
+
+#endif //EPOLLCHAT_ROOMSHARDS_H
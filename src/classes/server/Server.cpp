@@ -1,12 +1,14 @@
 #include "Server.h"
+#include <algorithm>
 #include <utility>
 #include <functional>
+#include <chrono>
 
 using namespace std;
 
 namespace src::classes::server {
     Server::Server() {
-        Setup();
+        Setup(ROOM_SHARDS);
     }
 
     Server::~Server() {
@@ -15,16 +17,26 @@ namespace src::classes::server {
             ServerThread->join();
         }
         delete ServerThread;
+        delete MetricsThread;
+        // Shard, fan-out and verifier jobs reference the containers below and the coalescer, let them
+        // finish first.
+        Shards.reset();
+        Fanout.reset();
+        Verifier.reset();
 
         // Clean up all shared_ptr containers
         Connections.clear();
         Accounts.clear();
         Rooms.clear();
         Messages.clear();
+
+        // Frees the port for the next server in this process.
+        close(FileDescriptor);
+        close(EpollFD);
     }
 
-    Server::Server(string name) : ServerName(move(name)) {
-        Setup();
+    Server::Server(string name, unsigned roomShards) : ServerName(move(name)) {
+        Setup(roomShards);
     }
 
     void Server::Start() {
@@ -44,16 +56,29 @@ namespace src::classes::server {
                     break;
                 }
 
-                int n = epoll_wait(EpollFD, events.data(), MAX_EVENTS, -1);
+                int n;
+                {
+                    TRACE_SPAN("epoll_wait");
+                    n = epoll_wait(EpollFD, events.data(), MAX_EVENTS, -1);
+                }
                 if (errno == EINTR)
                     continue;
                 if (n == -1) {
                     perror("epoll_wait");
                     exit(EXIT_FAILURE);
                 }
+                TRACE_SPAN_ARG("EventLoop", n);
 
                 for (int i = 0; i < n; ++i) {
-                    if (events[i].data.fd == FileDescriptor) {
+                    if (events[i].data.fd == VerifierFD) {
+                        Verifier->RunCompletions();
+                    } else if (events[i].data.fd == PresenceFD) {
+                        FlushPresence();
+                    } else if (events[i].data.fd == BumpsFD) {
+                        FlushUnread();
+                    } else if (events[i].data.fd == CoalesceFD) {
+                        Coalescing->Flush();
+                    } else if (events[i].data.fd == FileDescriptor) {
                         sockaddr_storage addr{};
                         socklen_t addr_len = sizeof(addr);
                         int new_fd = accept(FileDescriptor, (sockaddr *) &addr, &addr_len);
@@ -77,56 +102,111 @@ namespace src::classes::server {
 
                         EpollEvent event{};
                         event.data.fd = new_fd;
-                        event.events = EPOLLIN | EPOLLET;
+                        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
                         if (epoll_ctl(EpollFD, EPOLL_CTL_ADD, new_fd, &event) == -1) {
                             perror("epoll_ctl");
                             close(new_fd);
                             continue;
                         }
 
-                        auto client = std::make_shared<Client>(new_fd, addr, true);
+                        auto client = MakePooled<Client>(new_fd, addr, true);
+                        client->Coalescer = Coalescing.get();
                         PushConnection(std::move(client));
                     } else {
                         auto client = GetClientByFd(events[i].data.fd);
                         if (!client) continue;
 
-                        ssize_t bytes_read = client->Read();
-                        if (bytes_read <= 0) {
-                            if (bytes_read == 0) {
-                                std::cerr << "Received zero bytes, waiting for explicit termination request." << std::endl;
-                            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
-                                perror("Error in recv()");
-                                close(client->FileDescriptor);
-                                RemoveConnection(client->FileDescriptor);
-                            }
+                        if (events[i].events & EPOLLOUT)
+                            client->Write();
+                        if (!(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP)))
                             continue;
-                        } else {
-                            std::string buff = std::string(client->ReadBuffer.begin(), client->ReadBuffer.end());
-                            auto curReq = std::make_shared<ServerRequest>(ServerRequest::Deserialize(buff));
-                            auto requesterID = client->ID;
-                            PushRequest(requesterID, curReq);
+
+                        ssize_t bytes_read;
+                        while ((bytes_read = client->Read()) > 0) {
+                            TRACE_SPAN("Deserialize");
+                            string_view pending = client->PendingInput();
+                            size_t consumed = 0, length;
+                            if (client->SkippingFrame) {
+                                // The frame ends at its DATA_END, which its data cannot hold.
+                                if ((length = RequestParser::FrameLength(pending)) > 0) {
+                                    consumed = length;
+                                    client->SkippingFrame = false;
+                                } else {
+                                    size_t end = pending.find(DATA_END);
+                                    consumed = end == string_view::npos || client->InputFull() ? pending.size() : end;
+                                }
+                            }
+                            while (!client->SkippingFrame &&
+                                   (length = RequestParser::FrameLength(pending.substr(consumed))) > 0) {
+                                RequestView view{};
+                                if (RequestParser::ParseFrame(pending.substr(consumed, length), view)) {
+                                    auto curReq = MakePooled<ServerRequest>(view.Type, view.TargetFD);
+                                    curReq->Data = view.Data;
+                                    PushRequest(client->ID, curReq);
+                                } else
+                                    std::cerr << "Dropped a malformed frame from connection #" << client->ID << std::endl;
+                                consumed += length;
+                            }
+                            if (consumed == 0 && client->InputFull()) {
+                                // Answered in turn with the requests before it, the rest is skipped as it comes.
+                                auto oversized = MakePooled<ServerRequest>(ServerActionType::NONE,
+                                                                          client->FileDescriptor);
+                                oversized->Oversized = true;
+                                PushRequest(client->ID, oversized);
+                                client->SkippingFrame = true;
+                                consumed = pending.size();
+                            }
+                            client->ConsumeInput(consumed);
+                        }
+                        if (bytes_read == 0) {
+                            // The peer is gone, e.g. it crashed or was killed before terminating: its
+                            // sessions end now, so presence is updated and its events go to the mailbox.
+                            client->Close();
+                            RemoveConnection(client->FileDescriptor);
+                        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                            perror("Error in recv()");
+                            client->Close();
+                            RemoveConnection(client->FileDescriptor);
                         }
                     }
                 }
                 EnactRespond();
+                UpdateGauges();
             }
         });
         ServerThread->detach();
+
+        if (MetricsFD != -1)
+            MetricsThread = new std::thread([this]() -> void { ServeMetrics(); });
     }
 
-    void Server::Setup() {
+    void Server::Setup(unsigned roomShards) {
         FileDescriptor = -1;
         sharedStatus = make_shared<atomic<bool>>(false);
         Status = sharedStatus;
         ServerThread = nullptr;
+        MetricsThread = nullptr;
+        MetricsFD = -1;
+        Stats = make_shared<Metrics>();
+        Fanout = make_unique<FanoutPool>();
+        if (roomShards > 0)
+            Shards = make_unique<RoomShards>(roomShards);
+        Verifier = make_unique<KeyVerifier>();
+        VerifierFD = Verifier->CompletionFD();
+        Online = make_unique<Presence>();
+        PresenceFD = Online->FlushFD();
+        CoalesceFD = -1;
+        Bumps = make_unique<UnreadBumps>();
+        BumpsFD = Bumps->FlushFD();
+        KeyCost = KEY_HASH_COST;
         msgCount = 0;
-        m_Connections = make_shared<mutex>();
-        m_Accounts = make_shared<mutex>();
-        m_Rooms = make_shared<mutex>();
-        m_Log = make_shared<mutex>();
-        m_Messages = make_shared<mutex>();
-        m_Responses = make_shared<mutex>();
-        m_Requests = make_shared<mutex>();
+        m_Connections = make_shared<ProfiledMutex>("Server::m_Connections");
+        m_Accounts = make_shared<ProfiledMutex>("Server::m_Accounts");
+        m_Rooms = make_shared<ProfiledMutex>("Server::m_Rooms");
+        m_Log = make_shared<ProfiledMutex>("Server::m_Log");
+        m_Messages = make_shared<ProfiledMutex>("Server::m_Messages");
+        m_Responses = make_shared<ProfiledMutex>("Server::m_Responses");
+        m_Requests = make_shared<ProfiledMutex>("Server::m_Requests");
 
         EpollFD = epoll_create1(0);
         if (EpollFD == -1) {
@@ -173,7 +253,7 @@ namespace src::classes::server {
             exit(EXIT_FAILURE);
         }
 
-        if (listen(FileDescriptor, 10) == -1) {
+        if (listen(FileDescriptor, SOMAXCONN) == -1) {
             cerr << "Listen failure, cause:\n\t" << strerror(errno) << endl;
             exit(EXIT_FAILURE);
         }
@@ -189,15 +269,137 @@ namespace src::classes::server {
             exit(EXIT_FAILURE);
         }
 
+        Watch(FileDescriptor);
+        Watch(VerifierFD);
+        Watch(PresenceFD);
+        Watch(BumpsFD);
+        if (COALESCE_WINDOW_US || COALESCE_MAX_EVENTS)
+            EnableCoalescing(COALESCE_WINDOW_US, COALESCE_MAX_EVENTS);
+
+        SetupMetricsEndpoint();
+    }
+
+    void Server::EnableCoalescing(unsigned windowMicros, unsigned maxEvents) {
+        if (Coalescing)
+            return;
+        Coalescing = make_unique<EventCoalescer>(windowMicros, maxEvents);
+        CoalesceFD = Coalescing->FlushFD();
+        Watch(CoalesceFD);
+    }
+
+    void Server::Watch(int fd) {
         EpollEvent event{};
-        event.data.fd = FileDescriptor;
+        event.data.fd = fd;
         event.events = EPOLLIN;
-        if (epoll_ctl(EpollFD, EPOLL_CTL_ADD, FileDescriptor, &event) == -1) {
+        if (epoll_ctl(EpollFD, EPOLL_CTL_ADD, fd, &event) == -1) {
             cerr << "Error in epoll_ctl:\n\t" << strerror(errno) << endl;
             exit(EXIT_FAILURE);
         }
     }
 
+    void Server::SetupMetricsEndpoint() {
+        // The scrape endpoint is bound to loopback only; failing to bind it is not fatal for the chat server.
+        MetricsFD = socket(AF_INET, SOCK_STREAM, 0);
+        if (MetricsFD == -1) {
+            perror("metrics socket()");
+            return;
+        }
+        int yes = 1;
+        setsockopt(MetricsFD, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(METRICS_PORT);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(MetricsFD, (sockaddr *) &addr, sizeof addr) == -1 || listen(MetricsFD, 4) == -1) {
+            cerr << "Metrics endpoint disabled, cause:\n\t" << strerror(errno) << endl;
+            close(MetricsFD);
+            MetricsFD = -1;
+        }
+    }
+
+    void Server::ServeMetrics() {
+        while (true) {
+            int fd = accept(MetricsFD, nullptr, nullptr);
+            if (fd == -1) {
+                if (errno == EINTR)
+                    continue;
+                return; // Listener was shut down by Stop()
+            }
+
+            timeval tv{1, 0};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+            char buf[BUFFER_SIZE] = {};
+            recv(fd, buf, sizeof buf - 1, 0); // Only the request path matters, headers are ignored
+
+            string body, contentType;
+            if (strncmp(buf, "GET /trace", 10) == 0) {
+                stringstream trace{};
+                Tracer::DumpChromeTrace(trace);
+                body = trace.str();
+                contentType = "application/json";
+            } else {
+                UpdateGauges();
+                body = Stats->Scrape() + LockRegistry::Scrape();
+                contentType = "text/plain; version=0.0.4";
+            }
+            stringstream ss{};
+            ss << "HTTP/1.0 200 OK\r\n"
+               << "Content-Type: " << contentType << "\r\n"
+               << "Content-Length: " << body.size() << "\r\n\r\n"
+               << body;
+            string resp = ss.str();
+            send(fd, resp.c_str(), resp.size(), MSG_NOSIGNAL);
+            close(fd);
+        }
+    }
+
+    void Server::UpdateGauges() {
+        {
+            lock_guard<ProfiledMutex> guard(*m_Connections);
+            Stats->SetGauge(Gauge::Connections, (long long) Connections.size());
+        }
+        {
+            lock_guard<ProfiledMutex> guard(*m_Accounts);
+            Stats->SetGauge(Gauge::Accounts, (long long) Accounts.size());
+        }
+        {
+            lock_guard<ProfiledMutex> guard(*m_Rooms);
+            Stats->SetGauge(Gauge::Rooms, (long long) Rooms.size());
+        }
+        {
+            lock_guard<ProfiledMutex> guard(*m_Messages);
+            Stats->SetGauge(Gauge::Messages, (long long) Messages.size());
+        }
+        {
+            lock_guard<ProfiledMutex> guard(*m_Requests);
+            Stats->SetGauge(Gauge::RequestQueue, (long long) Requests.size());
+        }
+        {
+            lock_guard<ProfiledMutex> guard(*m_Responses);
+            Stats->SetGauge(Gauge::ResponseQueue, (long long) Responses.size());
+        }
+        Stats->SetGauge(Gauge::OnlineAccounts, (long long) Online->OnlineCount());
+        Stats->SetGauge(Gauge::FanoutQueue, Fanout->Pending());
+        if (Shards)
+            Stats->SetGauge(Gauge::RoomShardQueue, Shards->Pending());
+        Stats->SetGauge(Gauge::KeyVerifyQueue, Verifier->Pending());
+    }
+
+    bool Server::IsLoopback(const sockaddr_storage &addr) {
+        if (addr.ss_family == AF_INET) {
+            auto *in = (const sockaddr_in *) &addr;
+            return (ntohl(in->sin_addr.s_addr) >> 24) == 127;
+        }
+        if (addr.ss_family == AF_INET6) {
+            auto *in6 = (const sockaddr_in6 *) &addr;
+            if (IN6_IS_ADDR_LOOPBACK(&in6->sin6_addr))
+                return true;
+            return IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr) && in6->sin6_addr.s6_addr[12] == 127;
+        }
+        return false;
+    }
+
     void Server::Stop() {
         sharedStatus = Status.lock();
         if (sharedStatus) {
@@ -206,667 +408,1610 @@ namespace src::classes::server {
         if (ServerThread && ServerThread->joinable()) {
             ServerThread->join();
         }
+        if (MetricsFD != -1) {
+            shutdown(MetricsFD, SHUT_RDWR);
+            close(MetricsFD);
+            MetricsFD = -1;
+        }
+        if (MetricsThread && MetricsThread->joinable()) {
+            MetricsThread->join();
+        }
     }
 
 
 
     void Server::EnactRespond() {
-        function<bool()> isRequestsEmpty = [this]() -> bool {
+        auto isRequestsEmpty = [this]() -> bool {
             {
-                lock_guard<mutex> guard(*m_Requests);
+                lock_guard<ProfiledMutex> guard(*m_Requests);
                 return Requests.empty();
             }
         };
         while (!isRequestsEmpty()) {
-            //region Setup
-            bool closeFlag = false;
             auto current = PopRequest();
-            Hash ConnectionID = get<0>(current);
-            shared_ptr<Account> requester = nullptr;
-            bool isGuest = false;
-            shared_ptr<Client> connection = nullptr;
-            function<unsigned long()> ConnectionsSize = [this]() -> unsigned long {
-                lock_guard<mutex> guard(*m_Connections);
-                return Connections.size();
-            };
-            function<unsigned long()> AccountSize = [this]() -> unsigned long {
-                lock_guard<mutex> guard(*m_Accounts);
-                return Accounts.size();
-            };
+            Enact(get<0>(current), get<1>(current));
+        }
+        RequestArena.Reset();
+    }
 
-            {
-                bool f_break = false;
-                for (unsigned long i = 0; i < ConnectionsSize() && !f_break; i++) {
-                    if ((connection = GetConnection(i))) {
-                        {
-                            lock_guard<mutex> guard(*m_Connections);
-                            if (connection->ID == get<0>(current))
-                                f_break = true;
-                            isGuest = connection->IsGuest;
-                        }
-                    }
-                }
-            }
+    void Server::Enact(Hash ConnectionID, const IntrusivePtr<ServerRequest> &request) {
+        if (request == nullptr)
+            return;
+        // A connection's requests are enacted in order, the ones behind a pending login or registration wait for it.
+        if (auto parked = Parked.find(ConnectionID); parked != Parked.end()) {
+            parked->second.push_back(request);
+            return;
+        }
 
-            if (!isGuest)
-                requester = connection->Owner;
+        //region Setup
+        bool closeFlag = false;
+        auto started = chrono::steady_clock::now();
+        shared_ptr<Account> requester = nullptr;
+        bool isGuest = false;
+        IntrusivePtr<Client> connection = nullptr;
+        auto ConnectionsSize = [this]() -> unsigned long {
+            lock_guard<ProfiledMutex> guard(*m_Connections);
+            return Connections.size();
+        };
 
-            shared_ptr<ServerRequest> request = get<1>(current);
-            //endregion
+        for (unsigned long i = 0; i < ConnectionsSize(); i++) {
+            auto candidate = GetConnection(i);
+            if (candidate && candidate->ID == ConnectionID) {
+                connection = std::move(candidate);
+                break;
+            }
+        }
+        // The connection went away after the request was queued, e.g. on a recv error in the same loop.
+        // Nothing may be enacted for it, and no other session may be mistaken for it.
+        if (!connection)
+            return;
 
-            if (request == nullptr)
-                continue;
+        // The session lives on the connection. Login and logout are enacted here on the reactor, the only
+        // writer of IsGuest and Owner, so authorizing a request is a plain read of both.
+        isGuest = connection->IsGuest;
+        if (!isGuest)
+            requester = connection->Owner;
+        //endregion
+
+        TRACE_SPAN_ARG("EnactRespond", static_cast<unsigned long long>(request->Type));
+
+        //region Enact/Respond:
+        ArenaWriter ss_response(RequestArena);
+        ArenaWriter ss_log(RequestArena);
+        ClientActionType responseType = general::ClientActionType::NONE;
+        // Runs the room-side half of a request here, or posts it to the room's shard which then
+        // answers the client itself and leaves nothing for Respond.
+        auto enactOnRoom = [&](const shared_ptr<ChatRoom> &room, auto enact) -> ClientActionType {
+            if (!Shards)
+                return enact(RequestArena, ss_response, ss_log);
+            Shards->Post(room->ID, [this, enact, connection, request, started](Arena &scratch) {
+                ArenaWriter response(scratch);
+                ArenaWriter log(scratch);
+                ClientActionType outcome = enact(scratch, response, log);
+                Conclude(connection, request->Type, outcome, started, response.View(), log.View(), scratch);
+            });
+            return general::ClientActionType::NONE;
+        };
+        //region Enact
+        switch (request->Type) {
+            case ServerActionType::NONE: {
+                if (request->Oversized) {
+                    ss_response << "'Request exceeds the frame size limit of "
+                                << IO_BUFFER_SIZE
+                                << " bytes. Aborted'";
+                    ss_log << "Client (" << connection->ID
+                           << ") has sent a frame over the size limit. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
+                cerr << "Server has attempted to enact a NULL request";
+                return;
+            }
+            case ServerActionType::LoginAccount: {
+                if (!isGuest) { //Check if already logged in
+                    ss_response << "'Nothing to do, you are already logged in. To switch accounts, "
+                                   "have to logout first.'";
+                    ss_log << "User ("
+                           << requester->DisplayName
+                           << "#"
+                           << requester->ID
+                           << ") has requested to re-login. Request denied; Aborted.";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
 
-            //region Enact/Respond:
-            stringstream ss_response{};
-            stringstream ss_log{};
-            stringstream ss_data(request->Data);
-            ClientActionType responseType;
-            function<bool(shared_ptr<Account>, Hash, string)> verifyIdentity = [this](
-                    const shared_ptr<Account> &accIn,
-                    Hash _id, const string &_key) -> bool {
+                //format: '{id} [key]'
+                //region Unpack data
+                CredentialsPayload payload{};
+                if (!RequestParser::Parse(request->Data, payload)) {
+                    ss_response << "'Malformed request. Aborted'";
+                    ss_log << "Client (" << connection->ID
+                           << ") has sent a malformed login request. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
+                Hash id = payload.ID;
+                string_view key = payload.Key;
+                //endregion
+
+                shared_ptr<Account> targetAccount = nullptr;
                 {
-                    lock_guard<mutex> guard(*m_Accounts);
-                    return accIn->ID == _id && accIn->Key == _key;
+                    long long accInd;
+                    if ((accInd = FindAccount(id)) != -1)
+                        targetAccount = GetAccount(accInd);
                 }
-            };
-            //region Enact
-            switch (request->Type) {
-                case ServerActionType::NONE: {
-                    cerr << "Server has attempted to enact a NULL request";
-                    continue;
+                if (targetAccount == nullptr) { //Account was not found
+                    ss_response << "'Login failed, provided credentials were found to be invalid'";
+                    ss_log << "Guest has requested to login into an account with id (#"
+                           << id
+                           << ") that does not exist. Request Denied; Aborted.";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
                 }
-                case ServerActionType::LoginAccount: {
-                    if (!isGuest) { //Check if already logged in
-                        ss_response << "'Nothing to do, you are already logged in. To switch accounts, "
-                                       "have to logout first.'";
-                        ss_log << "User ("
-                               << requester->DisplayName
-                               << "#"
-                               << requester->ID
-                               << ") has requested to re-login. Request denied; Aborted.";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
-                    }
 
-                    //format: '{id} [key]'
-                    //region Unpack data
-                    Hash id;
-                    string key;
-                    ss_data >> id;
-                    getline(ss_data, key);
-                    key=key.substr(1); //Remove space in beginning
-                    key=key.substr(0,key.size()-1); //Remove space in end
-                    //endregion
-
-                    shared_ptr<Account> targetAccount = nullptr;
-                    bool f_break = false;
-
-                    for (unsigned long i = 0; i < AccountSize() && !f_break; i++)
-                        if (verifyIdentity((targetAccount = GetAccount(i)), id, key))
-                            f_break = true;
-                    if (!f_break) { //Account was not found
-                        ss_response << "'Login failed, provided credentials were found to be invalid'";
-                        ss_log << "Guest has requested to login into an account with id (#"
-                               << id
-                               << ") using key '"
-                               << key
-                               << "'. The provided credentials did not match internal record. Request Denied; Aborted.";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
-                    }
+                //region Verify the key off the reactor, the session is bound once the verdict comes back
+                Parked[connection->ID];
+                Verifier->Submit([this, connection, targetAccount, started, type = request->Type,
+                                  record = targetAccount->Key, key = string(key)]() -> KeyVerifier::Completion {
+                    bool verified = KeyHasher::Verify(record, key);
+                    return [this, connection, targetAccount, started, type, verified]() {
+                        // The connection is gone, so are the requests parked behind this one.
+                        if (GetClientByFd(connection->FileDescriptor) != connection) {
+                            Parked.erase(connection->ID);
+                            return;
+                        }
+                        ArenaWriter response(RequestArena);
+                        ArenaWriter log(RequestArena);
+                        ClientActionType outcome;
+                        if (verified) {
+                            //region Move the connection to the target account:
+                            connection->IsGuest = false;
+                            targetAccount->SetConnection(connection);
+                            //endregion
+
+                            response << targetAccount->DisplayName
+                                     << " | "
+                                     << ServerName
+                                     << " "
+                                     << "'You were successfully logged in'";
+                            log << "User ("
+                                << targetAccount->DisplayName
+                                << "#"
+                                << targetAccount->ID
+                                << ") Has requested to login. Request Approved; User has logged in.";
+                            outcome = general::ClientActionType::InformSuccess;
+                        } else {
+                            response << "'Login failed, provided credentials were found to be invalid'";
+                            log << "Guest has requested to login into an account with id (#"
+                                << targetAccount->ID
+                                << "). The provided key did not match internal record. Request Denied; Aborted.";
+                            outcome = general::ClientActionType::InformFailure;
+                        }
+                        Conclude(connection, type, outcome, started, response.View(), log.View(), RequestArena);
+                        // What arrived while the account was offline follows the reply as one burst, then
+                        // the unread count of every room in one frame.
+                        if (verified) {
+                            if (targetAccount->Attach(connection, RequestArena))
+                                Online->SetOnline(targetAccount, true);
+                            SendUnreadCounts(targetAccount, connection, RequestArena);
+                        }
+                        Resume(connection->ID);
+                    };
+                });
+                //endregion
+                break;
+            }
+            case ServerActionType::LogoutAccount: {
+                if (isGuest) { //Check if guest
+                    ss_response << "'Nothing to do; a guest cannot logout.'";
+                    ss_log << "Guest with connection ID '#"
+                           << connection->ID
+                           << "' has requested to logout. Request Denied; Aborted.";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
 
-                    //region Move the connection to the target account:
-                    targetAccount->Connection = connection;
-                    targetAccount->Connection->IsGuest = false;
-                    connection->SetOwner(make_shared<Account>(*targetAccount));
-                    //endregion
-
-                    ss_response << targetAccount->DisplayName
-                                << " | "
-                                << ServerName
-                                << " "
-                                << "'You were successfully logged in'";
-                    ss_log << "User ("
-                           << targetAccount->DisplayName
+                //region Disconnect client from the account
+                if (requester->Detach(connection))
+                    Online->SetOnline(requester, false);
+                connection->ResetViews();
+                connection->SetOwner(nullptr);
+                connection->IsGuest= true;
+                //endregion
+
+                ss_response << "'You were successfully logged out of the server.'";
+                ss_log << "User ("
+                       << requester->DisplayName
+                       << "#"
+                       << requester->ID
+                       << ") has requested to logout. Request Approved; Client was logged out.";
+                responseType = general::ClientActionType::InformSuccess;
+                break;
+            }
+            case ServerActionType::TerminateConnection: {
+                cout << "\nConnection terminated by client request." << endl;
+                ss_response << "'Connection terminated'";
+                ss_log << "Client (" << connection->ID
+                       << ") requested to terminate the connection. Connection closed.";
+                responseType=general::ClientActionType::InformSuccess;
+                closeFlag= true;
+                goto Respond;
+            }
+            case ServerActionType::RegisterAccount: {
+                if (!isGuest) {
+                    ss_response << "'To register a new account, you must first logout of the current one'";
+                    ss_log << "Logged-in user ("
+                           << requester->DisplayName
                            << "#"
-                           << targetAccount->ID
-                           << ") Has requested to login. Request Approved; User has logged in.";
-                    responseType = general::ClientActionType::InformSuccess;
+                           << requester->ID
+                           << ") has requested to register a new account. Request denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
 
-                    break;
+                //format [name] | [key]
+                //region Unpack data
+                RegisterPayload payload{};
+                if (!RequestParser::Parse(request->Data, payload)) {
+                    ss_response << "'Malformed request. Aborted'";
+                    ss_log << "Client (" << connection->ID
+                           << ") has sent a malformed registration request. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
+                //endregion
+
+                //region Hash the key off the reactor, the account is created once the record comes back
+                Parked[connection->ID];
+                Verifier->Submit([this, connection, started, type = request->Type, cost = KeyCost,
+                                  name = string(payload.Name), key = string(payload.Key)]() -> KeyVerifier::Completion {
+                    KeyRecord record = KeyHasher::Hash(key, cost);
+                    return [this, connection, started, type, name, record]() {
+                        // The connection is gone, so are the requests parked behind this one.
+                        if (GetClientByFd(connection->FileDescriptor) != connection) {
+                            Parked.erase(connection->ID);
+                            return;
+                        }
+                        PushAccount(make_shared<Account>(name, record));
+                        shared_ptr<Account> target = GetAccount(-1);
+                        Hash ID;
+                        {
+                            lock_guard<ProfiledMutex> guard(*m_Accounts);
+                            ID = target->ID;
+                        }
+                        ArenaWriter response(RequestArena);
+                        ArenaWriter log(RequestArena);
+                        response << ID
+                                 << " 'Account was successfully registered'";
+                        log << "Guest had requested to register a new account. Request Approved, "
+                               "New account registered: ("
+                            << target->DisplayName
+                            << "#"
+                            << ID
+                            << ")";
+                        Conclude(connection, type, general::ClientActionType::InformSuccess, started,
+                                 response.View(), log.View(), RequestArena);
+                        Resume(connection->ID);
+                    };
+                });
+                //endregion
+                break;
+            }
+            case ServerActionType::CreateRoom: {
+                if (isGuest) {
+                    ss_response << "'You must be logged in in order to create a new chatroom on the server'";
+                    ss_log << "Guest with ID (#"
+                           << connection->ID
+                           << ") Had requested the creation of a new chatroom. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
                 }
-                case ServerActionType::LogoutAccount: {
-                    if (isGuest) { //Check if guest
-                        ss_response << "'Nothing to do; a guest cannot logout.'";
-                        ss_log << "Guest with connection ID '#"
-                               << connection->ID
-                               << "' has requested to logout. Request Denied; Aborted.";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
-                    }
 
-                    //format {id} [key]
-                    //region Unpack data
-                    Hash id;
-                    string key;
-                    ss_data >> id;
-                    getline(ss_data, key);
-                    key=key.substr(1); //Remove space in beginning
-                    key=key.substr(0,key.size()-1); //Remove space in end
-                    //endregion
-
-                    if (!verifyIdentity(requester, id, key)) {
-                        ss_response << "'Logout failed, provided credentials were found to be invalid'";
-                        ss_log << "Guest has requested to logout from an account with id (#"
-                               << id
-                               << ") using key '"
-                               << key
-                               << "'. The provided credentials did not match internal record. Request Denied; Aborted.";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
-                    }
+                //format [name]
+                //region Unpack data
+                CreateRoomPayload payload{};
+                if (!RequestParser::Parse(request->Data, payload)) {
+                    ss_response << "'Malformed request. Aborted'";
+                    ss_log << "Client (" << connection->ID
+                           << ") has sent a malformed create-room request. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
+                string_view name = payload.Name;
+                //endregion
+
+                shared_ptr<ChatRoom> target;
+                {
+                    auto newRoom = make_shared<ChatRoom>(string(name), requester);
+                    if (Shards)
+                        newRoom->ClaimForShard();
+                    PushRoom(newRoom);
+                    target = GetRoom(-1);
+                }
 
-                    //region Disconnect client from the account
-                    requester->Connection = nullptr;
-                    connection->SetOwner(nullptr);
-                    connection->IsGuest= true;
-                    //endregion
+                ss_response << target->ID
+                            << " 'The chatroom was created successfully.'";
+                ss_log << "User ("
+                       << requester->DisplayName
+                       << "#"
+                       << requester->ID
+                       << ") Had requested the creation of a new chatroom. Request Approved, chatroom ["
+                       << target->DisplayName
+                       << "#"
+                       << target->ID
+                       << "] Was created.";
+                responseType = general::ClientActionType::InformSuccess;
+                break;
+            }
+            case ServerActionType::AddMember: {
+                if (isGuest) {
+                    ss_response << "'You must be logged-in to a Host user of a chatroom in order to add"
+                                   "a new member. You are currently NOT logged-in to ANY account. Aborted";
+                    ss_log << "Guest user has requested to add a new member to a chatroom. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
+
+                //format {roomID} {memID}
+                //region Unpack data
+                MemberPayload payload{};
+                if (!RequestParser::Parse(request->Data, payload)) {
+                    ss_response << "'Malformed request. Aborted'";
+                    ss_log << "Client (" << connection->ID
+                           << ") has sent a malformed add-member request. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
+                Hash roomID = payload.RoomID, memID = payload.MemberID;
+                //endregion
+
+                long long roomIndex;
 
-                    ss_response << "'You were successfully logged out of the server.'";
+                if ((roomIndex = FindRoom(roomID)) == -1) {
+                    ss_response << "'Referred chatroom was not found. Aborted'";
                     ss_log << "User ("
                            << requester->DisplayName
                            << "#"
                            << requester->ID
-                           << ") has requested to logout. Request Approved; Client was logged out.";
-                    responseType = general::ClientActionType::InformSuccess;
-                    break;
+                           << ") had requested to add a new member to a non-existent chatroom. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
                 }
-                case ServerActionType::TerminateConnection: {
-                    cout << "\nConnection terminated by client request." << endl;
-                    ss_response << "'Connection terminated'";
-                    ss_log << "Client (" << connection->ID
-                           << ") requested to terminate the connection. Connection closed.";
-                    responseType=general::ClientActionType::InformSuccess;
-                    closeFlag= true;
+
+                auto targetRoom = GetRoom(roomIndex);
+                if (targetRoom->Host->ID != requester->ID) {
+                    ss_response << "'You must be the host of a chatroom to add a new member to it. Aborted'";
+                    ss_log << "User ("
+                           << requester->DisplayName
+                           << "#"
+                           << requester->ID
+                           << ") had requested to add a new member to a room they are not the host of. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
                     goto Respond;
                 }
-                case ServerActionType::RegisterAccount: {
-                    if (!isGuest) {
-                        ss_response << "'To register a new account, you must first logout of the current one'";
-                        ss_log << "Logged-in user ("
-                               << requester->DisplayName
-                               << "#"
-                               << requester->ID
-                               << ") has requested to register a new account. Request denied; Aborted";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
-                    }
 
-                    //format [name] | [key]
-                    //region Unpack data
-                    string name, key;
-                    {   //Make sure temporary vars go out of scope asap.
-                        string::size_type separator = request->Data.find('|');
-                        name = request->Data.substr(1, separator - 2 /* Because of the residual space between the end of name and '|' */);
-                        key = request->Data.substr(separator + 2 /* Because of the residual space between the end of '| 'and start of key */);
-                        key = key.substr(0,key.size()-1); //Remove residual space at end of key
-                    }
-                    //endregion
+                shared_ptr<Account> targetAccount = nullptr;
+                { // Find user account to add as member
+                    long long accInd;
+                    if ((accInd = FindAccount(memID)) != -1)
+                        targetAccount = GetAccount(accInd);
+                }
+                responseType = enactOnRoom(targetRoom, [this, requester, targetRoom, targetAccount](
+                        Arena &scratch, ArenaWriter &response, ArenaWriter &log) {
+                    return AddToRoom(requester, targetRoom, targetAccount, scratch, response, log);
+                });
+                break;
+            }
+            case ServerActionType::RemoveMember: {
+                if (isGuest) {
+                    ss_response << "'You must be logged-in to a Host user of a chatroom or the user themselves"
+                                   " in order to remove a chatroom member. You are currently NOT logged-in to ANY"
+                                   " account. Aborted";
+                    ss_log
+                            << "Guest user has requested to remove a member from a chatroom. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
 
-                    auto newCl = make_shared<Account>(name, key);
+                //format {roomID} {memID}
+                //region Unpack data
+                MemberPayload payload{};
+                if (!RequestParser::Parse(request->Data, payload)) {
+                    ss_response << "'Malformed request. Aborted'";
+                    ss_log << "Client (" << connection->ID
+                           << ") has sent a malformed remove-member request. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
+                Hash roomID = payload.RoomID, memID = payload.MemberID;
+                //endregion
 
-                    PushAccount(move(newCl));
-                    shared_ptr<Account> target = GetAccount(-1);
-                    Hash ID;
-                    {
-                        lock_guard<mutex> guard(*m_Accounts);
-                        ID = target->ID;
-                    }
-                    ss_response << ID
-                                << " 'Account was successfully registered'";
-                    ss_log << "Guest had requested to register a new account. Request Approved, "
-                              "New account registered: ("
-                           << target->DisplayName
+                long long roomIndex;
+
+                if ((roomIndex = FindRoom(roomID)) == -1) {
+                    ss_response << "'Referred chatroom was not found. Aborted'";
+                    ss_log << "User ("
+                           << requester->DisplayName
                            << "#"
-                           << ID
-                           << ")";
-                    responseType = general::ClientActionType::InformSuccess;
-                    break;
+                           << requester->ID
+                           << ") had requested to remove a member from a non-existent chatroom. Request Denied;"
+                              " Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
                 }
-                case ServerActionType::CreateRoom: {
-                    if (isGuest) {
-                        ss_response << "'You must be logged in in order to create a new chatroom on the server'";
-                        ss_log << "Guest with ID (#"
-                               << connection->ID
-                               << ") Had requested the creation of a new chatroom. Request Denied; Aborted";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
-                    }
-
-                    //format {id} [key] | [name]
-                    //region Unpack data
-                    Hash cID;
-                    string name;
-                    string cKey;
-                    ss_data >> cID;
-                    { //Make sure temporary vars go out of scope asap.
-                        string reminder;
-                        getline(ss_data, reminder);
-                        string::size_type separator = reminder.find('|');
-                        cKey = reminder.substr(1, separator-1);
-                        name = reminder.substr(separator + 1);
-                        name = name.substr(0,name.size()-1);
-                    }
-                    //endregion
 
-                    if (!verifyIdentity(requester, cID, cKey)) {
-                        ss_response << "'Authentication failed, your provided credentials did not match the internal"
-                                       "records. Aborted'";
-                        ss_log << "Warning: Authentication failure => requester("
-                               << requester->DisplayName
-                               << "#"
-                               << requester->ID
-                               << ":"
-                               << requester->Key
-                               << ") Requested access with credentials {id="
-                               << cID
-                               << " ,Key = "
-                               << cKey
-                               << "}. Request details {type='Create chatroom', RoomName = '"
-                               << name
-                               << "'}. Request Denied; Aborted";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
-                    }
+                auto targetRoom = GetRoom(roomIndex);
 
+                shared_ptr<Account> targetAccount = nullptr;
+                { // Find user account to remove
+                    long long accInd;
+                    if ((accInd = FindAccount(memID)) != -1)
+                        targetAccount = GetAccount(accInd);
+                }
+                responseType = enactOnRoom(targetRoom, [this, requester, targetRoom, memID, targetAccount](
+                        Arena &scratch, ArenaWriter &response, ArenaWriter &log) {
+                    return RemoveFromRoom(requester, targetRoom, memID, targetAccount, scratch, response, log);
+                });
+                break;
+            }
+            case ServerActionType::AddMembers:
+            case ServerActionType::RemoveMembers: {
+                bool adding = request->Type == ServerActionType::AddMembers;
+                if (isGuest) {
+                    ss_response << "'You must be logged-in in order to change the members of a chatroom. You are"
+                                   " currently NOT logged-in to ANY account. Aborted'";
+                    ss_log << "Guest user has requested to "
+                           << (adding ? "add members to" : "remove members from")
+                           << " a chatroom. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
 
-                    shared_ptr<ChatRoom> target;
-                    {
-                        auto newRoom = make_shared<ChatRoom>(name, requester);
-                        PushRoom(newRoom);
-                        target = GetRoom(-1);
-                    }
+                //format {roomID} ({memID})...
+                //region Unpack data
+                MembersPayload payload{};
+                if (!RequestParser::Parse(request->Data, payload)) {
+                    ss_response << "'Malformed request. Aborted'";
+                    ss_log << "Client (" << connection->ID
+                           << ") has sent a malformed "
+                           << (adding ? "add-members" : "remove-members")
+                           << " request. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
+                //endregion
 
-                    ss_response << target->ID
-                                << " 'The chatroom was created successfully.'";
+                long long roomIndex;
+                if ((roomIndex = FindRoom(payload.RoomID)) == -1) {
+                    ss_response << "'Referred chatroom was not found. Aborted'";
                     ss_log << "User ("
                            << requester->DisplayName
                            << "#"
                            << requester->ID
-                           << ") Had requested the creation of a new chatroom. Request Approved, chatroom ["
-                           << target->DisplayName
-                           << "#"
-                           << target->ID
-                           << "] Was created.";
-                    responseType = general::ClientActionType::InformSuccess;
-                    break;
+                           << ") had requested to change the members of a non-existent chatroom. Request Denied;"
+                              " Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
                 }
-                case ServerActionType::AddMember: {
-                    if (isGuest) {
-                        ss_response << "'You must be logged-in to a Host user of a chatroom in order to add"
-                                       "a new member. You are currently NOT logged-in to ANY account. Aborted";
-                        ss_log << "Guest user has requested to add a new member to a chatroom. Request Denied; Aborted";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
-                    }
-
-                    //format {reqID} {roomID} {memID} [reqKey]
-                    //region Unpack data
-                    Hash reqID, roomID, memID;
-                    string reqKey;
-                    ss_data >> reqID >> roomID >> memID;
-                    getline(ss_data, reqKey);
-                    reqKey=reqKey.substr(1); //Remove space in beginning
-                    reqKey=reqKey.substr(0,reqKey.size()-1); //Remove space in end
-                    //endregion
-
-                    if (!verifyIdentity(requester, reqID, reqKey)) {
-                        ss_response << "'Authentication failed, your provided credentials did not match the internal"
-                                       "records. Aborted'";
-                        ss_log << "Warning: Authentication failure => requester("
-                               << requester->DisplayName
-                               << "#"
-                               << requester->ID
-                               << ":"
-                               << requester->Key
-                               << ") Requested access with credentials {id=" << reqID
-                               << " ,Key = "
-                               << reqKey
-                               << "}. Request details {type='Add member to room', RoomID = '"
-                               << roomID
-                               << "MemberAccountID= "
-                               << memID
-                               << "'}. Request Denied; Aborted";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
-                    }
-
-                    long long roomIndex;
 
-                    if ((roomIndex = FindRoom(roomID)) == -1) {
-                        ss_response << "'Referred chatroom was not found. Aborted'";
-                        ss_log << "User ("
-                               << requester->DisplayName
-                               << "#"
-                               << requester->ID
-                               << ") had requested to add a new member to a non-existent chatroom. Request Denied; Aborted";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
-                    }
+                auto targetRoom = GetRoom(roomIndex);
+                if (adding && targetRoom->Host->ID != requester->ID) {
+                    ss_response << "'You must be the host of a chatroom to add new members to it. Aborted'";
+                    ss_log << "User ("
+                           << requester->DisplayName
+                           << "#"
+                           << requester->ID
+                           << ") had requested to add new members to a room they are not the host of. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
 
-                    auto targetRoom = GetRoom(roomIndex);
-                    if (targetRoom->Host->ID != reqID) {
-                        ss_response << "'You must be the host of a chatroom to add a new member to it. Aborted'";
-                        ss_log << "User ("
-                               << requester->DisplayName
-                               << "#"
-                               << requester->ID
-                               << ") had requested to add a new member to a room they are not the host of. Request Denied; Aborted";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
-                    }
+                // Every account is resolved in one pass here, the room then changes in one update on its owner.
+                vector<Hash> ids(payload.IDs.begin(), payload.IDs.begin() + (long) payload.Count);
+                vector<shared_ptr<Account>> members;
+                FindAccounts(ids.data(), ids.size(), members);
+                responseType = enactOnRoom(targetRoom, [this, adding, requester, targetRoom, ids = std::move(ids),
+                                                        members = std::move(members)](
+                        Arena &scratch, ArenaWriter &response, ArenaWriter &log) {
+                    return adding ? AddMembersToRoom(requester, targetRoom, ids, members, scratch, response, log)
+                                  : RemoveMembersFromRoom(requester, targetRoom, ids, members, scratch, response, log);
+                });
+                break;
+            }
+            case ServerActionType::FetchMetrics: {
+                if (!IsLoopback(connection->Address)) {
+                    ss_response << "'Metrics are only served to local connections. Aborted'";
+                    ss_log << "Client (" << connection->ID
+                           << ") has requested the server metrics from a remote address. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
+                UpdateGauges();
+                ss_response << Stats->Summary() << LockRegistry::Summary();
+                ss_log << "Client (" << connection->ID
+                       << ") has requested the server metrics. Request Approved; Metrics were sent.";
+                responseType = general::ClientActionType::InformSuccess;
+                break;
+            }
+            case ServerActionType::FetchHistory: {
+                if (isGuest) {
+                    ss_response << "'You must be logged in in order to read the history of a chatroom. Aborted'";
+                    ss_log << "Guest with ID (#"
+                           << connection->ID
+                           << ") has requested the history of a chatroom. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
 
-                    targetRoom->PushMember(requester);
+                //format {roomID} {cursor} {limit}
+                //region Unpack data
+                HistoryPayload payload{};
+                // A page of no messages has no cursor to continue from.
+                if (!RequestParser::Parse(request->Data, payload) || payload.Limit == 0) {
+                    ss_response << "'Malformed request. Aborted'";
+                    ss_log << "Client (" << connection->ID
+                           << ") has sent a malformed fetch-history request. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
+                Hash cursor = payload.Cursor;
+                size_t limit = min((size_t) payload.Limit, (size_t) HISTORY_PAGE_LIMIT);
+                //endregion
 
-                    shared_ptr<Account> targetAccount = nullptr;
-                    { // Find user account to add as member
-                        long long accInd;
-                        if ((accInd = FindAccount(memID)) != -1)
-                            targetAccount = GetAccount(accInd);
-                    }
-                    if (targetAccount == nullptr) {
-                        ss_response
-                                << "'The client ID you provided was invalid. Failed to add new member to chatroom. Aborted";
-                        ss_log << "User ("
-                               << requester->DisplayName
-                               << "#"
-                               << requester->ID
-                               << ") had requested to add a non-existent account as a member of a chatroom. Request Denied; Aborted";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
-                    }
-                    targetRoom->PushMember(targetAccount);
-                    ss_response << "'Member was successfully added to the chatroom'";
+                long long roomIndex;
+                if ((roomIndex = FindRoom(payload.RoomID)) == -1) {
+                    ss_response << "'Referred chatroom was not found. Aborted'";
                     ss_log << "User ("
                            << requester->DisplayName
                            << "#"
                            << requester->ID
-                           << ") had requested to add a new member to a chatroom. Request Approved; A new member ("
-                           << targetAccount->DisplayName
-                           << "#"
-                           << targetAccount->ID
-                           << ") Was added to room ["
-                           << targetRoom->DisplayName
-                           << "#"
-                           << targetRoom->ID
-                           << "]";
-                    responseType = general::ClientActionType::InformSuccess;
+                           << ") had requested the history of a non-existent chatroom. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
 
-                    //region inform new member
-                    {
-                        stringstream ss{};
-                        ss << targetRoom->ID
-                           << " "
-                           << targetRoom->DisplayName;
-                        auto inmcr = ClientResponse(ClientActionType::JoinRoom,
-                                                    targetAccount->Connection->FileDescriptor,
-                                                    ss.str());
-                        targetAccount->Connection->EnqueueResponse(inmcr.Serialize());
-                        targetAccount->Connection->Write();
-                    }
-                    //endregion
-                    break;
+                auto targetRoom = GetRoom(roomIndex);
+                responseType = enactOnRoom(targetRoom, [this, requester, targetRoom, connection, cursor, limit](
+                        Arena &scratch, ArenaWriter &response, ArenaWriter &log) {
+                    return HistoryFromRoom(requester, targetRoom, connection, cursor, limit, scratch, response, log);
+                });
+                break;
+            }
+            case ServerActionType::Resync: {
+                if (isGuest) {
+                    ss_response << "'You must be logged in in order to resync your chatrooms. Aborted'";
+                    ss_log << "Guest with ID (#"
+                           << connection->ID
+                           << ") has requested to resync their chatrooms. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
                 }
-                case ServerActionType::RemoveMember: {
-                    if (isGuest) {
-                        ss_response << "'You must be logged-in to a Host user of a chatroom or the user themselves"
-                                       " in order to remove a chatroom member. You are currently NOT logged-in to ANY"
-                                       " account. Aborted";
-                        ss_log
-                                << "Guest user has requested to remove a member from a chatroom. Request Denied; Aborted";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
-                    }
 
-                    //format {reqID} {roomID} {memID} [reqKey]
-                    //region Unpack data
-                    Hash reqID, roomID, memID;
-                    string reqKey;
-                    ss_data >> reqID >> roomID >> memID;
-                    getline(ss_data, reqKey);
-                    //endregion
-
-                    if (!verifyIdentity(requester, reqID, reqKey)) {
-                        ss_response << "'Authentication failed, your provided credentials did not match the internal"
-                                       "records. Aborted'";
-                        ss_log << "Warning: Authentication failure => requester("
-                               << requester->DisplayName
-                               << "#"
-                               << requester->ID
-                               << ":"
-                               << requester->Key
-                               << ") Requested access with credentials {id=" << reqID
-                               << " ,Key = "
-                               << reqKey
-                               << "}. Request details {type='Remove member from room', RoomID = '"
-                               << roomID
-                               << "MemberAccountID= "
-                               << memID
-                               << "'}. Request Denied; Aborted";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
-                    }
+                //format ({roomID} {lastSeq})...
+                //region Unpack data
+                struct ResyncState {
+                    ResyncPayload Payload;
+                    array<pair<ResyncStatus, Hash>, RESYNC_MAX_ROOMS> Results;
+                };
+                auto state = make_shared<ResyncState>();
+                if (!RequestParser::Parse(request->Data, state->Payload)) {
+                    ss_response << "'Malformed request. Aborted'";
+                    ss_log << "Client (" << connection->ID
+                           << ") has sent a malformed resync request. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
+                //endregion
 
+                // Each room fills its own slot and the last one to finish answers. Its deltas are all
+                // queued by then, so the reply follows every batch.
+                vector<shared_ptr<ChatRoom>> rooms(state->Payload.Count);
+                for (size_t i = 0; i < state->Payload.Count; i++) {
                     long long roomIndex;
-
-                    if ((roomIndex = FindRoom(roomID)) == -1) {
-                        ss_response << "'Referred chatroom was not found. Aborted'";
-                        ss_log << "User ("
-                               << requester->DisplayName
-                               << "#"
-                               << requester->ID
-                               << ") had requested to remove a member from a non-existent chatroom. Request Denied;"
-                                  " Aborted";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
+                    if ((roomIndex = FindRoom(state->Payload.Rooms[i].first)) != -1)
+                        rooms[i] = GetRoom(roomIndex);
+                }
+                AcrossRooms(rooms, [this, state, requester, connection](
+                        size_t i, const shared_ptr<ChatRoom> &room, Arena &scratch) {
+                    state->Results[i] = room ? ResyncRoom(requester, room, connection, state->Payload.Rooms[i].second,
+                                                          scratch)
+                                             : pair<ResyncStatus, Hash>{ResyncStatus::Denied, 0};
+                }, [this, state, requester, connection, type = request->Type, started](Arena &scratch) {
+                    ArenaWriter response(scratch);
+                    ArenaWriter log(scratch);
+                    size_t reloads = 0;
+                    response << state->Payload.Count;
+                    for (size_t i = 0; i < state->Payload.Count; i++) {
+                        auto [status, latest] = state->Results[i];
+                        reloads += status == ResyncStatus::Reload;
+                        response << " "
+                                 << state->Payload.Rooms[i].first
+                                 << " "
+                                 << (int) status
+                                 << " "
+                                 << latest;
                     }
+                    response << " 'Resync complete'";
+                    log << "User ("
+                        << requester->DisplayName
+                        << "#"
+                        << requester->ID
+                        << ") had requested to resync "
+                        << state->Payload.Count
+                        << " chatrooms. Request Approved; "
+                        << reloads
+                        << " of them have to be reloaded.";
+                    Conclude(connection, type, general::ClientActionType::InformSuccess, started,
+                             response.View(), log.View(), scratch);
+                });
+                responseType = general::ClientActionType::NONE;
+                break;
+            }
+            case ServerActionType::QueryPresence: {
+                if (isGuest) {
+                    ss_response << "'You must be logged in in order to see who is online. Aborted'";
+                    ss_log << "Guest with ID (#"
+                           << connection->ID
+                           << ") has requested the presence of other users. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
 
-                    auto targetRoom = GetRoom(roomIndex);
+                //format {roomID}
+                //region Unpack data
+                PresencePayload payload{};
+                if (!RequestParser::Parse(request->Data, payload)) {
+                    ss_response << "'Malformed request. Aborted'";
+                    ss_log << "Client (" << connection->ID
+                           << ") has sent a malformed presence request. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
+                //endregion
 
-                    if (!targetRoom->FindMember(memID)) {
-                        ss_response << "'Failed to find member with provided ID in the chatroom. Aborted'";
+                if (payload.RoomID != 0) {
+                    long long roomIndex;
+                    if ((roomIndex = FindRoom(payload.RoomID)) == -1) {
+                        ss_response << "'Referred chatroom was not found. Aborted'";
                         ss_log << "User ("
                                << requester->DisplayName
                                << "#"
                                << requester->ID
-                               << ") had requested to kick a user that isn't a member of the room they referred to. "
-                                  "Request Denied; Aborted";
+                               << ") had requested the presence in a non-existent chatroom. Request Denied; Aborted";
                         responseType = general::ClientActionType::InformFailure;
                         goto Respond;
                     }
+                    auto targetRoom = GetRoom(roomIndex);
+                    responseType = enactOnRoom(targetRoom, [this, requester, targetRoom](
+                            Arena &, ArenaWriter &response, ArenaWriter &log) {
+                        return PresenceInRoom(requester, targetRoom, response, log);
+                    });
+                    break;
+                }
 
-                    if (targetRoom->Host->ID != reqID && memID != requester->ID) {
-                        ss_response << "'You must be the host of a chatroom or the member themselves to kick them from"
-                                       " the room. Aborted'";
-                        ss_log << "User ("
-                               << requester->DisplayName
-                               << "#"
-                               << requester->ID
-                               << ") had requested to kick a member from a room they are not the host of or the member "
-                                  "themselves. Request Denied; Aborted";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
+                // Contacts: the member bitsets of the requester's rooms are copied on their owners, united
+                // by the last of them and intersected with the online one.
+                vector<shared_ptr<ChatRoom>> rooms;
+                for (auto &[roomID, entry]: *requester->RoomsSnapshot())
+                    if (auto room = entry.Room.lock())
+                        rooms.push_back(move(room));
+                auto words = make_shared<vector<vector<pair<Hash, uint64_t>>>>(rooms.size());
+                AcrossRooms(rooms, [words](size_t i, const shared_ptr<ChatRoom> &room, Arena &) {
+                    (*words)[i] = room->MemberWords();
+                }, [this, words, requester, connection, type = request->Type, started](Arena &scratch) {
+                    unordered_map<Hash, uint64_t> contacts;
+                    for (auto &room: *words)
+                        for (auto &[word, bits]: room)
+                            contacts[word] |= bits;
+                    if (auto self = contacts.find(requester->ID / 64); self != contacts.end())
+                        self->second &= ~(1ULL << (requester->ID % 64));
+
+                    size_t total = 0, online = 0;
+                    vector<Hash> ids;
+                    for (auto &[word, bits]: contacts) {
+                        uint64_t present = bits & Online->Word(word);
+                        total += __builtin_popcountll(bits);
+                        online += __builtin_popcountll(present);
+                        for (; present && ids.size() < PRESENCE_LIST_LIMIT; present &= present - 1)
+                            ids.push_back(word * 64 + __builtin_ctzll(present));
                     }
+                    sort(ids.begin(), ids.end());
+
+                    //format 0 {online} {contacts} ({id})...
+                    ArenaWriter response(scratch);
+                    ArenaWriter log(scratch);
+                    response << 0
+                             << " "
+                             << online
+                             << " "
+                             << total;
+                    for (Hash id: ids)
+                        response << " " << id;
+                    response << " 'Presence listed'";
+                    log << "User ("
+                        << requester->DisplayName
+                        << "#"
+                        << requester->ID
+                        << ") had requested the presence of their contacts. Request Approved; "
+                        << online
+                        << " of "
+                        << total
+                        << " are online.";
+                    Conclude(connection, type, general::ClientActionType::InformSuccess, started,
+                             response.View(), log.View(), scratch);
+                });
+                responseType = general::ClientActionType::NONE;
+                break;
+            }
+            case ServerActionType::SendMessages: {
+                if (isGuest) {
+                    ss_response << "'You must be logged in in order to send messages. Aborted'";
+                    ss_log << "Guest with ID (#"
+                           << connection->ID
+                           << ") has requested to send a batch of messages. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
 
-                    shared_ptr<Account> targetAccount = nullptr;
-                    { // Find user account to add as member
-                        long long accInd;
-                        if ((accInd = FindAccount(memID)) != -1)
-                            targetAccount = GetAccount(accInd);
+                //format ({rID} {length}|[msg])...
+                //region Unpack data
+                // The messages view the request's own buffer, the state keeps it alive for the shards.
+                struct SendState {
+                    IntrusivePtr<ServerRequest> Request;
+                    SendMessagesPayload Payload;
+                    vector<vector<size_t>> ByRoom;
+                    array<pair<Hash, Hash>, SEND_MAX_MESSAGES> Results;
+                };
+                auto state = make_shared<SendState>();
+                state->Request = request;
+                if (!RequestParser::Parse(state->Request->Data, state->Payload)) {
+                    ss_response << "'Malformed request. Aborted'";
+                    ss_log << "Client (" << connection->ID
+                           << ") has sent a malformed send-messages request. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
+                //endregion
+
+                // Messages are grouped by room, each room takes its own in order on its owner and the last
+                // one to finish answers for all of them. A message whose room was not found stays unsent.
+                vector<shared_ptr<ChatRoom>> rooms;
+                unordered_map<Hash, size_t> slots;
+                for (size_t i = 0; i < state->Payload.Count; i++) {
+                    auto [slot, fresh] = slots.try_emplace(state->Payload.Messages[i].first, rooms.size());
+                    if (fresh) {
+                        long long roomIndex = FindRoom(state->Payload.Messages[i].first);
+                        rooms.push_back(roomIndex != -1 ? GetRoom(roomIndex) : nullptr);
+                        state->ByRoom.emplace_back();
                     }
-                    if (targetAccount == nullptr) {
-                        ss_response
-                                << "'The client ID you provided was invalid. Failed to kick member from the chatroom."
-                                   " Aborted";
-                        ss_log << "User ("
-                               << requester->DisplayName
-                               << "#"
-                               << requester->ID
-                               << ") had requested to kick a non-existent account from a chatroom. Request Denied;"
-                                  " Aborted";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
+                    state->ByRoom[slot->second].push_back(i);
+                }
+                AcrossRooms(rooms, [this, state, requester, connection](
+                        size_t i, const shared_ptr<ChatRoom> &room, Arena &scratch) {
+                    if (room)
+                        SendBatchToRoom(requester, room, connection, state->Payload, state->ByRoom[i],
+                                        state->Results.data(), scratch);
+                }, [this, state, requester, connection, type = request->Type, started](Arena &scratch) {
+                    //format {count} ({msgID} {seq})... [message]
+                    ArenaWriter response(scratch);
+                    ArenaWriter log(scratch);
+                    size_t sent = 0;
+                    response << state->Payload.Count;
+                    for (size_t i = 0; i < state->Payload.Count; i++) {
+                        auto [msgID, seq] = state->Results[i];
+                        sent += msgID != 0;
+                        response << " "
+                                 << msgID
+                                 << " "
+                                 << seq;
                     }
-                    targetRoom->EraseMember(targetAccount->ID);
-                    ss_response << "'Member was successfully removed from the chatroom'";
+                    response << " '"
+                             << sent
+                             << " of "
+                             << state->Payload.Count
+                             << " messages were sent'";
+                    log << "User ("
+                        << requester->DisplayName
+                        << "#"
+                        << requester->ID
+                        << ") had requested to send "
+                        << state->Payload.Count
+                        << " messages in "
+                        << state->ByRoom.size()
+                        << " chatrooms. "
+                        << (sent ? "Request Approved; " : "Request Denied; ")
+                        << sent
+                        << " of them were sent.";
+                    Conclude(connection, type, sent ? general::ClientActionType::InformSuccess
+                                                    : general::ClientActionType::InformFailure,
+                             started, response.View(), log.View(), scratch);
+                });
+                responseType = general::ClientActionType::NONE;
+                break;
+            }
+            case ServerActionType::Subscribe:
+            case ServerActionType::Unsubscribe: {
+                bool subscribe = request->Type == ServerActionType::Subscribe;
+                if (isGuest) {
+                    ss_response << "'You must be logged in in order to "
+                                << (subscribe ? "view" : "stop viewing")
+                                << " a chatroom. Aborted'";
+                    ss_log << "Guest with ID (#"
+                           << connection->ID
+                           << ") has requested to "
+                           << (subscribe ? "subscribe to" : "unsubscribe from")
+                           << " a chatroom. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
+
+                //format {roomID}
+                //region Unpack data
+                SubscribePayload payload{};
+                if (!RequestParser::Parse(request->Data, payload)) {
+                    ss_response << "'Malformed request. Aborted'";
+                    ss_log << "Client (" << connection->ID
+                           << ") has sent a malformed subscription request. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
+                //endregion
+
+                if (!subscribe) {
+                    connection->Unsubscribe(payload.RoomID);
+                    ss_response << payload.RoomID << " 'Unsubscribed'";
                     ss_log << "User ("
                            << requester->DisplayName
                            << "#"
                            << requester->ID
-                           << ") had requested to add a remove a member from a chatroom. Request Approved; Member ("
-                           << targetAccount->DisplayName
-                           << "#"
-                           << targetAccount->ID
-                           << ") Was removed from room ["
-                           << targetRoom->DisplayName
-                           << "#"
-                           << targetRoom->ID
-                           << "]";
+                           << ") had requested to stop viewing "
+                           << (payload.RoomID ? "a chatroom" : "every chatroom")
+                           << ". Request Approved.";
                     responseType = general::ClientActionType::InformSuccess;
-                    //region inform ex member
-                    {
-                        stringstream ss{};
-                        ss << targetRoom->ID
-                           << " "
-                           << targetRoom->DisplayName;
-                        auto iemcr = ClientResponse(ClientActionType::LeaveRoom,
-                                                    targetAccount->Connection->FileDescriptor,
-                                                    ss.str());
-                        targetAccount->Connection->EnqueueResponse(iemcr.Serialize());
-                        targetAccount->Connection->Write();
-                    }
-                    //endregion
-                    break;
+                    goto Respond;
                 }
-                case ServerActionType::SendMessage:
-                    if (isGuest) {
-                        ss_response
-                                << "'You must be logged-in to a member user of a chatroom in order to send a message."
-                                   " You are currently NOT logged-in to ANY account. Aborted";
-                        ss_log << "Guest user has requested to send a message in a chatroom. Request Denied; Aborted";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
-                    }
 
-                    //format {cID} {rID} [cKey] | [msg]
-                    //region Unpack data
-                    Hash cID, rID;
-                    string cKey, msg;
-                    ss_data >> cID >> rID;
-                    {
-                        string reminder;
-                        getline(ss_data, reminder);
-                        string::size_type separator = reminder.find('|');
-                        cKey = reminder.substr(1, separator-1);
-                        msg = reminder.substr(separator + 1);
-                        msg = msg.substr(0,msg.size()-1);
-                    }
-                    //endregion
-                    if (!verifyIdentity(requester, cID, cKey)) {
-                        ss_response << "'Authentication failed, your provided credentials did not match the internal"
-                                       "records. Aborted'";
-                        ss_log << "Warning: Authentication failure => requester("
-                               << requester->DisplayName
-                               << "#"
-                               << requester->ID
-                               << ":"
-                               << requester->Key
-                               << ") Requested access with credentials {id=" << cID
-                               << " ,Key = "
-                               << cKey
-                               << "}. Request details {type='Send message in room', RoomID = '"
-                               << rID
-                               << "' Message= '"
-                               << msg
-                               << "'}. Request Denied; Aborted";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
-                    }
-                    long long roomIndex;
-
-                    if ((roomIndex = FindRoom(rID)) == -1) {
-                        ss_response << "'Referred chatroom was not found. Aborted'";
-                        ss_log << "User ("
-                               << requester->DisplayName
-                               << "#"
-                               << requester->ID
-                               << ") had requested to send a message in a non-existent chatroom. Request Denied;"
-                                  " Aborted";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
-                    }
+                long long roomIndex;
+                if ((roomIndex = FindRoom(payload.RoomID)) == -1) {
+                    ss_response << "'Referred chatroom was not found. Aborted'";
+                    ss_log << "User ("
+                           << requester->DisplayName
+                           << "#"
+                           << requester->ID
+                           << ") had requested to subscribe to a non-existent chatroom. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
+                auto targetRoom = GetRoom(roomIndex);
+                responseType = enactOnRoom(targetRoom, [this, requester, targetRoom, connection](
+                        Arena &, ArenaWriter &response, ArenaWriter &log) {
+                    return SubscribeToRoom(requester, targetRoom, connection, response, log);
+                });
+                break;
+            }
+            case ServerActionType::AckRead: {
+                // Clients send these on their own schedule and never wait on them, so nothing is sent back.
+                if (isGuest) {
+                    ss_log << "Guest with ID (#"
+                           << connection->ID
+                           << ") has acknowledged reading a chatroom. Request Denied; Ignored";
+                    goto Respond;
+                }
 
-                    auto targetRoom = GetRoom(roomIndex);
+                //format ({roomID} {readSeq})...
+                //region Unpack data
+                AckReadPayload payload{};
+                if (!RequestParser::Parse(request->Data, payload)) {
+                    ss_log << "Client (" << connection->ID
+                           << ") has sent a malformed read acknowledgement. Request Denied; Ignored";
+                    goto Respond;
+                }
+                //endregion
+
+                // Only the account's cursors move, each clamped to its room's last message, so the rooms'
+                // owners are not involved.
+                auto joined = requester->RoomsSnapshot();
+                size_t applied = 0;
+                for (size_t i = 0; i < payload.Count; i++) {
+                    auto [roomID, seq] = payload.Rooms[i];
+                    auto found = joined->find(roomID);
+                    shared_ptr<ChatRoom> room;
+                    if (found == joined->end() || !(room = found->second.Room.lock()))
+                        continue;
+                    requester->AdvanceRead(roomID, min(seq, room->LatestSeq()));
+                    applied++;
+                }
+                Stats->RecordRequest(request->Type, applied ? general::ClientActionType::InformSuccess
+                                                            : general::ClientActionType::InformFailure,
+                                     (unsigned long long) chrono::duration_cast<chrono::nanoseconds>(
+                                             chrono::steady_clock::now() - started).count());
+                break;
+            }
+            case ServerActionType::SendMessage:
+                if (isGuest) {
+                    ss_response
+                            << "'You must be logged-in to a member user of a chatroom in order to send a message."
+                               " You are currently NOT logged-in to ANY account. Aborted";
+                    ss_log << "Guest user has requested to send a message in a chatroom. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
 
-                    if (!targetRoom->FindMember(cID)) {
-                        ss_response << "'You must be a member of a chatroom to send a message in it. Aborted'";
-                        ss_log << "User ("
-                               << requester->DisplayName
-                               << "#"
-                               << requester->ID
-                               << ") had requested to send a message in a room they are not a member of. "
-                                  "Request Denied; Aborted";
-                        responseType = general::ClientActionType::InformFailure;
-                        goto Respond;
-                    }
-                    msgCount.store(msgCount.load() + 1);
-                    EmplaceMessage(msgCount.load(), tuple<Hash, Hash, string>(rID, Hash(cID), string(msg)));
-                    targetRoom->PushMessage(cID, string(msg));
+                //format {rID}|[msg]
+                //region Unpack data
+                SendMessagePayload payload{};
+                if (!RequestParser::Parse(request->Data, payload)) {
+                    ss_response << "'Malformed request. Aborted'";
+                    ss_log << "Client (" << connection->ID
+                           << ") has sent a malformed send-message request. Request Denied; Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
+                Hash rID = payload.RoomID;
+                string_view msg = payload.Message;
+                //endregion
+                long long roomIndex;
 
-                    ss_response << msgCount.load()
-                                << "'Message sent'";
+                if ((roomIndex = FindRoom(rID)) == -1) {
+                    ss_response << "'Referred chatroom was not found. Aborted'";
                     ss_log << "User ("
                            << requester->DisplayName
                            << "#"
                            << requester->ID
-                           << ") had requested to send a message in a chatroom. Request Approved; Message {"
-                           << msgCount.load()
-                           << ">"
-                           << msg
-                           << ") Was sent in room ["
-                           << targetRoom->DisplayName
-                           << "#"
-                           << targetRoom->ID
-                           << "]";
-                    responseType = general::ClientActionType::InformSuccess;
-                    break;
+                           << ") had requested to send a message in a non-existent chatroom. Request Denied;"
+                              " Aborted";
+                    responseType = general::ClientActionType::InformFailure;
+                    goto Respond;
+                }
+
+                auto targetRoom = GetRoom(roomIndex);
+
+                // 'msg' views the request's own buffer, which the shard job keeps alive by holding 'request'.
+                responseType = enactOnRoom(targetRoom, [this, requester, targetRoom, connection, msg](
+                        Arena &scratch, ArenaWriter &response, ArenaWriter &log) {
+                    return SendToRoom(requester, targetRoom, connection, msg, scratch, response, log);
+                });
+                break;
+        }
+        //endregion
+        Respond:
+        {
+            Conclude(connection, request->Type, responseType, started, ss_response.View(), ss_log.View(),
+                     RequestArena);
+            if(responseType != general::ClientActionType::NONE && closeFlag){
+                connection->Close();
+                RemoveConnection(connection->FileDescriptor);
             }
-            //endregion
-            Respond:
-            {
-                LogMessage(ss_log.str());
-                if(responseType != general::ClientActionType::NONE){
-                    auto s_resp = ClientResponse(responseType, connection->FileDescriptor,
-                                                 ss_response.str()).Serialize();
-                    connection->EnqueueResponse(s_resp);
-                    connection->Write();
-                    if(closeFlag){
-                        close(connection->FileDescriptor);
-                        RemoveConnection(connection->FileDescriptor);
-                    }
+        }
+        //endregion
+    }
+
+    void Server::Resume(Hash ConnectionID) {
+        auto parked = Parked.find(ConnectionID);
+        if (parked == Parked.end())
+            return;
+        auto waiting = move(parked->second);
+        Parked.erase(parked);
+        // Enact parks the rest again in order if one of these is itself a login or registration.
+        for (auto &request: waiting)
+            Enact(ConnectionID, request);
+    }
+
+    void Server::Conclude(const IntrusivePtr<Client> &connection, ServerActionType type, ClientActionType outcome,
+                          chrono::steady_clock::time_point started, string_view response, string_view log,
+                          Arena &scratch) {
+        if (!log.empty())
+            LogMessage(log, scratch);
+        if (outcome == general::ClientActionType::NONE)
+            return;
+        Stats->RecordRequest(type, outcome, (unsigned long long)
+                chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - started).count());
+        connection->EnqueueResponse(ClientResponse::Frame(scratch, outcome, connection->FileDescriptor, response));
+        connection->Write();
+    }
+
+    ClientActionType Server::AddToRoom(const shared_ptr<Account> &requester, const shared_ptr<ChatRoom> &room,
+                                       const shared_ptr<Account> &member, Arena &scratch,
+                                       ArenaWriter &response, ArenaWriter &log) {
+        room->PushMember(requester);
+        requester->PushRoom(room);
+        if (member == nullptr) {
+            response << "'The client ID you provided was invalid. Failed to add new member to chatroom. Aborted";
+            log << "User ("
+                << requester->DisplayName
+                << "#"
+                << requester->ID
+                << ") had requested to add a non-existent account as a member of a chatroom. Request Denied; Aborted";
+            return general::ClientActionType::InformFailure;
+        }
+        room->PushMember(member);
+        member->PushRoom(room);
+        response << "'Member was successfully added to the chatroom'";
+        log << "User ("
+            << requester->DisplayName
+            << "#"
+            << requester->ID
+            << ") had requested to add a new member to a chatroom. Request Approved; A new member ("
+            << member->DisplayName
+            << "#"
+            << member->ID
+            << ") Was added to room ["
+            << room->DisplayName
+            << "#"
+            << room->ID
+            << "]";
+
+        //region inform new member
+        {
+            ArenaWriter ss(scratch);
+            ss << room->ID
+               << " "
+               << room->DisplayName;
+            member->Deliver(ClientActionType::JoinRoom, ss.View(), scratch);
+        }
+        //endregion
+        return general::ClientActionType::InformSuccess;
+    }
+
+    ClientActionType Server::RemoveFromRoom(const shared_ptr<Account> &requester, const shared_ptr<ChatRoom> &room,
+                                            Hash memID, const shared_ptr<Account> &member, Arena &scratch,
+                                            ArenaWriter &response, ArenaWriter &log) {
+        if (!room->FindMember(memID)) {
+            response << "'Failed to find member with provided ID in the chatroom. Aborted'";
+            log << "User ("
+                << requester->DisplayName
+                << "#"
+                << requester->ID
+                << ") had requested to kick a user that isn't a member of the room they referred to. "
+                   "Request Denied; Aborted";
+            return general::ClientActionType::InformFailure;
+        }
+
+        if (room->Host->ID != requester->ID && memID != requester->ID) {
+            response << "'You must be the host of a chatroom or the member themselves to kick them from"
+                        " the room. Aborted'";
+            log << "User ("
+                << requester->DisplayName
+                << "#"
+                << requester->ID
+                << ") had requested to kick a member from a room they are not the host of or the member "
+                   "themselves. Request Denied; Aborted";
+            return general::ClientActionType::InformFailure;
+        }
+
+        if (member == nullptr) {
+            response << "'The client ID you provided was invalid. Failed to kick member from the chatroom."
+                        " Aborted";
+            log << "User ("
+                << requester->DisplayName
+                << "#"
+                << requester->ID
+                << ") had requested to kick a non-existent account from a chatroom. Request Denied;"
+                   " Aborted";
+            return general::ClientActionType::InformFailure;
+        }
+        room->EraseMember(member->ID);
+        member->EraseRoom(room->ID);
+        response << "'Member was successfully removed from the chatroom'";
+        log << "User ("
+            << requester->DisplayName
+            << "#"
+            << requester->ID
+            << ") had requested to add a remove a member from a chatroom. Request Approved; Member ("
+            << member->DisplayName
+            << "#"
+            << member->ID
+            << ") Was removed from room ["
+            << room->DisplayName
+            << "#"
+            << room->ID
+            << "]";
+        //region inform ex member
+        {
+            ArenaWriter ss(scratch);
+            ss << room->ID
+               << " "
+               << room->DisplayName;
+            member->Deliver(ClientActionType::LeaveRoom, ss.View(), scratch);
+        }
+        //endregion
+        return general::ClientActionType::InformSuccess;
+    }
+
+    ClientActionType Server::AddMembersToRoom(const shared_ptr<Account> &requester, const shared_ptr<ChatRoom> &room,
+                                              const vector<Hash> &ids, const vector<shared_ptr<Account>> &members,
+                                              Arena &scratch, ArenaWriter &response, ArenaWriter &log) {
+        room->PushMember(requester);
+        requester->PushRoom(room);
+        vector<bool> added;
+        room->PushMembers(members, added);
+
+        // Every new member is told with the same payload, built once.
+        ArenaWriter joined(scratch);
+        joined << room->ID
+               << " "
+               << room->DisplayName;
+        //format {roomID} {count} ({memID} {status})...
+        size_t done = 0;
+        response << room->ID
+                 << " "
+                 << ids.size();
+        for (size_t i = 0; i < ids.size(); i++) {
+            MemberStatus status = !members[i] ? MemberStatus::NoAccount :
+                                  !added[i] ? MemberStatus::Unchanged : MemberStatus::Done;
+            response << " "
+                     << ids[i]
+                     << " "
+                     << (int) status;
+            if (status != MemberStatus::Done)
+                continue;
+            done++;
+            members[i]->PushRoom(room);
+            members[i]->Deliver(ClientActionType::JoinRoom, joined.View(), scratch);
+        }
+        response << " '"
+                 << done
+                 << " of "
+                 << ids.size()
+                 << " members were added to the chatroom'";
+        log << "User ("
+            << requester->DisplayName
+            << "#"
+            << requester->ID
+            << ") had requested to add "
+            << ids.size()
+            << " members to room ["
+            << room->DisplayName
+            << "#"
+            << room->ID
+            << "]. Request Approved; "
+            << done
+            << " of them were added.";
+        return general::ClientActionType::InformSuccess;
+    }
+
+    ClientActionType Server::RemoveMembersFromRoom(const shared_ptr<Account> &requester,
+                                                   const shared_ptr<ChatRoom> &room, const vector<Hash> &ids,
+                                                   const vector<shared_ptr<Account>> &members, Arena &scratch,
+                                                   ArenaWriter &response, ArenaWriter &log) {
+        // A host may remove anyone, any other member only themselves.
+        bool host = room->Host->ID == requester->ID;
+        vector<MemberStatus> statuses(ids.size(), MemberStatus::Unchanged);
+        vector<Hash> leaving;
+        vector<size_t> positions;
+        for (size_t i = 0; i < ids.size(); i++) {
+            if (!host && ids[i] != requester->ID)
+                statuses[i] = MemberStatus::Denied;
+            else if (!members[i])
+                statuses[i] = MemberStatus::NoAccount;
+            else {
+                leaving.push_back(ids[i]);
+                positions.push_back(i);
+            }
+        }
+        vector<bool> removed;
+        room->EraseMembers(leaving, removed);
+
+        ArenaWriter left(scratch);
+        left << room->ID
+             << " "
+             << room->DisplayName;
+        size_t done = 0;
+        for (size_t j = 0; j < leaving.size(); j++) {
+            if (!removed[j])
+                continue;
+            size_t i = positions[j];
+            statuses[i] = MemberStatus::Done;
+            done++;
+            members[i]->EraseRoom(room->ID);
+            members[i]->Deliver(ClientActionType::LeaveRoom, left.View(), scratch);
+        }
+
+        //format {roomID} {count} ({memID} {status})...
+        response << room->ID
+                 << " "
+                 << ids.size();
+        for (size_t i = 0; i < ids.size(); i++)
+            response << " "
+                     << ids[i]
+                     << " "
+                     << (int) statuses[i];
+        response << " '"
+                 << done
+                 << " of "
+                 << ids.size()
+                 << " members were removed from the chatroom'";
+        log << "User ("
+            << requester->DisplayName
+            << "#"
+            << requester->ID
+            << ") had requested to remove "
+            << ids.size()
+            << " members from room ["
+            << room->DisplayName
+            << "#"
+            << room->ID
+            << "]. Request Approved; "
+            << done
+            << " of them were removed.";
+        return general::ClientActionType::InformSuccess;
+    }
+
+    ClientActionType Server::HistoryFromRoom(const shared_ptr<Account> &requester, const shared_ptr<ChatRoom> &room,
+                                             const IntrusivePtr<Client> &connection, Hash cursor, size_t limit,
+                                             Arena &scratch, ArenaWriter &response, ArenaWriter &log) {
+        if (!room->FindMember(requester->ID)) {
+            response << "'You must be a member of a chatroom to read its history. Aborted'";
+            log << "User ("
+                << requester->DisplayName
+                << "#"
+                << requester->ID
+                << ") had requested the history of a room they are not a member of. Request Denied; Aborted";
+            return general::ClientActionType::InformFailure;
+        }
+        // The batches are queued ahead of the reply, so a client has the whole page once it sees it.
+        Hash next;
+        size_t sent = room->SendHistory(connection, cursor, limit, next, scratch);
+
+        response << room->ID
+                 << " "
+                 << next
+                 << " "
+                 << sent
+                 << " 'History sent'";
+        log << "User ("
+            << requester->DisplayName
+            << "#"
+            << requester->ID
+            << ") had requested the history of room ["
+            << room->DisplayName
+            << "#"
+            << room->ID
+            << "] before message {"
+            << cursor
+            << "}. Request Approved; "
+            << sent
+            << " messages were sent.";
+        return general::ClientActionType::InformSuccess;
+    }
+
+    ClientActionType Server::PresenceInRoom(const shared_ptr<Account> &requester, const shared_ptr<ChatRoom> &room,
+                                            ArenaWriter &response, ArenaWriter &log) {
+        if (!room->FindMember(requester->ID)) {
+            response << "'You must be a member of a chatroom to see who is online in it. Aborted'";
+            log << "User ("
+                << requester->DisplayName
+                << "#"
+                << requester->ID
+                << ") had requested the presence in a room they are not a member of. Request Denied; Aborted";
+            return general::ClientActionType::InformFailure;
+        }
+        vector<Hash> ids;
+        size_t members;
+        size_t online = room->OnlineMembers(*Online, ids, PRESENCE_LIST_LIMIT, members);
+        sort(ids.begin(), ids.end());
+
+        //format {roomID} {online} {members} ({id})...
+        response << room->ID
+                 << " "
+                 << online
+                 << " "
+                 << members;
+        for (Hash id: ids)
+            response << " " << id;
+        response << " 'Presence listed'";
+        log << "User ("
+            << requester->DisplayName
+            << "#"
+            << requester->ID
+            << ") had requested the presence in room ["
+            << room->DisplayName
+            << "#"
+            << room->ID
+            << "]. Request Approved; "
+            << online
+            << " of "
+            << members
+            << " members are online.";
+        return general::ClientActionType::InformSuccess;
+    }
+
+    ClientActionType Server::SubscribeToRoom(const shared_ptr<Account> &requester, const shared_ptr<ChatRoom> &room,
+                                             const IntrusivePtr<Client> &connection, ArenaWriter &response,
+                                             ArenaWriter &log) {
+        if (!room->FindMember(requester->ID)) {
+            response << "'You must be a member of a chatroom to view it. Aborted'";
+            log << "User ("
+                << requester->DisplayName
+                << "#"
+                << requester->ID
+                << ") had requested to subscribe to a room they are not a member of. Request Denied; Aborted";
+            return general::ClientActionType::InformFailure;
+        }
+        if (!connection->Subscribe(room->ID)) {
+            response << "'You may view at most "
+                     << CLIENT_MAX_VIEWED
+                     << " chatrooms at once. Aborted'";
+            log << "User ("
+                << requester->DisplayName
+                << "#"
+                << requester->ID
+                << ") had requested to subscribe to more rooms than a session may view. Request Denied; Aborted";
+            return general::ClientActionType::InformFailure;
+        }
+
+        // Taken after subscribing, so any later message is pushed in full and the client loses none
+        // between this and the history it fetches.
+        //format {roomID} {latestSeq}
+        response << room->ID
+                 << " "
+                 << room->LatestSeq()
+                 << " 'Subscribed'";
+        log << "User ("
+            << requester->DisplayName
+            << "#"
+            << requester->ID
+            << ") had requested to subscribe to room ["
+            << room->DisplayName
+            << "#"
+            << room->ID
+            << "]. Request Approved.";
+        return general::ClientActionType::InformSuccess;
+    }
+
+    void Server::AcrossRooms(const vector<shared_ptr<ChatRoom>> &rooms,
+                             function<void(size_t, const shared_ptr<ChatRoom> &, Arena &)> each,
+                             function<void(Arena &)> done) {
+        struct Gather {
+            atomic<size_t> Remaining;
+            function<void(size_t, const shared_ptr<ChatRoom> &, Arena &)> Each;
+            function<void(Arena &)> Done;
+        };
+        if (rooms.empty()) {
+            done(RequestArena);
+            return;
+        }
+        auto gather = make_shared<Gather>();
+        gather->Remaining.store(rooms.size());
+        gather->Each = std::move(each);
+        gather->Done = std::move(done);
+        for (size_t i = 0; i < rooms.size(); i++) {
+            auto job = [gather, room = rooms[i], i](Arena &scratch) {
+                gather->Each(i, room, scratch);
+                if (gather->Remaining.fetch_sub(1) == 1)
+                    gather->Done(scratch);
+            };
+            if (Shards && rooms[i])
+                Shards->Post(rooms[i]->ID, job);
+            else
+                job(RequestArena);
+        }
+    }
+
+    void Server::FlushPresence() {
+        auto changes = Online->TakeChanges();
+        if (changes.empty())
+            return;
+        TRACE_SPAN_ARG("FlushPresence", changes.size());
+
+        // The rooms of the accounts that changed, each with the changes it passes on to its members.
+        struct Flush {
+            vector<pair<shared_ptr<Account>, bool>> Changes;
+            vector<vector<uint32_t>> RoomChanges;
+            vector<vector<shared_ptr<Account>>> Watchers;
+        };
+        auto flush = make_shared<Flush>();
+        flush->Changes = std::move(changes);
+        unordered_map<Hash, pair<weak_ptr<ChatRoom>, vector<uint32_t>>> byRoom;
+        for (uint32_t c = 0; c < flush->Changes.size(); c++)
+            for (auto &[roomID, entry]: *flush->Changes[c].first->RoomsSnapshot()) {
+                auto &[handle, roomChanges] = byRoom[roomID];
+                handle = entry.Room;
+                roomChanges.push_back(c);
+            }
+        vector<shared_ptr<ChatRoom>> rooms;
+        for (auto &[roomID, byEntry]: byRoom) {
+            auto &[handle, roomChanges] = byEntry;
+            auto room = handle.lock();
+            if (!room)
+                continue;
+            rooms.push_back(move(room));
+            flush->RoomChanges.push_back(std::move(roomChanges));
+        }
+        flush->Watchers.resize(rooms.size());
+
+        AcrossRooms(rooms, [this, flush](size_t i, const shared_ptr<ChatRoom> &room, Arena &) {
+            room->OnlineAccounts(*Online, flush->Watchers[i]);
+        }, [flush](Arena &scratch) {
+            // A watcher sharing several rooms with the accounts that changed hears about each once.
+            unordered_map<Account *, pair<shared_ptr<Account>, vector<uint32_t>>> told;
+            for (size_t r = 0; r < flush->Watchers.size(); r++)
+                for (auto &watcher: flush->Watchers[r]) {
+                    auto &[account, seen] = told[watcher.get()];
+                    account = watcher;
+                    seen.insert(seen.end(), flush->RoomChanges[r].begin(), flush->RoomChanges[r].end());
+                }
+
+            //format {count} ({accountID} {online})...
+            for (auto &[key, entry]: told) {
+                auto &[watcher, seen] = entry;
+                sort(seen.begin(), seen.end());
+                seen.erase(unique(seen.begin(), seen.end()), seen.end());
+                ArenaWriter entries(scratch);
+                size_t count = 0;
+                auto send = [&]() {
+                    ArenaWriter data(scratch, entries.Size() + 24);
+                    data << count << entries.View();
+                    watcher->Notify(ClientActionType::PresenceUpdate, data.View(), scratch);
+                    entries.Clear();
+                    count = 0;
+                };
+                for (uint32_t c: seen) {
+                    auto &[account, online] = flush->Changes[c];
+                    if (account == watcher)
+                        continue;
+                    entries << " "
+                            << account->ID
+                            << " "
+                            << (online ? 1 : 0);
+                    if (++count == PRESENCE_LIST_LIMIT)
+                        send();
                 }
+                if (count)
+                    send();
             }
-            //endregion
+        });
+    }
+
+    void Server::FlushUnread() {
+        auto roomIDs = Bumps->TakeRooms();
+        if (roomIDs.empty())
+            return;
+        TRACE_SPAN_ARG("FlushUnread", roomIDs.size());
+
+        // Per room, the sessions it passed over and how many messages each missed.
+        struct Flush {
+            vector<vector<pair<IntrusivePtr<Client>, Hash>>> Missed;
+        };
+        auto flush = make_shared<Flush>();
+        vector<shared_ptr<ChatRoom>> rooms;
+        for (Hash roomID: roomIDs) {
+            long long roomIndex;
+            if ((roomIndex = FindRoom(roomID)) != -1)
+                rooms.push_back(GetRoom(roomIndex));
+        }
+        flush->Missed.resize(rooms.size());
+
+        AcrossRooms(rooms, [flush](size_t i, const shared_ptr<ChatRoom> &room, Arena &) {
+            room->TakeBumps(flush->Missed[i]);
+        }, [flush, rooms](Arena &scratch) {
+            // A session passed over by several rooms hears about all of them at once.
+            unordered_map<Client *, pair<IntrusivePtr<Client>, vector<pair<size_t, Hash>>>> told;
+            for (size_t r = 0; r < rooms.size(); r++)
+                for (auto &[session, unread]: flush->Missed[r]) {
+                    auto &[target, missed] = told[session.get()];
+                    target = session;
+                    missed.emplace_back(r, unread);
+                }
+
+            //format {count} ({roomID} {unread})...
+            for (auto &[key, entry]: told) {
+                auto &[session, missed] = entry;
+                ArenaWriter data(scratch, missed.size() * 24 + 8);
+                data << missed.size();
+                for (auto &[r, unread]: missed)
+                    data << " "
+                         << rooms[r]->ID
+                         << " "
+                         << unread;
+                session->PushEvent(ClientActionType::UnreadBump, data.View(), scratch);
+            }
+        });
+    }
+
+    void Server::SendUnreadCounts(const shared_ptr<Account> &account, const IntrusivePtr<Client> &connection,
+                                  Arena &scratch) {
+        auto joined = account->RoomsSnapshot();
+        if (joined->empty())
+            return;
+        //format {count} ({roomID} {unread})...
+        ArenaWriter data(scratch, joined->size() * 24 + 8);
+        data << joined->size();
+        for (auto &[roomID, entry]: *joined) {
+            Hash latest = 0;
+            if (auto room = entry.Room.lock())
+                latest = room->LatestSeq();
+            Hash cursor = account->ReadCursor(roomID);
+            data << " "
+                 << roomID
+                 << " "
+                 << (latest > cursor ? latest - cursor : 0);
+        }
+        connection->PushEvent(ClientActionType::UnreadCounts, data.View(), scratch);
+    }
+
+    pair<ResyncStatus, Hash> Server::ResyncRoom(const shared_ptr<Account> &requester, const shared_ptr<ChatRoom> &room,
+                                                const IntrusivePtr<Client> &connection, Hash seq, Arena &scratch) {
+        if (!room->FindMember(requester->ID))
+            return {ResyncStatus::Denied, 0};
+        Hash latest;
+        if (!room->SendSince(connection, seq, RESYNC_MAX_DELTA, latest, scratch))
+            return {ResyncStatus::Reload, latest};
+        return {ResyncStatus::Delta, latest};
+    }
+
+    ClientActionType Server::SendToRoom(const shared_ptr<Account> &requester, const shared_ptr<ChatRoom> &room,
+                                        const IntrusivePtr<Client> &connection, string_view msg, Arena &scratch,
+                                        ArenaWriter &response, ArenaWriter &log) {
+        if (!room->FindMember(requester->ID)) {
+            response << "'You must be a member of a chatroom to send a message in it. Aborted'";
+            log << "User ("
+                << requester->DisplayName
+                << "#"
+                << requester->ID
+                << ") had requested to send a message in a room they are not a member of. "
+                   "Request Denied; Aborted";
+            return general::ClientActionType::InformFailure;
         }
+        Hash msgID = msgCount.fetch_add(1) + 1;
+        EmplaceMessage(msgID, tuple<Hash, Hash, string>(room->ID, requester->ID, string(msg)));
+        Hash seq = room->PushMessage(msgID, requester->ID, msg, scratch, Fanout.get(), connection.get());
+        requester->AdvanceRead(room->ID, seq);
+        if (room->QueueBump())
+            Bumps->Queue(room->ID);
+
+        response << msgID
+                 << " "
+                 << seq
+                 << " 'Message sent'";
+        log << "User ("
+            << requester->DisplayName
+            << "#"
+            << requester->ID
+            << ") had requested to send a message in a chatroom. Request Approved; Message {"
+            << msgID
+            << ">"
+            << msg
+            << ") Was sent in room ["
+            << room->DisplayName
+            << "#"
+            << room->ID
+            << "]";
+        return general::ClientActionType::InformSuccess;
     }
 
-    void Server::LogMessage(const string &msg) {
-        stringstream ss;
-        string s_time;
+    void Server::SendBatchToRoom(const shared_ptr<Account> &requester, const shared_ptr<ChatRoom> &room,
+                                 const IntrusivePtr<Client> &connection, const SendMessagesPayload &payload,
+                                 const vector<size_t> &which, pair<Hash, Hash> *results, Arena &scratch) {
+        if (!room->FindMember(requester->ID)) {
+            for (size_t i: which)
+                results[i] = {0, 0};
+            return;
+        }
+        // One block of ids for the whole batch keeps them in order within the room.
+        Hash msgID = msgCount.fetch_add(which.size()) + 1;
+        for (size_t i: which) {
+            string_view msg = payload.Messages[i].second;
+            EmplaceMessage(msgID, tuple<Hash, Hash, string>(room->ID, requester->ID, string(msg)));
+            results[i] = {msgID, room->PushMessage(msgID, requester->ID, msg, scratch, Fanout.get(),
+                                                   connection.get())};
+            msgID++;
+        }
+        requester->AdvanceRead(room->ID, results[which.back()].second);
+        if (room->QueueBump())
+            Bumps->Queue(room->ID);
+    }
+
+    void Server::LogMessage(string_view msg) {
+        LogMessage(msg, RequestArena);
+    }
+
+    void Server::LogMessage(string_view msg, Arena &scratch) {
+        ArenaWriter ss(scratch, msg.size() + 48);
+        string_view s_time;
+        char buf[64];
         {
             char fmt[64];
-            char buf[64];
             struct timeval tv{};
             struct tm *tm;
 
@@ -874,22 +2019,24 @@ namespace src::classes::server {
             tm = localtime(&tv.tv_sec);
             strftime(fmt, sizeof(fmt), "%H:%M:%S:%%06u", tm);
             snprintf(buf, sizeof(buf), fmt, tv.tv_usec);
-            s_time = string(buf);
+            s_time = string_view(buf);
         }
+        // Room shards log concurrently with the reactor, the line number has to be taken under the lock.
+        lock_guard<ProfiledMutex> guard(*m_Log);
         ss << "[LOG(" << ServerLog.size() + 1 << ")]:" << "[" << s_time << "]=" << msg;
-        ServerLog.push_back(ss.str());
+        ServerLog.emplace_back(ss.View());
     }
 
-    void Server::PushConnection(shared_ptr<Client> client) {
+    void Server::PushConnection(IntrusivePtr<Client> client) {
         {
-            lock_guard<mutex> guard(*m_Connections);
+            lock_guard<ProfiledMutex> guard(*m_Connections);
             Connections.push_back(client);
         }
     }
 
-    shared_ptr<Client> Server::GetConnection(long long i) {
+    IntrusivePtr<Client> Server::GetConnection(long long i) {
         {
-            lock_guard<mutex> guard(*m_Connections);
+            lock_guard<ProfiledMutex> guard(*m_Connections);
             if (i < 0)
                 i = (long) Connections.size() + i;
             return Connections[i];
@@ -898,14 +2045,14 @@ namespace src::classes::server {
 
     void Server::PushAccount(shared_ptr<Account> account) {
         {
-            lock_guard<mutex> guard(*m_Accounts);
+            lock_guard<ProfiledMutex> guard(*m_Accounts);
             Accounts.push_back(move(account));
         }
     }
 
     shared_ptr<Account> Server::GetAccount(long long i) {
         {
-            lock_guard<mutex> guard(*m_Accounts);
+            lock_guard<ProfiledMutex> guard(*m_Accounts);
             if (i < 0)
                 i = (long) Accounts.size() + i;
         }
@@ -914,14 +2061,14 @@ namespace src::classes::server {
 
     void Server::PushRoom(const shared_ptr<ChatRoom> &room) {
         {
-            lock_guard<mutex> guard(*m_Rooms);
+            lock_guard<ProfiledMutex> guard(*m_Rooms);
             Rooms.push_back(room);
         }
     }
 
     shared_ptr<ChatRoom> Server::GetRoom(long long i) {
         {
-            lock_guard<mutex> guard(*m_Rooms);
+            lock_guard<ProfiledMutex> guard(*m_Rooms);
             if (i < 0)
                 i = (long) Rooms.size() + i;
             return Rooms[i];
@@ -930,14 +2077,14 @@ namespace src::classes::server {
 
     void Server::PushLog(string msg) {
         {
-            lock_guard<mutex> guard(*m_Log);
+            lock_guard<ProfiledMutex> guard(*m_Log);
             ServerLog.push_back(move(msg));
         }
     }
 
     string Server::GetLog(unsigned long i) {
         {
-            lock_guard<mutex> guard(*m_Log);
+            lock_guard<ProfiledMutex> guard(*m_Log);
             if (i < 0)
                 i = ServerLog.size() + i;
             return ServerLog[i];
@@ -946,21 +2093,21 @@ namespace src::classes::server {
 
     void Server::EmplaceMessage(Hash h, tuple<Hash, Hash, string> cont) {
         {
-            lock_guard<mutex> guard(*m_Messages);
+            lock_guard<ProfiledMutex> guard(*m_Messages);
             Messages.emplace(h, move(cont));
         }
     }
 
     tuple<Hash, Hash, string> Server::KGetMessage(Hash id) {
         {
-            lock_guard<mutex> guard(*m_Messages);
+            lock_guard<ProfiledMutex> guard(*m_Messages);
             return Messages[id];
         }
     }
 
     vector<tuple<Hash, Hash, string>> Server::V1GetMessage(Hash room) {
         {
-            lock_guard<mutex> guard(*m_Messages);
+            lock_guard<ProfiledMutex> guard(*m_Messages);
             vector<tuple<Hash, Hash, string>> res;
             for (auto &cur: Messages)
                 if (get<0>(cur.second) == room)
@@ -971,7 +2118,7 @@ namespace src::classes::server {
 
     vector<tuple<Hash, Hash, string>> Server::V2GetMessage(Hash sender) {
         {
-            lock_guard<mutex> guard(*m_Messages);
+            lock_guard<ProfiledMutex> guard(*m_Messages);
             vector<tuple<Hash, Hash, string>> res;
             for (auto &cur: Messages)
                 if (get<1>(cur.second) == sender)
@@ -982,7 +2129,7 @@ namespace src::classes::server {
 
     vector<tuple<Hash, Hash, string>> Server::V3GetMessage(string content) {
         {
-            lock_guard<mutex> guard(*m_Messages);
+            lock_guard<ProfiledMutex> guard(*m_Messages);
             vector<tuple<Hash, Hash, string>> res;
             for (auto &cur: Messages)
                 if (get<2>(cur.second) == content)
@@ -991,42 +2138,65 @@ namespace src::classes::server {
         }
     }
 
-    void Server::PushRequest(Hash id, const shared_ptr<ServerRequest> &req) {
+    void Server::PushRequest(Hash id, const IntrusivePtr<ServerRequest> &req) {
         {
-            lock_guard<mutex> guard(*m_Requests);
+            lock_guard<ProfiledMutex> guard(*m_Requests);
             Requests.emplace(id, req);
         }
     }
 
-    tuple<Hash, shared_ptr<ServerRequest>> Server::PopRequest() {
+    tuple<Hash, IntrusivePtr<ServerRequest>> Server::PopRequest() {
         {
-            lock_guard<mutex> guard(*m_Requests);
+            lock_guard<ProfiledMutex> guard(*m_Requests);
             auto tmp = Requests.front();
             Requests.pop();
             return tmp;
         }
     }
 
-    void Server::PushResponse(Hash id, const shared_ptr<ClientResponse> &resp) {
+    void Server::PushResponse(Hash id, const IntrusivePtr<ClientResponse> &resp) {
         {
-            lock_guard<mutex> guard(*m_Responses);
+            lock_guard<ProfiledMutex> guard(*m_Responses);
             Responses.emplace(id, resp);
         }
     }
 
-    tuple<Hash, shared_ptr<ClientResponse>> Server::PopResponse() {
+    tuple<Hash, IntrusivePtr<ClientResponse>> Server::PopResponse() {
         {
-            lock_guard<mutex> guard(*m_Responses);
+            lock_guard<ProfiledMutex> guard(*m_Responses);
             auto tmp = Responses.front();
             Responses.pop();
             return tmp;
         }
     }
 
+    void Server::FindAccounts(const Hash *ids, size_t count, vector<shared_ptr<Account>> &out) {
+        out.assign(count, nullptr);
+        unordered_map<Hash, size_t> wanted;
+        for (size_t i = 0; i < count; i++)
+            wanted.try_emplace(ids[i], i);
+        {
+            lock_guard<ProfiledMutex> guard(*m_Accounts);
+            size_t left = wanted.size();
+            for (auto &account: Accounts) {
+                auto found = wanted.find(account->ID);
+                if (found == wanted.end())
+                    continue;
+                out[found->second] = account;
+                if (--left == 0)
+                    break;
+            }
+        }
+        // An id named twice shares the first one's lookup.
+        for (size_t i = 0; i < count; i++)
+            if (!out[i])
+                out[i] = out[wanted[ids[i]]];
+    }
+
     long long Server::FindRoom(Hash id) {
         function<unsigned long()> roomsSize = [this]() -> unsigned long {
             {
-                lock_guard<mutex> guard(*m_Rooms);
+                lock_guard<ProfiledMutex> guard(*m_Rooms);
                 return Rooms.size();
             }
         };
@@ -1039,7 +2209,7 @@ namespace src::classes::server {
     long long Server::FindAccount(Hash id) {
         function<unsigned long()> accountsSize = [this]() -> unsigned long {
             {
-                lock_guard<mutex> guard(*m_Accounts);
+                lock_guard<ProfiledMutex> guard(*m_Accounts);
                 return Accounts.size();
             }
         };
@@ -1049,8 +2219,8 @@ namespace src::classes::server {
         return -1;
     }
 
-    shared_ptr<Client> Server::GetClientByFd(int fd) {
-        lock_guard<mutex> guard(*m_Connections);
+    IntrusivePtr<Client> Server::GetClientByFd(int fd) {
+        lock_guard<ProfiledMutex> guard(*m_Connections);
         for (auto &client: Connections) {
             if (client->FileDescriptor == fd) {
                 return client;
@@ -1060,13 +2230,17 @@ namespace src::classes::server {
     }
 
     void Server::RemoveConnection(int fd) {
-        lock_guard<mutex> guard(*m_Connections);
-        auto it = remove_if(Connections.begin(), Connections.end(),
-                            [fd](const shared_ptr<Client> &client) {
-                                return client->FileDescriptor == fd;
-                            });
+        lock_guard<ProfiledMutex> guard(*m_Connections);
+        // A descriptor belongs to at most one live connection, so stop at the first match.
+        auto it = find_if(Connections.begin(), Connections.end(),
+                          [fd](const IntrusivePtr<Client> &client) {
+                              return client->FileDescriptor == fd;
+                          });
         if (it != Connections.end()) {
-            Connections.erase(it, Connections.end());
+            Parked.erase((*it)->ID);
+            if ((*it)->Owner && (*it)->Owner->Detach(*it))
+                Online->SetOnline((*it)->Owner, false);
+            Connections.erase(it);
         }
     }
 
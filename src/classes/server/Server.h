@@ -10,6 +10,7 @@
 #include <sstream>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <tuple>
 #include <queue>
 #include <atomic>
@@ -21,11 +22,22 @@
 #include <limits>
 #include <unistd.h>
 #include <mutex>
+#include <chrono>
 
 #include "./Account.h"
 #include "./ChatRoom.h"
 #include "./Client.h"
+#include "./Metrics.h"
+#include "./Trace.h"
+#include "./ProfiledMutex.h"
+#include "./FanoutPool.h"
+#include "./RoomShards.h"
+#include "./KeyVerifier.h"
+#include "./Presence.h"
+#include "./EventCoalescer.h"
+#include "./UnreadBumps.h"
 #include "../general/ClientResponse.h"
+#include "../general/RequestParser.h"
 
 using namespace std;
 using namespace src::classes::general;
@@ -36,12 +48,20 @@ typedef struct epoll_event EpollEvent;
 
 const int MAX_EVENTS= 16;
 
+namespace src::Testing {
+    class Benchmarks;
+    class AllocationTest;
+    class BehaviourTest;
+}
+
 namespace src::classes::general {
-    struct ServerRequest {
+    struct ServerRequest : public RefCounted<ServerRequest> {
     public:
         ServerActionType Type;
         int TargetFD;
         string Data;
+        // Stands in for a frame too large for the inbound buffer, Enact answers it with a failure in turn.
+        bool Oversized = false;
 
         ServerRequest();
 
@@ -55,34 +75,13 @@ namespace src::classes::general {
 
         [[nodiscard]] string Serialize() const;
 
-        template<typename... Args>
-        static ServerRequest Deserialize(const string &inp) {
-            stringstream input(inp);
-            string token;
-
-            input >> token;
-            if (token[0] != DELIMITER_START)
-                return {};
-
-            int typeInt;
-            input >> typeInt;
-            auto type = static_cast<ServerActionType>(typeInt);
-
-            int fd;
-            input >> fd;
-
-            input >> token;
-            if (token[0] != DATA_START)
+        static ServerRequest Deserialize(string_view inp) {
+            RequestView view{};
+            if (!RequestParser::ParseFrame(inp, view))
                 return {};
 
-            string data;
-            getline(input, data);
-
-            if (data.find(DATA_END) != string::npos)
-                data.erase(data.find(DATA_END));
-
-            ServerRequest result(type, fd);
-            result.Data = data;
+            ServerRequest result(view.Type, view.TargetFD);
+            result.Data = view.Data;
 
             return result;
         }
@@ -91,44 +90,73 @@ namespace src::classes::general {
 
 namespace src::classes::server {
     class Server {
+        friend class src::Testing::Benchmarks;
+        friend class src::Testing::AllocationTest;
+        friend class src::Testing::BehaviourTest;
     public:
-        vector<shared_ptr<Client>> Connections;
+        vector<IntrusivePtr<Client>> Connections;
         vector<shared_ptr<Account>> Accounts;
         vector<shared_ptr<ChatRoom>> Rooms;
         vector<string> ServerLog;
         map<Hash,tuple<Hash,Hash,string>> Messages;
-        queue<tuple<Hash,shared_ptr<ClientResponse>>> Responses;
-        queue<tuple<Hash,shared_ptr<ServerRequest>>> Requests;
+        queue<tuple<Hash,IntrusivePtr<ClientResponse>>> Responses;
+        queue<tuple<Hash,IntrusivePtr<ServerRequest>>> Requests;
 
         int FileDescriptor;
         int EpollFD;
+        int MetricsFD;
+        int VerifierFD;
+        int PresenceFD;
+        int CoalesceFD;
+        int BumpsFD;
         string ServerName;
         thread *ServerThread;
+        thread *MetricsThread;
+        shared_ptr<Metrics> Stats;
+        unique_ptr<FanoutPool> Fanout;
+        // Owners of the rooms when the server runs sharded, null when every room lives on the reactor.
+        unique_ptr<RoomShards> Shards;
+        // Hashes and verifies keys for Register and Login, completions come back through the epoll loop.
+        unique_ptr<KeyVerifier> Verifier;
+        // Which accounts have a live session, kept up by the reactor on login, logout and disconnect.
+        unique_ptr<Presence> Online;
+        // Rooms whose messages passed sessions by, waiting for their UnreadBump frames.
+        unique_ptr<UnreadBumps> Bumps;
+        // Holds pushed events per session for one EventBatch frame, null while coalescing is off.
+        unique_ptr<EventCoalescer> Coalescing;
+        // PBKDF2 iterations for keys registered from now on, existing records keep their own.
+        unsigned KeyCost;
+        // Scratch space for the reactor's handlers, reset after every EnactRespond batch.
+        Arena RequestArena;
 
         Server();
         ~Server();
-        explicit Server(string  name);
+        explicit Server(string  name, unsigned roomShards = ROOM_SHARDS);
 
         void Start();
         void Stop();
+        // Turns on coalescing of pushed events for connections accepted from now on, see EventCoalescer.
+        void EnableCoalescing(unsigned windowMicros, unsigned maxEvents);
         atomic<Hash> msgCount;
         shared_ptr<atomic<bool>> sharedStatus;
         weak_ptr<atomic<bool>> Status;
-        shared_ptr<mutex> m_Connections;
-        shared_ptr<mutex> m_Accounts;
-        shared_ptr<mutex> m_Rooms;
-        shared_ptr<mutex> m_Log;
-        shared_ptr<mutex> m_Messages;
-        shared_ptr<mutex> m_Responses;
-        shared_ptr<mutex> m_Requests;
+        shared_ptr<ProfiledMutex> m_Connections;
+        shared_ptr<ProfiledMutex> m_Accounts;
+        shared_ptr<ProfiledMutex> m_Rooms;
+        shared_ptr<ProfiledMutex> m_Log;
+        shared_ptr<ProfiledMutex> m_Messages;
+        shared_ptr<ProfiledMutex> m_Responses;
+        shared_ptr<ProfiledMutex> m_Requests;
     private:
 
-        void PushConnection(shared_ptr<Client> client);
-        shared_ptr<Client> GetConnection(long long i);
+        void PushConnection(IntrusivePtr<Client> client);
+        IntrusivePtr<Client> GetConnection(long long i);
 
         void PushAccount(shared_ptr<Account> account);
         shared_ptr<Account> GetAccount(long long i);
         long long FindAccount(Hash id);
+        // Looks every id up in one pass over the accounts, 'out[i]' is null when 'ids[i]' has none.
+        void FindAccounts(const Hash *ids, size_t count, vector<shared_ptr<Account>> &out);
 
         void PushRoom(const shared_ptr<ChatRoom>& room);
         shared_ptr<ChatRoom> GetRoom(long long i);
@@ -143,19 +171,88 @@ namespace src::classes::server {
         vector<tuple<Hash,Hash,string>> V2GetMessage(Hash sender);
         vector<tuple<Hash,Hash,string>> V3GetMessage(string content);
 
-        void PushRequest(Hash id, const shared_ptr<ServerRequest>& req);
-        tuple<Hash,shared_ptr<ServerRequest>> PopRequest();
+        void PushRequest(Hash id, const IntrusivePtr<ServerRequest>& req);
+        tuple<Hash,IntrusivePtr<ServerRequest>> PopRequest();
 
-        void PushResponse(Hash id, const shared_ptr<ClientResponse>& resp);
-        tuple<Hash, shared_ptr<ClientResponse>> PopResponse();
+        void PushResponse(Hash id, const IntrusivePtr<ClientResponse>& resp);
+        tuple<Hash, IntrusivePtr<ClientResponse>> PopResponse();
 
-        void Setup();
+        void Setup(unsigned roomShards);
+        // Registers a descriptor with the reactor's epoll for input, the server cannot run without it.
+        void Watch(int fd);
+        void SetupMetricsEndpoint();
+        void ServeMetrics();
+        void UpdateGauges();
         void EnactRespond();
-        void LogMessage(const string& msg);
-
-        shared_ptr<Client> GetClientByFd(int fd);
+        void Enact(Hash ConnectionID, const IntrusivePtr<ServerRequest> &request);
+        // Enacts the requests held back behind a connection's login or registration.
+        void Resume(Hash ConnectionID);
+        void LogMessage(string_view msg);
+        void LogMessage(string_view msg, Arena &scratch);
+        // Logs and answers one enacted request, from the reactor or from a room shard.
+        void Conclude(const IntrusivePtr<Client> &connection, ServerActionType type, ClientActionType outcome,
+                      chrono::steady_clock::time_point started, string_view response, string_view log,
+                      Arena &scratch);
+
+        // Room-side halves of the member and message handlers, run by whoever owns the room.
+        ClientActionType AddToRoom(const shared_ptr<Account> &requester, const shared_ptr<ChatRoom> &room,
+                                   const shared_ptr<Account> &member, Arena &scratch,
+                                   ArenaWriter &response, ArenaWriter &log);
+        ClientActionType RemoveFromRoom(const shared_ptr<Account> &requester, const shared_ptr<ChatRoom> &room,
+                                        Hash memID, const shared_ptr<Account> &member, Arena &scratch,
+                                        ArenaWriter &response, ArenaWriter &log);
+        // Bulk variants: one room update for every account named, one reply with an outcome for each.
+        ClientActionType AddMembersToRoom(const shared_ptr<Account> &requester, const shared_ptr<ChatRoom> &room,
+                                          const vector<Hash> &ids, const vector<shared_ptr<Account>> &members,
+                                          Arena &scratch, ArenaWriter &response, ArenaWriter &log);
+        ClientActionType RemoveMembersFromRoom(const shared_ptr<Account> &requester, const shared_ptr<ChatRoom> &room,
+                                               const vector<Hash> &ids, const vector<shared_ptr<Account>> &members,
+                                               Arena &scratch, ArenaWriter &response, ArenaWriter &log);
+        ClientActionType HistoryFromRoom(const shared_ptr<Account> &requester, const shared_ptr<ChatRoom> &room,
+                                         const IntrusivePtr<Client> &connection, Hash cursor, size_t limit,
+                                         Arena &scratch, ArenaWriter &response, ArenaWriter &log);
+        ClientActionType SendToRoom(const shared_ptr<Account> &requester, const shared_ptr<ChatRoom> &room,
+                                    const IntrusivePtr<Client> &connection, string_view msg, Arena &scratch,
+                                    ArenaWriter &response, ArenaWriter &log);
+        // Sends the messages 'which' indexes in 'payload' to 'room', in order. 'results' gets each one's
+        // (message id, sequence number), or zeros when the requester is not a member.
+        void SendBatchToRoom(const shared_ptr<Account> &requester, const shared_ptr<ChatRoom> &room,
+                             const IntrusivePtr<Client> &connection, const SendMessagesPayload &payload,
+                             const vector<size_t> &which, pair<Hash, Hash> *results, Arena &scratch);
+        // Sends 'requester' what they missed in 'room' after sequence number 'seq', returns the outcome
+        // and the room's latest sequence number.
+        pair<ResyncStatus, Hash> ResyncRoom(const shared_ptr<Account> &requester, const shared_ptr<ChatRoom> &room,
+                                            const IntrusivePtr<Client> &connection, Hash seq, Arena &scratch);
+        ClientActionType PresenceInRoom(const shared_ptr<Account> &requester, const shared_ptr<ChatRoom> &room,
+                                        ArenaWriter &response, ArenaWriter &log);
+        ClientActionType SubscribeToRoom(const shared_ptr<Account> &requester, const shared_ptr<ChatRoom> &room,
+                                         const IntrusivePtr<Client> &connection, ArenaWriter &response,
+                                         ArenaWriter &log);
+
+        // Runs 'each' for every room on whoever owns it, then 'done' once on whichever of them finished
+        // last (right away when there are none). A null room is handed to 'each' on the reactor.
+        void AcrossRooms(const vector<shared_ptr<ChatRoom>> &rooms,
+                         function<void(size_t, const shared_ptr<ChatRoom> &, Arena &)> each,
+                         function<void(Arena &)> done);
+        // Tells the online members sharing a room with the accounts that changed state during the last
+        // window, one PresenceUpdate frame per watcher.
+        void FlushPresence();
+        // Tells every session passed over by the rooms queued during the last window how many messages
+        // it missed in each, one UnreadBump frame per session.
+        void FlushUnread();
+        // Writes 'connection' the unread count of each of the account's rooms as one UnreadCounts frame,
+        // from the rooms' latest sequence numbers and the account's read cursors; no history is read.
+        void SendUnreadCounts(const shared_ptr<Account> &account, const IntrusivePtr<Client> &connection,
+                              Arena &scratch);
+
+        IntrusivePtr<Client> GetClientByFd(int fd);
+
+        // Requests of connections with a login or registration in flight, reactor-only.
+        unordered_map<Hash, vector<IntrusivePtr<ServerRequest>>> Parked;
 
         void RemoveConnection(int fd);
+
+        static bool IsLoopback(const sockaddr_storage &addr);
     };
 } // server
 
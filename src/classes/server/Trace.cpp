@@ -0,0 +1,65 @@
+#include "Trace.h"
+
+#include <chrono>
+#include <iomanip>
+
+namespace src::classes::server {
+    mutex Tracer::m_Buffers = {};
+    vector<shared_ptr<TraceBuffer>> Tracer::Buffers = {};
+
+    unsigned long long Tracer::NowNs() {
+        return (unsigned long long) chrono::duration_cast<chrono::nanoseconds>(
+                chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    TraceBuffer *Tracer::LocalBuffer() {
+        // The registry keeps the buffer alive after its thread exits, so its spans can still be dumped.
+        thread_local TraceBuffer *local = nullptr;
+        if (!local) {
+            lock_guard<mutex> guard(m_Buffers);
+            Buffers.push_back(make_shared<TraceBuffer>((int) Buffers.size() + 1));
+            local = Buffers.back().get();
+        }
+        return local;
+    }
+
+    void Tracer::Record(const char *name, unsigned long long startNs, unsigned long long endNs,
+                        unsigned long long arg) {
+        TraceBuffer *buffer = LocalBuffer();
+        unsigned long long head = buffer->Head.load(memory_order_relaxed);
+        TraceEvent &slot = buffer->Events[head % TraceBuffer::CAPACITY];
+        slot.Name.store(name, memory_order_relaxed);
+        slot.StartNs.store(startNs, memory_order_relaxed);
+        slot.DurationNs.store(endNs - startNs, memory_order_relaxed);
+        slot.Arg.store(arg, memory_order_relaxed);
+        buffer->Head.store(head + 1, memory_order_release);
+    }
+
+    void Tracer::DumpChromeTrace(ostream &out) {
+        vector<shared_ptr<TraceBuffer>> buffers;
+        {
+            lock_guard<mutex> guard(m_Buffers);
+            buffers = Buffers;
+        }
+
+        bool first = true;
+        out << fixed << setprecision(3) << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        for (auto &buffer: buffers) {
+            unsigned long long head = buffer->Head.load(memory_order_acquire);
+            unsigned long long from = head > TraceBuffer::CAPACITY ? head - TraceBuffer::CAPACITY : 0;
+            for (unsigned long long i = from; i < head; i++) {
+                const TraceEvent &cur = buffer->Events[i % TraceBuffer::CAPACITY];
+                const char *name = cur.Name.load(memory_order_relaxed);
+                if (!name)
+                    continue;
+                out << (first ? "" : ",") << "\n{\"name\":\"" << name
+                    << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->ThreadID
+                    << ",\"ts\":" << (double) cur.StartNs.load(memory_order_relaxed) / 1000.0
+                    << ",\"dur\":" << (double) cur.DurationNs.load(memory_order_relaxed) / 1000.0
+                    << ",\"args\":{\"arg\":" << cur.Arg.load(memory_order_relaxed) << "}}";
+                first = false;
+            }
+        }
+        out << "\n]}\n";
+    }
+} // server
@@ -0,0 +1,74 @@
+#ifndef EPOLLCHAT_TRACE_H
+#define EPOLLCHAT_TRACE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <ostream>
+
+using namespace std;
+
+namespace src::classes::server {
+
+    struct TraceEvent {
+        atomic<const char *> Name{nullptr};
+        atomic<unsigned long long> StartNs{0};
+        atomic<unsigned long long> DurationNs{0};
+        atomic<unsigned long long> Arg{0};
+    };
+
+    // Fixed-size ring of the most recent spans of one thread. Only the owning thread writes,
+    // the dumper reads concurrently, hence the relaxed atomics in TraceEvent.
+    class TraceBuffer {
+    public:
+        static const unsigned long long CAPACITY = 1 << 14;
+
+        int ThreadID;
+        atomic<unsigned long long> Head{0};
+        TraceEvent Events[CAPACITY];
+
+        explicit TraceBuffer(int tid) : ThreadID(tid) {}
+    };
+
+    class Tracer {
+    public:
+        static unsigned long long NowNs();
+        static void Record(const char *name, unsigned long long startNs, unsigned long long endNs,
+                           unsigned long long arg);
+
+        // Writes every buffered span as Chrome/Perfetto trace JSON ("X" complete events, microseconds).
+        static void DumpChromeTrace(ostream &out);
+    private:
+        static mutex m_Buffers;
+        static vector<shared_ptr<TraceBuffer>> Buffers;
+        static TraceBuffer *LocalBuffer();
+    };
+
+    class TraceSpan {
+    public:
+        explicit TraceSpan(const char *name, unsigned long long arg = 0) :
+                m_Name(name), m_Arg(arg), m_Start(Tracer::NowNs()) {}
+        ~TraceSpan() { Tracer::Record(m_Name, m_Start, Tracer::NowNs(), m_Arg); }
+        TraceSpan(const TraceSpan &) = delete;
+        TraceSpan &operator=(const TraceSpan &) = delete;
+    private:
+        const char *m_Name;
+        unsigned long long m_Arg;
+        unsigned long long m_Start;
+    };
+
+} // server
+
+// Spans are compiled in only with -DECHAT_TRACING=ON, otherwise they cost nothing.
+#define ECHAT_TRACE_CONCAT_(a, b) a##b
+#define ECHAT_TRACE_CONCAT(a, b) ECHAT_TRACE_CONCAT_(a, b)
+#ifdef ECHAT_TRACING
+#define TRACE_SPAN(name) src::classes::server::TraceSpan ECHAT_TRACE_CONCAT(_traceSpan, __LINE__)(name)
+#define TRACE_SPAN_ARG(name, arg) src::classes::server::TraceSpan ECHAT_TRACE_CONCAT(_traceSpan, __LINE__)(name, arg)
+#else
+#define TRACE_SPAN(name) ((void) 0)
+#define TRACE_SPAN_ARG(name, arg) ((void) 0)
+#endif
+
+#endif //EPOLLCHAT_TRACE_H
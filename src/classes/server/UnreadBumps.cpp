@@ -0,0 +1,22 @@
+#include "UnreadBumps.h"
+
+namespace src::classes::server {
+
+    void UnreadBumps::Queue(Hash roomID) {
+        lock_guard<mutex> guard(m_Rooms);
+        Rooms.push_back(roomID);
+        Timer.Arm(UNREAD_FLUSH_MS * 1000UL);
+    }
+
+    int UnreadBumps::FlushFD() const {
+        return Timer.FD();
+    }
+
+    vector<Hash> UnreadBumps::TakeRooms() {
+        lock_guard<mutex> guard(m_Rooms);
+        Timer.Expire();
+        vector<Hash> rooms;
+        rooms.swap(Rooms);
+        return rooms;
+    }
+} // server
@@ -0,0 +1,43 @@
+#ifndef EPOLLCHAT_UNREADBUMPS_H
+#define EPOLLCHAT_UNREADBUMPS_H
+
+#include <vector>
+#include <mutex>
+
+#include "../general/Constants.h"
+#include "FlushTimer.h"
+
+using namespace std;
+using namespace src::classes::general;
+
+// How long a room's passed-over messages are counted before the sessions that missed them are told.
+#define UNREAD_FLUSH_MS 250
+
+namespace src::classes::server {
+
+    // Rooms whose messages passed some session by, because it views other rooms. Their owners queue
+    // them here at most once per window; once it is over the reactor asks every room for its count
+    // and sends each such session one UnreadBump frame for all of its rooms.
+    class UnreadBumps {
+    public:
+        UnreadBumps() = default;
+        UnreadBumps(const UnreadBumps &) = delete;
+        UnreadBumps &operator=(const UnreadBumps &) = delete;
+
+        // Called from any thread by the owner of the room, see ChatRoom::QueueBump.
+        void Queue(Hash roomID);
+        // Readable once the window of the oldest queued room is over, meant to be registered with the
+        // reactor's epoll.
+        [[nodiscard]] int FlushFD() const;
+        // Reactor-only. The rooms queued since the previous call.
+        vector<Hash> TakeRooms();
+    private:
+        mutex m_Rooms;
+        vector<Hash> Rooms;
+        // Guarded by m_Rooms.
+        FlushTimer Timer;
+    };
+
+} // server
+
+#endif //EPOLLCHAT_UNREADBUMPS_H
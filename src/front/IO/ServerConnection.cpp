@@ -61,26 +61,29 @@ namespace src::front::IO {
         });
 
         t_Receiver = new thread([this]() {
+            // A recv may end mid-frame or hold several frames, history batches alone span many reads.
+            string pending;
             while (!f_Stop->load()) {
-                char buf[1024] = {0};
-                auto st_recv = recv(FDConnection, buf, sizeof(buf) - 1, 0);
+                char buf[IO_BUFFER_SIZE];
+                auto st_recv = recv(FDConnection, buf, sizeof(buf), 0);
                 if (st_recv > 0) {
-                    buf[st_recv] = '\0';
-                    string received_data(buf);
-
-                    // Attempt to deserialize the response
-                    auto deserialized = make_shared<ClientResponse>(ClientResponse::Deserialize(received_data));
-
-                    if (f_AwaitStatus && f_AwaitStatus->load() == 0) {
-                        PushResp(deserialized, -1);
-                    } else if (deserialized->Type == classes::general::ClientActionType::InformSuccess ||
-                               deserialized->Type == classes::general::ClientActionType::InformFailure) {
-                        PushResp(deserialized, 0);
-                        f_AwaitStatus->store(-1);
-                    } else {
-                        if (!f_Stop || f_Stop->load())
+                    pending.append(buf, st_recv);
+                    size_t length;
+                    while ((length = RequestParser::FrameLength(pending)) > 0) {
+                        // Attempt to deserialize the response
+                        auto deserialized = make_shared<ClientResponse>(
+                                ClientResponse::Deserialize(pending.substr(0, length)));
+                        pending.erase(0, length);
+
+                        if (deserialized->Type == classes::general::ClientActionType::EventBatch) {
+                            // Pushed events the server coalesced, taken as if each had come on its own.
+                            vector<ClientResponse> events;
+                            ClientResponse::ParseEvents(deserialized->Data, deserialized->TargetFD, events);
+                            for (auto &event: events)
+                                if (!Dispatch(make_shared<ClientResponse>(std::move(event))))
+                                    return;
+                        } else if (!Dispatch(deserialized))
                             return;
-                        PushResp(deserialized, 1);
                     }
                 } else if (st_recv == 0) {
                     Stop();
@@ -95,6 +98,8 @@ namespace src::front::IO {
 
         t_Background = new thread([this](){
             while(!f_Stop->load()){
+                for (auto &ack: TakeAcks(false))
+                    PushReq(ack);
                 if(f_AwaitStatus->load()==0 && isLoggedIn){
                     auto current = PopResp();
                     if(!current || current->Type == classes::general::ClientActionType::NONE)
@@ -125,11 +130,55 @@ namespace src::front::IO {
                         if (event_GotMessage) {
                             Hash sID;
                             Hash rID;
+                            Hash seq;
                             string msg;
-                            ss_data >> rID >> sID;
+                            ss_data >> rID >> seq >> sID;
                             getline(ss_data,msg);
                             msg=msg.substr(1,msg.size()-2);
-                            event_GotMessage(sID,rID,msg);
+                            event_GotMessage(sID,rID,seq,msg);
+                        }
+                    }
+                    if(current->Type == classes::general::ClientActionType::PresenceUpdate) {
+                        if (event_PresenceChanged) {
+                            //format {count} ({accountID} {online})...
+                            size_t count = 0;
+                            ss_data >> count;
+                            vector<pair<Hash, bool>> changes;
+                            for (size_t i = 0; i < count && ss_data; i++) {
+                                Hash aID;
+                                int online;
+                                ss_data >> aID >> online;
+                                changes.emplace_back(aID, online != 0);
+                            }
+                            event_PresenceChanged(changes);
+                        }
+                    }
+                    if(current->Type == classes::general::ClientActionType::UnreadBump) {
+                        if (event_UnreadBump) {
+                            //format {count} ({roomID} {unread})...
+                            size_t count = 0;
+                            ss_data >> count;
+                            vector<pair<Hash, Hash>> bumps;
+                            for (size_t i = 0; i < count && ss_data; i++) {
+                                Hash rID, unread;
+                                ss_data >> rID >> unread;
+                                bumps.emplace_back(rID, unread);
+                            }
+                            event_UnreadBump(bumps);
+                        }
+                    }
+                    if(current->Type == classes::general::ClientActionType::UnreadCounts) {
+                        if (event_UnreadCounts) {
+                            //format {count} ({roomID} {unread})...
+                            size_t count = 0;
+                            ss_data >> count;
+                            vector<pair<Hash, Hash>> counts;
+                            for (size_t i = 0; i < count && ss_data; i++) {
+                                Hash rID, unread;
+                                ss_data >> rID >> unread;
+                                counts.emplace_back(rID, unread);
+                            }
+                            event_UnreadCounts(counts);
                         }
                     }
                 }
@@ -139,10 +188,41 @@ namespace src::front::IO {
     }
 
 
+    bool ServerConnection::Dispatch(const shared_ptr<ClientResponse> &response) {
+        if (response->Type == classes::general::ClientActionType::HistoryBatch) {
+            // Collected here and handed out by FetchHistory, the batches precede its reply.
+            Hash rID;
+            vector<tuple<Hash, Hash, Hash, string>> entries;
+            if (ClientResponse::ParseHistory(response->Data, rID, entries)) {
+                lock_guard<mutex> guard(*m_IngoingHistory);
+                auto &room = (*IngoingHistory)[rID];
+                move(entries.begin(), entries.end(), back_inserter(room));
+            }
+        } else if (f_AwaitStatus && f_AwaitStatus->load() == 0) {
+            PushResp(response, -1);
+        } else if (response->Type == classes::general::ClientActionType::InformSuccess ||
+                   response->Type == classes::general::ClientActionType::InformFailure) {
+            PushResp(response, 0);
+            f_AwaitStatus->store(-1);
+        } else {
+            if (!f_Stop || f_Stop->load())
+                return false;
+            PushResp(response, 1);
+        }
+        return true;
+    }
+
     void ServerConnection::Stop() {
         f_Stop->store(true);
 
         if (FDConnection != -1) {
+            // Whatever was read but not acknowledged yet goes out ahead of the termination request
+            for (auto &ack: TakeAcks(true)) {
+                string s_ack = ack.Serialize();
+                if (send(FDConnection, s_ack.c_str(), s_ack.size(), 0) == -1)
+                    perror("send");
+            }
+
             // Send the termination request first
             ServerRequest terminationRequest(ServerActionType::TerminateConnection, FDConnection, "");
             string s_ter = terminationRequest.Serialize();
@@ -175,6 +255,207 @@ namespace src::front::IO {
         return *resp;
     }
 
+    ClientResponse ServerConnection::FetchHistory(Hash roomID, Hash cursor, unsigned limit,
+                                                  vector<tuple<Hash, Hash, Hash, string>> &out) {
+        {
+            lock_guard<mutex> guard(*m_IngoingHistory);
+            IngoingHistory->erase(roomID);
+        }
+        stringstream ss{};
+        ss << roomID
+           << " "
+           << cursor
+           << " "
+           << limit;
+        auto resp = Request(ServerRequest(ServerActionType::FetchHistory, FDConnection, ss.str()));
+        {
+            lock_guard<mutex> guard(*m_IngoingHistory);
+            auto it = IngoingHistory->find(roomID);
+            if (it != IngoingHistory->end()) {
+                out = move(it->second);
+                IngoingHistory->erase(it);
+            }
+        }
+        return resp;
+    }
+
+    ClientResponse ServerConnection::Resync(const vector<pair<Hash, Hash>> &lastSeen,
+                                            map<Hash, vector<tuple<Hash, Hash, Hash, string>>> &delta,
+                                            vector<tuple<Hash, ResyncStatus, Hash>> &statuses) {
+        stringstream ss{};
+        {
+            lock_guard<mutex> guard(*m_IngoingHistory);
+            for (auto &[roomID, seq]: lastSeen) {
+                IngoingHistory->erase(roomID);
+                ss << roomID
+                   << " "
+                   << seq
+                   << " ";
+            }
+        }
+        auto resp = Request(ServerRequest(ServerActionType::Resync, FDConnection, ss.str()));
+        if (resp.Type != classes::general::ClientActionType::InformSuccess)
+            return resp;
+
+        //format {count} ({roomID} {status} {latest})... [message]
+        stringstream data{resp.Data};
+        size_t count = 0;
+        data >> count;
+        for (size_t i = 0; i < count && data; i++) {
+            Hash roomID, latest;
+            int status;
+            data >> roomID >> status >> latest;
+            statuses.emplace_back(roomID, static_cast<ResyncStatus>(status), latest);
+        }
+        {
+            lock_guard<mutex> guard(*m_IngoingHistory);
+            for (auto &[roomID, seq]: lastSeen) {
+                auto it = IngoingHistory->find(roomID);
+                if (it != IngoingHistory->end()) {
+                    delta[roomID] = move(it->second);
+                    IngoingHistory->erase(it);
+                }
+            }
+        }
+        return resp;
+    }
+
+    ClientResponse ServerConnection::ChangeMembers(ServerActionType type, Hash roomID, const vector<Hash> &ids,
+                                                   vector<pair<Hash, MemberStatus>> &results) {
+        ClientResponse resp(classes::general::ClientActionType::NONE, FDConnection);
+        for (size_t begin = 0; begin < ids.size(); begin += MEMBERS_MAX_IDS) {
+            stringstream ss{};
+            ss << roomID;
+            for (size_t i = begin; i < min(ids.size(), begin + MEMBERS_MAX_IDS); i++)
+                ss << " " << ids[i];
+            resp = Request(ServerRequest(type, FDConnection, ss.str()));
+            if (resp.Type != classes::general::ClientActionType::InformSuccess)
+                return resp;
+
+            //format {roomID} {count} ({memID} {status})... [message]
+            stringstream data{resp.Data};
+            size_t count = 0;
+            data >> roomID >> count;
+            for (size_t i = 0; i < count && data; i++) {
+                Hash id;
+                int status;
+                data >> id >> status;
+                results.emplace_back(id, static_cast<MemberStatus>(status));
+            }
+        }
+        return resp;
+    }
+
+    ClientResponse ServerConnection::SendMessages(const vector<pair<Hash, string>> &messages,
+                                                  vector<pair<Hash, Hash>> &ids) {
+        ClientResponse resp(classes::general::ClientActionType::NONE, FDConnection);
+        size_t base = ids.size();
+        size_t begin = 0;
+        while (begin < messages.size()) {
+            // Cut by size too: the server drops a frame that does not fit one of its inbound buffers.
+            stringstream ss{};
+            size_t end = begin;
+            size_t bytes = REQUEST_FRAME_OVERHEAD;
+            for (; end < messages.size() && end - begin < SEND_MAX_MESSAGES; end++) {
+                string entry = to_string(messages[end].first) + " " + to_string(messages[end].second.size()) + "|"
+                               + messages[end].second + " ";
+                if (end > begin && bytes + entry.size() > IO_BUFFER_SIZE)
+                    break;
+                bytes += entry.size();
+                ss << entry;
+            }
+            resp = Request(ServerRequest(ServerActionType::SendMessages, FDConnection, ss.str()));
+            if (resp.Type == classes::general::ClientActionType::NONE)
+                return resp;
+
+            //format {count} ({msgID} {seq})... [message]
+            stringstream data{resp.Data};
+            size_t count = 0;
+            data >> count;
+            for (size_t i = 0; i < count && data; i++) {
+                Hash msgID, seq;
+                data >> msgID >> seq;
+                ids.emplace_back(msgID, seq);
+            }
+            // A rejected request has no pairs, its messages were not sent.
+            ids.resize(base + end, {0, 0});
+            begin = end;
+        }
+        return resp;
+    }
+
+    ClientResponse ServerConnection::Subscribe(Hash roomID, Hash &latest) {
+        auto resp = Request(ServerRequest(ServerActionType::Subscribe, FDConnection, roomID));
+        if (resp.Type != classes::general::ClientActionType::InformSuccess)
+            return resp;
+
+        //format {roomID} {latestSeq} [message]
+        stringstream data{resp.Data};
+        data >> roomID >> latest;
+        return resp;
+    }
+
+    ClientResponse ServerConnection::Unsubscribe(Hash roomID) {
+        return Request(ServerRequest(ServerActionType::Unsubscribe, FDConnection, roomID));
+    }
+
+    void ServerConnection::AckRead(Hash roomID, Hash seq) {
+        lock_guard<mutex> guard(*m_PendingAcks);
+        if (PendingAcks->empty())
+            AcksDue = chrono::steady_clock::now() + chrono::milliseconds(ACK_FLUSH_MS);
+        Hash &pending = (*PendingAcks)[roomID];
+        pending = max(pending, seq);
+    }
+
+    void ServerConnection::FlushAcks() {
+        for (auto &ack: TakeAcks(true))
+            PushReq(ack);
+    }
+
+    vector<ServerRequest> ServerConnection::TakeAcks(bool all) {
+        map<Hash, Hash> acks;
+        {
+            lock_guard<mutex> guard(*m_PendingAcks);
+            if (PendingAcks->empty() || (!all && chrono::steady_clock::now() < AcksDue))
+                return {};
+            acks.swap(*PendingAcks);
+        }
+        //format ({roomID} {readSeq})...
+        vector<ServerRequest> requests;
+        stringstream ss{};
+        size_t inRequest = 0;
+        for (auto &[roomID, seq]: acks) {
+            ss << (inRequest ? " " : "")
+               << roomID
+               << " "
+               << seq;
+            if (++inRequest == ACK_MAX_ROOMS) {
+                requests.emplace_back(ServerActionType::AckRead, FDConnection, ss.str());
+                ss.str("");
+                inRequest = 0;
+            }
+        }
+        if (inRequest)
+            requests.emplace_back(ServerActionType::AckRead, FDConnection, ss.str());
+        return requests;
+    }
+
+    ClientResponse ServerConnection::QueryPresence(Hash roomID, size_t &online, size_t &members, vector<Hash> &ids) {
+        auto resp = Request(ServerRequest(ServerActionType::QueryPresence, FDConnection, roomID));
+        if (resp.Type != classes::general::ClientActionType::InformSuccess)
+            return resp;
+
+        //format {roomID} {online} {members} ({id})... [message]
+        stringstream data{resp.Data};
+        data >> roomID >> online >> members;
+        for (size_t i = 0; i < min(online, (size_t) PRESENCE_LIST_LIMIT) && data; i++) {
+            Hash id;
+            data >> id;
+            ids.push_back(id);
+        }
+        return resp;
+    }
+
 
     void ServerConnection::Setup() {
         f_Stop = make_shared<atomic<bool>>(false);
@@ -187,13 +468,17 @@ namespace src::front::IO {
         m_IngoingPopOrder = make_shared<mutex>();
         m_OutgoingRequests = make_shared<mutex>();
         m_RoomsInfo = make_shared<mutex>();
+        m_IngoingHistory = make_shared<mutex>();
+        m_PendingAcks = make_shared<mutex>();
 
         ConnectionInfo = make_shared<ClientInfo>();
         UserInfo = make_shared<AccountInfo>();
         RoomsInfo = make_shared<vector<ChatRoomInfo>>();
         IngoingResponses = make_shared<vector<shared_ptr<ClientResponse>>>();
         IngoingPopOrder = make_shared<vector<int>>();
+        IngoingHistory = make_shared<map<Hash, vector<tuple<Hash, Hash, Hash, string>>>>();
         OutgoingRequests = make_shared<vector<ServerRequest>>();
+        PendingAcks = make_shared<map<Hash, Hash>>();
 
         t_Sender = nullptr;
         t_Receiver = nullptr;
@@ -7,6 +7,8 @@
 #include <mutex>
 #include <queue>
 #include <functional>
+#include <map>
+#include <chrono>
 
 #include "../../classes/client/AccountInfo.h"
 #include "../../classes/client/ClientInfo.h"
@@ -19,6 +21,11 @@
 using namespace std;
 using namespace src::classes::client;
 
+// Bytes of a request frame besides its data: the delimiters, the type and the descriptor.
+#define REQUEST_FRAME_OVERHEAD 32
+// How long read acknowledgements are held, so one AckRead carries every room read meanwhile.
+#define ACK_FLUSH_MS 500
+
 namespace src::front::IO {
 
     class ServerConnection {
@@ -34,11 +41,47 @@ namespace src::front::IO {
         void Start(); // Starts connection ASYNC
         void Stop(); // Sends stop signal through the atomic flag
         ClientResponse Request(ServerRequest&& req);
+        // Fetches up to 'limit' messages of a room older than 'cursor' (the newest when 0) into 'out',
+        // oldest first. The reply's data reads '{roomID} {nextCursor} {count} [message]'.
+        ClientResponse FetchHistory(Hash roomID, Hash cursor, unsigned limit, vector<tuple<Hash, Hash, Hash, string>> &out);
+        // Asks for what was missed in each room after the given (room id, last sequence number) pairs.
+        // Deltas land in 'delta' by room, 'statuses' gets each room's (id, outcome, latest sequence number).
+        ClientResponse Resync(const vector<pair<Hash, Hash>> &lastSeen,
+                              map<Hash, vector<tuple<Hash, Hash, Hash, string>>> &delta,
+                              vector<tuple<Hash, ResyncStatus, Hash>> &statuses);
+        // Adds ('type' AddMembers) or removes (RemoveMembers) several members of a room, MEMBERS_MAX_IDS per
+        // request. 'results' gets each id's outcome; the last reply is returned.
+        ClientResponse ChangeMembers(ServerActionType type, Hash roomID, const vector<Hash> &ids,
+                                     vector<pair<Hash, MemberStatus>> &results);
+        // Sends (room id, message) pairs, up to SEND_MAX_MESSAGES of them and IO_BUFFER_SIZE bytes per request;
+        // a message too large for a request of its own is refused by the server. 'ids' gets each one's (message id,
+        // sequence number), zeros for those that were not sent; the last reply is returned.
+        ClientResponse SendMessages(const vector<pair<Hash, string>> &messages, vector<pair<Hash, Hash>> &ids);
+        // Asks who is online in a room, or among everyone sharing a room with the user when 'roomID' is 0.
+        // 'ids' gets up to PRESENCE_LIST_LIMIT of the 'online' ones out of 'members'.
+        ClientResponse QueryPresence(Hash roomID, size_t &online, size_t &members, vector<Hash> &ids);
+
+        // Views a room: its messages are pushed in full from now on, other rooms' only as unread counts.
+        // 'latest' gets the room's last sequence number.
+        ClientResponse Subscribe(Hash roomID, Hash &latest);
+        // Stops viewing a room, or every room when 'roomID' is 0.
+        ClientResponse Unsubscribe(Hash roomID);
+        // Marks a room read up to sequence number 'seq'. It is held for up to ACK_FLUSH_MS and sent with the
+        // other rooms read meanwhile as one AckRead, which is not answered.
+        void AckRead(Hash roomID, Hash seq);
+        // Queues the held acknowledgements right away, e.g. before logging out.
+        void FlushAcks();
 
         function<bool()> isLoggedIn;
         function<void(Hash,string)> event_JoinedRoom;
         function<void(Hash,string)> event_LeftRoom;
-        function<void(Hash, Hash,string)> event_GotMessage;
+        function<void(Hash, Hash, Hash, string)> event_GotMessage;
+        // (account id, online) for each contact whose state changed since the last update.
+        function<void(const vector<pair<Hash, bool>> &)> event_PresenceChanged;
+        // (room id, messages missed) for each room not viewed that had new messages.
+        function<void(const vector<pair<Hash, Hash>> &)> event_UnreadBump;
+        // (room id, unread messages) for every room of the account, once after logging in.
+        function<void(const vector<pair<Hash, Hash>> &)> event_UnreadCounts;
 
         thread* t_Sender;
         thread* t_Receiver;
@@ -52,18 +95,30 @@ namespace src::front::IO {
         shared_ptr<vector<ChatRoomInfo>> RoomsInfo;
         shared_ptr<vector<shared_ptr<ClientResponse>>> IngoingResponses;
         shared_ptr<vector<int>> IngoingPopOrder;
+        shared_ptr<map<Hash, vector<tuple<Hash, Hash, Hash, string>>>> IngoingHistory;
         shared_ptr<vector<ServerRequest>> OutgoingRequests;
+        // Room id -> the sequence number read up to, not yet sent; due at AcksDue.
+        shared_ptr<map<Hash, Hash>> PendingAcks;
+        chrono::steady_clock::time_point AcksDue;
 
         shared_ptr<mutex> m_ConnectionInfo;
         shared_ptr<mutex> m_UserInfo;
         shared_ptr<mutex> m_RoomsInfo;
         shared_ptr<mutex> m_IngoingResponses;
         shared_ptr<mutex> m_IngoingPopOrder;
+        shared_ptr<mutex> m_IngoingHistory;
         shared_ptr<mutex> m_OutgoingRequests;
+        shared_ptr<mutex> m_PendingAcks;
 
         void Setup();
         shared_ptr<ClientResponse> AwaitResponse(int type);
+        // The held acknowledgements as AckRead requests, ACK_MAX_ROOMS rooms each; only those that are
+        // due unless 'all'.
+        vector<ServerRequest> TakeAcks(bool all);
 
+        // Routes one received frame, or one event of an EventBatch, to whoever waits for it. Returns false
+        // once the connection is stopping.
+        bool Dispatch(const shared_ptr<ClientResponse> &response);
         void PushResp(shared_ptr<ClientResponse> response, int order);
         shared_ptr<ClientResponse> PopResp();
         shared_ptr<ClientResponse> PopMessage();
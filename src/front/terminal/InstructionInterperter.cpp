@@ -16,11 +16,14 @@ namespace src::front::terminal {
                 "0:cc/connect-client|-sa %s/--serverAddress %s",
                 "1:sd/shutdown|",
                 "1:sl/show-log|",
+                "1:sm/show-metrics|",
+                "1:st/save-trace|-f %s/--fileName %s",
                 "3:ccr/change-chat-room|-i %i/--roomID %i,-n %s/--roomName %s",
                 "3:msgin/messageIn|-i %i/--roomID %i,-n %s/--roomName %s|-mc %s/--messageContent %s",
                 "5:msg/message|-m %s/--message %s",
                 "2:li/login|-i %i/--ID %i|-k %s/--loginKey %s",
                 "3:lo/logout|",
+                "3:onl/online|",
                 "3:mcr/make-chat-room|-n %s/--name %s|-i %i[]/--clientIDs %i[]",
                 "4:kcr/kill-chat-room|-i %i/-roomID %i",
                 "4:ler/leave-room|-i %i/--roomID %i,-n %s/--roomName %s",
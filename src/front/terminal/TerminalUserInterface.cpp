@@ -3,6 +3,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <csignal>
+#include <fstream>
 
 namespace src::front::terminal {
 
@@ -186,8 +187,8 @@ namespace src::front::terminal {
                         p_User->Rooms.erase(p_User->Rooms.begin() + i);
                     }
                 });
-                p_Host->event_GotMessage = function<void(Hash, Hash, string)>(
-                        [=](Hash sID, Hash rID, const string &msg) {
+                p_Host->event_GotMessage = function<void(Hash, Hash, Hash, string)>(
+                        [=](Hash sID, Hash rID, Hash seq, const string &msg) {
                             {
                                 lock_guard<mutex> guardRooms(m_User);
                                 int i = 0;
@@ -196,16 +197,46 @@ namespace src::front::terminal {
                                         break;
                                     ++i;
                                 }
-                                if (i == p_User->Rooms.size())
+                                if (i == p_User->Rooms.size() || !p_User->Rooms[i].Merge(seq, sID, msg))
                                     return;
                                 cout << "\nYou received a message in ["
                                      << p_User->Rooms[i].DisplayName
                                      << "#"
                                      << p_User->Rooms[i].ID
                                      << "] from user (id=" << sID << ") that reads:" << endl;
-                                p_User->Rooms[i].Messages.emplace_back(sID, msg);
                             }
                             cout << "\t" << msg << endl;
+                            // Shown in the room being viewed means read, acknowledged in batches.
+                            if (rID == curRoomID)
+                                p_Host->AckRead(rID, seq);
+                        });
+                p_Host->event_PresenceChanged = function<void(const vector<pair<Hash, bool>> &)>(
+                        [=](const vector<pair<Hash, bool>> &changes) {
+                            for (auto &[aID, online]: changes)
+                                cout << "\nUser (id=" << aID << ") is now " << (online ? "online" : "offline") << endl;
+                        });
+                p_Host->event_UnreadBump = function<void(const vector<pair<Hash, Hash>> &)>(
+                        [=](const vector<pair<Hash, Hash>> &bumps) {
+                            lock_guard<mutex> guardRooms(m_User);
+                            for (auto &[rID, unread]: bumps)
+                                for (const auto &cur: p_User->Rooms)
+                                    if (cur.ID == rID)
+                                        cout << "\n" << unread << " new message(s) in ["
+                                             << cur.DisplayName << "#" << rID << "]" << endl;
+                        });
+                p_Host->event_UnreadCounts = function<void(const vector<pair<Hash, Hash>> &)>(
+                        [=](const vector<pair<Hash, Hash>> &counts) {
+                            lock_guard<mutex> guardRooms(m_User);
+                            for (auto &[rID, unread]: counts) {
+                                if (!unread)
+                                    continue;
+                                string name;
+                                for (const auto &cur: p_User->Rooms)
+                                    if (cur.ID == rID)
+                                        name = cur.DisplayName;
+                                cout << "\n" << unread << " unread message(s) in ["
+                                     << name << "#" << rID << "]" << endl;
+                            }
                         });
                 PushContext(Context::CLIENT_LOGGED_OUT);
                 cout << "Successfully connected to the server: '" << p_Host->HostAddr << "'" << endl;
@@ -239,11 +270,25 @@ namespace src::front::terminal {
             if (!p_Server)
                 return;
             {
-                lock_guard<mutex> gl(*p_Server->m_Log);
+                lock_guard<ProfiledMutex> gl(*p_Server->m_Log);
                 cout << "Printing log:" << endl;
                 for (auto &cur: p_Server->ServerLog)
                     cout << "\t" << cur << endl;
             }
+        } else if (curName == "sm") {
+            if (!p_Server)
+                return;
+            cout << "Printing metrics:" << endl;
+            cout << p_Server->Stats->Scrape() << LockRegistry::Scrape();
+        } else if (curName == "st") {
+            auto fileName = any_cast<string>(toHandle.Params[0].Value);
+            ofstream out(fileName);
+            if (!out) {
+                cerr << "Failed to open '" << fileName << "' for writing." << endl;
+                return;
+            }
+            Tracer::DumpChromeTrace(out);
+            cout << "Trace was saved to '" << fileName << "'" << endl;
         } else if (curName == "li") {
             Hash id;
             string key;
@@ -300,12 +345,20 @@ namespace src::front::terminal {
             cout << "Server name: '" << s_name << "'" << endl;
             cout << s_msg << endl;
 
-            p_User = make_shared<AccountInfo>();
-            p_User->ID = id;
-            p_User->Name = s_dn;
-            p_User->Key = s_key;
+            {
+                lock_guard<mutex> g_Rooms(m_User);
+                auto previous = p_User;
+                p_User = make_shared<AccountInfo>();
+                p_User->ID = id;
+                p_User->Name = s_dn;
+                p_User->Key = s_key;
+                // Logging back into the same account keeps the rooms, which are then caught up below.
+                if (previous && previous->ID == id)
+                    p_User->Rooms = move(previous->Rooms);
+            }
             p_Host->DisplayName = s_name;
             PushContext(Context::CLIENT_LOGGED_IN);
+            ResyncRooms();
 
         } else if (curName == "ecx") {
             auto cont = FrontContext();
@@ -319,12 +372,12 @@ namespace src::front::terminal {
                 case Context::CLIENT_LOGGED_IN: {
                     if (!AreYouSure("Exiting this context will cause you to logout. Do you wish to proceed?"))
                         return;
-                    stringstream ss{};
-                    ss << p_User->ID << " " << p_User->Key;
-                    p_Host->Request(ServerRequest(ServerActionType::LogoutAccount, p_Host->FDConnection,
-                                                  ss.str()));
+                    p_Host->FlushAcks();
+                    p_Host->Request(ServerRequest(ServerActionType::LogoutAccount, p_Host->FDConnection));
                 }
                 case Context::CLIENT_LOGGED_IN_ROOM: {
+                    if (cont == Context::CLIENT_LOGGED_IN_ROOM)
+                        p_Host->Unsubscribe(curRoomID);
                     curRoomID.store(-1);
                     break;
                 }
@@ -364,7 +417,7 @@ namespace src::front::terminal {
                     ids = any_cast<vector<unsigned long long>>(cur.Value);
             }
             stringstream ss{};
-            ss << p_User->ID << " " << p_User->Key << "|" << roomName;
+            ss << roomName;
             auto resp = p_Host->Request(ServerRequest(ServerActionType::CreateRoom,
                                                       p_Host->FDConnection,
                                                       ss.str()));
@@ -381,31 +434,19 @@ namespace src::front::terminal {
             msg = msg.substr(1, msg.size() - 2);
             cout << msg;
 
-            for (auto &cur: ids) {
-                ss = {};
-                ss << p_User->ID
-                   << " "
-                   << rID
-                   << " "
-                   << cur
-                   << " "
-                   << p_User->Key;
-                auto r = p_Host->Request(ServerRequest(ServerActionType::AddMember,
-                                                       p_Host->FDConnection,
-                                                       ss.str()));
-
-                string rsp = r.Data;
-                rsp = rsp.substr(1, rsp.size() - 2);
-                int stat = (r.Type == classes::general::ClientActionType::InformSuccess) ? 1 :
-                           (r.Type == classes::general::ClientActionType::InformFailure ? 0 : -1);
-                if (stat == -1) {
-                    cout << "CRITICAL ERROR: received illegal response! Aborting." << endl;
-                    return;
-                }
-                if (stat)
-                    cout << rsp;
+            // Every member is added by one request, whose reply carries each one's outcome.
+            vector<pair<Hash, MemberStatus>> results;
+            auto r = p_Host->ChangeMembers(ServerActionType::AddMembers, rID, vector<Hash>(ids.begin(), ids.end()),
+                                           results);
+            if (r.Type == classes::general::ClientActionType::InformFailure)
+                cout << "Failed to add the members '" << r.Data << "'" << endl;
+            for (auto &[id, status]: results) {
+                if (status == MemberStatus::Done)
+                    cout << "Member was successfully added to the chatroom, id = " << id << endl;
+                else if (status == MemberStatus::Unchanged)
+                    cout << "Already a member, id = " << id << endl;
                 else
-                    cout << "Failed to add a member, id = " << cur << "'" << rsp << "'" << endl;
+                    cout << "Failed to add a member, id = " << id << "'The client ID you provided was invalid'" << endl;
             }
             {
                 lock_guard<mutex> guard(m_User);
@@ -413,6 +454,7 @@ namespace src::front::terminal {
             }
             cout << "Chatroom was created" << endl;
         } else if (curName == "ccr") {
+            Hash previousRoomID = curRoomID;
             if (toHandle.Params[0].Type->LongForm == "--roomName") {
                 auto name = any_cast<string>(toHandle.Params[0].Value);
                 {
@@ -440,12 +482,28 @@ namespace src::front::terminal {
                 curRoomID = any_cast<unsigned long long>(toHandle.Params[0].Value);
             if (FrontContext() != Context::CLIENT_LOGGED_IN_ROOM)
                 PushContext(Context::CLIENT_LOGGED_IN_ROOM);
+            else if (previousRoomID != curRoomID)
+                p_Host->Unsubscribe(previousRoomID);
+            // Subscribed first, so no message falls between the history and the pushed ones.
+            Hash latest = 0;
+            auto sub = p_Host->Subscribe(curRoomID, latest);
+            if (sub.Type == classes::general::ClientActionType::InformFailure)
+                cout << sub.Data << endl;
+            // The recent history comes in a single round trip, batched ahead of the reply.
+            vector<tuple<Hash, Hash, Hash, string>> history;
+            auto resp = p_Host->FetchHistory(curRoomID, 0, RECENT_HISTORY, history);
             string name;
             {
                 lock_guard<mutex> g_Rooms(m_User);
                 for (auto &cur: p_User->Rooms)
-                    if (cur.ID == curRoomID)
+                    if (cur.ID == curRoomID) {
                         name = cur.DisplayName;
+                        if (resp.Type == classes::general::ClientActionType::InformSuccess) {
+                            cur.Messages.clear();
+                            for (auto &[mID, seq, sID, msg]: history)
+                                cur.Merge(seq, sID, msg);
+                        }
+                    }
                 cout << "Successfully entered room '"
                      << name
                      << "#"
@@ -453,15 +511,56 @@ namespace src::front::terminal {
                      << "'"
                      << endl;
             }
+            if (resp.Type == classes::general::ClientActionType::InformFailure)
+                cout << resp.Data << endl;
+            for (auto &[mID, seq, sID, msg]: history)
+                cout << "\t(id=" << sID << "): " << msg << endl;
+            // Entering the room reads it up to where the subscription started.
+            if (latest)
+                p_Host->AckRead(curRoomID, latest);
+        } else if (curName == "kr") {
+            auto ids = any_cast<vector<unsigned long long>>(toHandle.Params[0].Value);
+            vector<pair<Hash, MemberStatus>> results;
+            auto r = p_Host->ChangeMembers(ServerActionType::RemoveMembers, curRoomID,
+                                           vector<Hash>(ids.begin(), ids.end()), results);
+            if (r.Type == classes::general::ClientActionType::InformFailure) {
+                cout << r.Data << endl;
+                return;
+            }
+            for (auto &[id, status]: results) {
+                if (status == MemberStatus::Done)
+                    cout << "Member was removed from the chatroom, id = " << id << endl;
+                else if (status == MemberStatus::Unchanged)
+                    cout << "Not a member of the chatroom, id = " << id << endl;
+                else if (status == MemberStatus::NoAccount)
+                    cout << "No such account, id = " << id << endl;
+                else
+                    cout << "Only the host can remove other members, id = " << id << endl;
+            }
+        } else if (curName == "onl") {
+            // Inside a room it is the room's members, elsewhere everyone sharing a room with the user.
+            Hash roomID = FrontContext() == Context::CLIENT_LOGGED_IN_ROOM ? curRoomID.load() : 0;
+            size_t online = 0, members = 0;
+            vector<Hash> ids;
+            auto resp = p_Host->QueryPresence(roomID, online, members, ids);
+            if (resp.Type == classes::general::ClientActionType::InformFailure) {
+                cout << resp.Data << endl;
+                return;
+            }
+            cout << online
+                 << " of "
+                 << members
+                 << (roomID ? " members" : " contacts")
+                 << " are online"
+                 << (ids.empty() ? "." : ":")
+                 << endl;
+            for (Hash id: ids)
+                cout << "\t(id=" << id << ")" << endl;
         } else if (curName == "msg") {
             auto msg = any_cast<string>(toHandle.Params[0].Value);
             auto b_msg = string(msg);
             stringstream ss{};
-            ss << p_User->ID
-               << " "
-               << curRoomID
-               << " "
-               << p_User->Key
+            ss << curRoomID
                << "|"
                << msg;
             auto rsp = p_Host->Request(ServerRequest(ServerActionType::SendMessage,
@@ -471,9 +570,10 @@ namespace src::front::terminal {
                 cout << rsp.Data << endl;
                 return;
             }
-            int mID;
+            Hash mID;
+            Hash seq;
             ss = stringstream{rsp.Data};
-            ss >> mID;
+            ss >> mID >> seq >> ws;
             string out;
             getline(ss, out);
             out = out.substr(1, out.size() - 3);
@@ -482,7 +582,7 @@ namespace src::front::terminal {
                 lock_guard<mutex> g_Rooms(m_User);
                 for (auto &cur: p_User->Rooms) {
                     if (cur.ID == curRoomID) {
-                        cur.Messages.emplace_back(p_User->ID, b_msg);
+                        cur.Merge(seq, p_User->ID, b_msg);
                         break;
                     }
                 }
@@ -490,6 +590,55 @@ namespace src::front::terminal {
         }
     }
 
+    void TerminalUserInterface::ResyncRooms() {
+        vector<pair<Hash, Hash>> lastSeen;
+        {
+            lock_guard<mutex> g_Rooms(m_User);
+            for (auto &cur: p_User->Rooms)
+                lastSeen.emplace_back(cur.ID, cur.LastSeq());
+        }
+        if (lastSeen.empty())
+            return;
+        map<Hash, vector<tuple<Hash, Hash, Hash, string>>> delta;
+        vector<tuple<Hash, ResyncStatus, Hash>> statuses;
+        auto resp = p_Host->Resync(lastSeen, delta, statuses);
+        if (resp.Type != classes::general::ClientActionType::InformSuccess) {
+            cout << resp.Data << endl;
+            return;
+        }
+
+        for (auto &[rID, status, latest]: statuses) {
+            // Rooms too far behind are reloaded from their recent history, like entering them does.
+            vector<tuple<Hash, Hash, Hash, string>> history;
+            if (status == ResyncStatus::Reload)
+                p_Host->FetchHistory(rID, 0, RECENT_HISTORY, history);
+            lock_guard<mutex> g_Rooms(m_User);
+            auto room = find_if(p_User->Rooms.begin(), p_User->Rooms.end(),
+                                [rID = rID](const ChatRoomInfo &cur) { return cur.ID == rID; });
+            if (room == p_User->Rooms.end())
+                continue;
+            if (status == ResyncStatus::Denied) {
+                cout << "You are no longer a member of [" << room->DisplayName << "#" << rID << "]." << endl;
+                p_User->Rooms.erase(room);
+                continue;
+            }
+            if (status == ResyncStatus::Reload) {
+                room->Messages.clear();
+                for (auto &[mID, seq, sID, msg]: history)
+                    room->Merge(seq, sID, msg);
+                cout << "Reloaded [" << room->DisplayName << "#" << rID << "], too much was missed to catch up."
+                     << endl;
+                continue;
+            }
+            size_t missed = 0;
+            for (auto &[mID, seq, sID, msg]: delta[rID])
+                missed += room->Merge(seq, sID, msg);
+            if (missed)
+                cout << "You missed " << missed << " messages in [" << room->DisplayName << "#" << rID << "]."
+                     << endl;
+        }
+    }
+
     bool TerminalUserInterface::AreYouSure(const string &msg) {
         string prompt = msg + " [Y/n]: \n";
         cout << prompt << flush;
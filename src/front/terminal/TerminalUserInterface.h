@@ -14,6 +14,10 @@
 
 using namespace src::classes::server;
 using namespace src::front::IO;
+
+// Messages of history shown when a room is entered.
+#define RECENT_HISTORY 20
+
 namespace src::front::terminal {
 
     class TerminalUserInterface {
@@ -42,6 +46,8 @@ namespace src::front::terminal {
         static void HandleInstruction(const Instruction&);
 
         static bool AreYouSure(const string& msg);
+        // Catches the rooms known from before a reconnect up with what was missed while away.
+        static void ResyncRooms();
 
         static void DisableInputDuringHalt();
         static void RestoreTerminalSettings();